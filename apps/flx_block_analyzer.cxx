@@ -0,0 +1,365 @@
+/**
+ * @file flx_block_analyzer.cxx Summarizes a raw FELIX block capture per
+ * elink, parsing the elinks in parallel with BlockParser<DefaultParserImpl>.
+ *
+ * The capture (BlockRecorder segments, or any files of whole blocks) is
+ * memory-mapped and its block headers scanned in parallel to split it into
+ * per-elink block lists. Every elink is then parsed on its own, spread over
+ * the cores, as the readout would parse it. Per elink it reports blocks,
+ * sequence number gaps, chunk and shortchunk counts, the chunk size
+ * histogram, error flags and, given the byte offset of a 64-bit timestamp in
+ * the chunks, timestamp continuity. Also written as JSON (--json FILE).
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "BlockReplaySource.hpp"
+#include "DefaultParserImpl.hpp"
+#include "FelixStatistics.hpp"
+
+#include "flxlibs/BlockFormat.hpp"
+
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+#include "packetformat/block_parser.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+const std::vector<std::string> length_bin_labels = { "<64",      "64-256",    "256-1k",    "1k-4k", "4k-16k",
+                                                     "16k-64k", "64k-256k", "256k-1M", ">=1M" };
+
+struct Options
+{
+  unsigned threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  int timestamp_offset{ -1 }; // byte offset of a 64-bit timestamp in every chunk; -1: no check
+  uint64_t tick_stride{ 0 };  // NOLINT(build/unsigned) expected timestamp step; 0: only increasing
+  std::string json_file;
+};
+
+struct TimestampCheck
+{
+  uint64_t checked{ 0 };         // NOLINT(build/unsigned)
+  uint64_t frozen{ 0 };          // NOLINT(build/unsigned)
+  uint64_t backwards{ 0 };       // NOLINT(build/unsigned)
+  uint64_t stride_mismatch{ 0 }; // NOLINT(build/unsigned)
+  uint64_t first{ 0 };           // NOLINT(build/unsigned)
+  uint64_t last{ 0 };            // NOLINT(build/unsigned)
+
+  void check(uint64_t ts, uint64_t stride) // NOLINT(build/unsigned)
+  {
+    if (checked == 0) {
+      first = ts;
+    } else if (ts == last) {
+      frozen++;
+    } else if (ts < last) {
+      backwards++;
+    } else if (stride != 0 && ts != last + stride) {
+      stride_mismatch++;
+    }
+    last = ts;
+    checked++;
+  }
+};
+
+struct ElinkAnalysis
+{
+  uint32_t elink{ 0 }; // NOLINT(build/unsigned)
+  std::vector<const char*> blocks;
+  bool trailer_32b{ true };
+  uint64_t seqnr_gaps{ 0 }; // NOLINT(build/unsigned)
+  stats::ParserStatsSnapshot parsed;
+  TimestampCheck timestamps;
+};
+
+// Copies len bytes at offset of a chunk out of its subchunks
+template<class DataPtrs, class Sizes>
+bool
+read_at(DataPtrs data, Sizes sizes, unsigned n_subchunks, std::size_t offset, char* dst, std::size_t len)
+{
+  for (unsigned i = 0; i < n_subchunks && len > 0; ++i) {
+    std::size_t size = sizes[i];
+    if (offset >= size) {
+      offset -= size;
+      continue;
+    }
+    std::size_t n = std::min(len, size - offset);
+    std::memcpy(dst, data[i] + offset, n);
+    dst += n;
+    len -= n;
+    offset = 0;
+  }
+  return len == 0;
+}
+
+// Splits the capture into per-elink block lists, in capture order
+std::vector<ElinkAnalysis>
+split_by_elink(const BlockReplaySource& capture, unsigned n_threads, uint64_t& bad_headers) // NOLINT
+{
+  struct Part
+  {
+    std::map<uint32_t, std::vector<const char*>> elinks; // NOLINT(build/unsigned)
+    std::map<uint32_t, bool> trailer_32b;                // NOLINT(build/unsigned)
+    uint64_t bad_headers{ 0 };                           // NOLINT(build/unsigned)
+  };
+  const std::size_t n_blocks = capture.get_num_blocks();
+  std::vector<Part> parts(n_threads);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t] {
+      Part& part = parts[t];
+      for (std::size_t i = n_blocks * t / n_threads; i < n_blocks * (t + 1) / n_threads; ++i) {
+        const char* block = capture.get_block(i);
+        uint32_t header; // NOLINT(build/unsigned)
+        std::memcpy(&header, block, sizeof(header));
+        const uint32_t sob = blockformat::header_sob(header); // NOLINT(build/unsigned)
+        if (sob != blockformat::sob_32b_trailers && sob != blockformat::sob_16b_trailers) {
+          part.bad_headers++;
+          continue;
+        }
+        const uint32_t elink = blockformat::header_elink(header); // NOLINT(build/unsigned)
+        part.elinks[elink].push_back(block);
+        part.trailer_32b.try_emplace(elink, sob == blockformat::sob_32b_trailers);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::map<uint32_t, ElinkAnalysis> merged; // NOLINT(build/unsigned)
+  bad_headers = 0;
+  for (auto& part : parts) {
+    bad_headers += part.bad_headers;
+    for (auto& [elink, blocks] : part.elinks) {
+      auto [it, inserted] = merged.try_emplace(elink);
+      ElinkAnalysis& e = it->second;
+      if (inserted) {
+        e.elink = elink;
+        e.trailer_32b = part.trailer_32b[elink];
+      }
+      e.blocks.insert(e.blocks.end(), blocks.begin(), blocks.end());
+    }
+  }
+  std::vector<ElinkAnalysis> elinks;
+  for (auto& [elink, e] : merged) {
+    elinks.push_back(std::move(e));
+  }
+  return elinks;
+}
+
+void
+analyze_elink(ElinkAnalysis& e, std::size_t block_size, const Options& opts)
+{
+  DefaultParserImpl impl;
+  auto parser = std::make_unique<felix::packetformat::BlockParser<DefaultParserImpl>>(impl);
+  parser->configure(block_size, e.trailer_32b);
+
+  if (opts.timestamp_offset >= 0) {
+    const std::size_t offset = opts.timestamp_offset;
+    impl.process_chunk_func = [&e, &opts, offset](const felix::packetformat::chunk& chunk) {
+      uint64_t ts; // NOLINT(build/unsigned)
+      if (read_at(chunk.subchunks(), chunk.subchunk_lengths(), chunk.subchunk_number(), offset,
+                  reinterpret_cast<char*>(&ts), sizeof(ts))) { // NOLINT
+        e.timestamps.check(ts, opts.tick_stride);
+      }
+    };
+    impl.process_shortchunk_func = [&e, &opts, offset](const felix::packetformat::shortchunk& shortchunk) {
+      if (shortchunk.length >= offset + sizeof(uint64_t)) { // NOLINT(build/unsigned)
+        uint64_t ts;                                         // NOLINT(build/unsigned)
+        std::memcpy(&ts, shortchunk.data + offset, sizeof(ts));
+        e.timestamps.check(ts, opts.tick_stride);
+      }
+    };
+  }
+
+  uint32_t prev_seqnr = 0; // NOLINT(build/unsigned)
+  for (std::size_t i = 0; i < e.blocks.size(); ++i) {
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, e.blocks[i], sizeof(header));
+    const uint32_t seqnr = blockformat::header_seqnr(header); // NOLINT(build/unsigned)
+    if (i != 0 && seqnr != ((prev_seqnr + 1) & blockformat::max_seqnr)) {
+      e.seqnr_gaps++;
+    }
+    prev_seqnr = seqnr;
+    impl.set_block_header(header);
+    parser->process(felix::packetformat::block_from_bytes(e.blocks[i]));
+  }
+  impl.flush_local_stats();
+  e.parsed = impl.get_stats().snapshot();
+}
+
+nlohmann::json
+to_json(const ElinkAnalysis& e)
+{
+  const auto& p = e.parsed;
+  nlohmann::json histogram;
+  for (std::size_t bin = 0; bin < stats::chunk_length_bins; ++bin) {
+    histogram[length_bin_labels[bin]] = p.chunk_length_hist[bin];
+  }
+  nlohmann::json j = { { "elink", e.elink },
+                       { "trailer_32b", e.trailer_32b },
+                       { "blocks", e.blocks.size() },
+                       { "seqnr_gaps", e.seqnr_gaps },
+                       { "chunks", p.chunk_ctr },
+                       { "shortchunks", p.short_ctr },
+                       { "subchunks", p.subchunk_ctr },
+                       { "chunk_bytes", p.chunk_bytes_ctr },
+                       { "shortchunk_bytes", p.short_bytes_ctr },
+                       { "chunk_length_histogram", histogram },
+                       { "chunks_with_error", p.error_chunk_ctr },
+                       { "shortchunks_with_error", p.error_short_ctr },
+                       { "subchunks_with_error", p.error_subchunk_ctr },
+                       { "blocks_with_error", p.error_block_ctr },
+                       { "subchunk_crc_errors", p.subchunk_crc_error_ctr },
+                       { "subchunk_truncations", p.subchunk_trunc_error_ctr },
+                       { "subchunk_error_flags", p.subchunk_error_ctr } };
+  if (e.timestamps.checked != 0) {
+    j["timestamps"] = { { "checked", e.timestamps.checked },     { "first", e.timestamps.first },
+                        { "last", e.timestamps.last },           { "frozen", e.timestamps.frozen },
+                        { "backwards", e.timestamps.backwards }, { "stride_mismatch", e.timestamps.stride_mismatch } };
+  }
+  return j;
+}
+
+void
+print(const ElinkAnalysis& e)
+{
+  const auto& p = e.parsed;
+  std::ostringstream hist;
+  for (std::size_t bin = 0; bin < stats::chunk_length_bins; ++bin) {
+    if (p.chunk_length_hist[bin] != 0) {
+      hist << " " << length_bin_labels[bin] << ":" << p.chunk_length_hist[bin];
+    }
+  }
+  std::ostringstream line;
+  line << "Elink " << e.elink << ": " << e.blocks.size() << " blocks, " << e.seqnr_gaps << " seqnr gaps, "
+       << p.chunk_ctr << " chunks, " << p.short_ctr << " shortchunks, errors (chunk/short/subchunk/block) "
+       << p.error_chunk_ctr << "/" << p.error_short_ctr << "/" << p.error_subchunk_ctr << "/" << p.error_block_ctr
+       << ", flags (crc/trunc/err) " << p.subchunk_crc_error_ctr << "/" << p.subchunk_trunc_error_ctr << "/"
+       << p.subchunk_error_ctr << ", sizes" << hist.str();
+  if (e.timestamps.checked != 0) {
+    line << ", timestamps " << e.timestamps.first << ".." << e.timestamps.last << " (frozen "
+         << e.timestamps.frozen << ", backwards " << e.timestamps.backwards << ", off stride "
+         << e.timestamps.stride_mismatch << ")";
+  }
+  TLOG() << line.str();
+}
+
+std::vector<std::string>
+split(const std::string& arg)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  BlockReplaySource::Settings settings;
+  Options opts;
+  std::string directory;
+  std::string prefix = "flx-blocks";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--dir" && has_value) {
+      directory = argv[++i];
+    } else if (arg == "--prefix" && has_value) {
+      prefix = argv[++i];
+    } else if (arg == "--files" && has_value) {
+      settings.files = split(argv[++i]);
+    } else if (arg == "--block-size" && has_value) {
+      settings.block_size = std::stoul(argv[++i]);
+    } else if (arg == "--threads" && has_value) {
+      opts.threads = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--timestamp-offset" && has_value) {
+      opts.timestamp_offset = std::stoi(argv[++i]);
+    } else if (arg == "--tick-stride" && has_value) {
+      opts.tick_stride = std::stoull(argv[++i]);
+    } else if (arg == "--json" && has_value) {
+      opts.json_file = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0] << " (--dir DIR [--prefix NAME] | --files F1,F2,...) [--block-size BYTES]"
+             << " [--threads N] [--timestamp-offset BYTES [--tick-stride TICKS]] [--json FILE]";
+      return EXIT_FAILURE;
+    }
+  }
+  if (!directory.empty()) {
+    settings.files = BlockReplaySource::find_segments(directory, prefix);
+  }
+  if (settings.files.empty()) {
+    TLOG() << "No capture files given or found";
+    return EXIT_FAILURE;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  BlockReplaySource capture(settings);
+  uint64_t bad_headers = 0; // NOLINT(build/unsigned)
+  std::vector<ElinkAnalysis> elinks = split_by_elink(capture, opts.threads, bad_headers);
+
+  // Largest elinks first, so the last ones to finish are short
+  std::vector<ElinkAnalysis*> order;
+  for (auto& e : elinks) {
+    order.push_back(&e);
+  }
+  std::sort(order.begin(), order.end(), [](auto* a, auto* b) { return a->blocks.size() > b->blocks.size(); });
+  std::atomic<std::size_t> next{ 0 };
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < std::min<std::size_t>(opts.threads, order.size()); ++t) {
+    workers.emplace_back([&] {
+      for (std::size_t i = next++; i < order.size(); i = next++) {
+        analyze_elink(*order[i], settings.block_size, opts);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  nlohmann::json summary = { { "files", settings.files },
+                             { "block_size", settings.block_size },
+                             { "blocks", capture.get_num_blocks() },
+                             { "bad_headers", bad_headers },
+                             { "elinks", nlohmann::json::array() } };
+  for (auto& e : elinks) {
+    print(e);
+    summary["elinks"].push_back(to_json(e));
+  }
+  TLOG() << capture.get_num_blocks() << " blocks (" << capture.get_num_blocks() * settings.block_size / 1e6
+         << " MB), " << elinks.size() << " elinks, " << bad_headers << " blocks with a bad header; analyzed in "
+         << seconds << " s with " << opts.threads << " threads";
+
+  if (!opts.json_file.empty()) {
+    std::ofstream out(opts.json_file);
+    out << summary.dump(2) << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
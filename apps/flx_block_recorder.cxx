@@ -0,0 +1,151 @@
+/**
+ * @file flx_block_recorder.cxx Records the raw DMA blocks of one FELIX card
+ * SLR to disk at full card bandwidth, for commissioning captures.
+ *
+ * The blocks are written from the DMA ring with O_DIRECT by BlockRecorder;
+ * see BlockRecorder.hpp for the segment and index files. With --software the
+ * blocks come from a software DMA source instead of a card, to try a disk
+ * setup on a machine without FELIX cards. With --export the ring is also
+ * published for flxlibs_ring_follow, to look at the data while recording.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "CardWrapper.hpp"
+#include "RingExport.hpp"
+#include "SoftwareDmaCard.hpp"
+
+#include "flxlibs/BlockRecorder.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+std::atomic<bool> stop_requested{ false };
+
+void
+signal_handler(int /*signal*/)
+{
+  stop_requested = true;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = 4UL << 30;
+  settings.poll_time = 100; // recording holds blocks from the card, see CardWrapper::set_block_recorder
+  BlockRecorder::Settings recorder_settings;
+  double seconds = 10;
+  double software_rate_mbps = 0;
+  std::size_t software_links = 6;
+  std::string export_name;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--card" && has_value) {
+      settings.card_id = std::stoi(argv[++i]);
+    } else if (arg == "--slr" && has_value) {
+      settings.logical_unit = std::stoi(argv[++i]);
+    } else if (arg == "--dma" && has_value) {
+      settings.dma_id = std::stoi(argv[++i]);
+    } else if (arg == "--ring-mb" && has_value) {
+      settings.dma_memory_size = std::stoul(argv[++i]) << 20;
+    } else if (arg == "--seconds" && has_value) {
+      seconds = std::stod(argv[++i]);
+    } else if (arg == "--dir" && has_value) {
+      recorder_settings.directory = argv[++i];
+    } else if (arg == "--prefix" && has_value) {
+      recorder_settings.prefix = argv[++i];
+    } else if (arg == "--segment-mb" && has_value) {
+      recorder_settings.segment_size = std::stoul(argv[++i]) << 20;
+    } else if (arg == "--writers" && has_value) {
+      recorder_settings.writer_threads = std::stoul(argv[++i]);
+    } else if (arg == "--buffered") {
+      recorder_settings.direct_io = false;
+    } else if (arg == "--software" && has_value) {
+      software_rate_mbps = std::stod(argv[++i]);
+    } else if (arg == "--links" && has_value) {
+      software_links = std::stoul(argv[++i]);
+    } else if (arg == "--export" && has_value) {
+      export_name = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0]
+             << " [--card N] [--slr N] [--dma N] [--ring-mb MB] [--seconds S (0: until Ctrl-C)]"
+             << " [--dir DIR] [--prefix NAME] [--segment-mb MB] [--writers N] [--buffered]"
+             << " [--software MB/s [--links N]] [--export SHM_NAME]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::unique_ptr<CardInterface> card;
+  SoftwareDmaCard* sw_card = nullptr;
+  if (software_rate_mbps > 0) {
+    auto software_card = std::make_unique<SoftwareDmaCard>();
+    sw_card = software_card.get();
+    card = std::move(software_card);
+  } else {
+    card = make_flx_card();
+  }
+
+  auto recorder = std::make_shared<BlockRecorder>(recorder_settings);
+  CardWrapper card_wrapper(settings, std::move(card));
+  card_wrapper.set_block_recorder(recorder);
+  if (!export_name.empty()) {
+    card_wrapper.set_ring_export(std::make_shared<RingExport>(export_name));
+  }
+  card_wrapper.configure();
+
+  std::signal(SIGINT, signal_handler);
+  card_wrapper.start();
+  if (sw_card != nullptr) {
+    SoftwareDmaCard::SourceSettings source;
+    source.rate_bytes_per_s = software_rate_mbps * 1e6;
+    for (std::size_t l = 0; l < software_links; ++l) {
+      source.elinks.push_back(l * 64);
+    }
+    sw_card->start_source(settings.dma_id, source);
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t last_bytes = 0; // NOLINT(build/unsigned)
+  while (!stop_requested.load() &&
+         (seconds <= 0 || std::chrono::steady_clock::now() - t0 < std::chrono::duration<double>(seconds))) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto stats = recorder->get_stats();
+    TLOG() << "Recorded " << stats.written_bytes / 1000000 << " MB in " << stats.segments << " segments, "
+           << (stats.written_bytes - last_bytes) / 1e6 << " MB/s, "
+           << (stats.submitted_bytes - recorder->get_retired_bytes()) / 1000000 << " MB in flight"
+           << (stats.write_errors != 0 ? ", " + std::to_string(stats.write_errors) + " write errors" : "");
+    last_bytes = stats.written_bytes;
+  }
+
+  if (sw_card != nullptr) {
+    sw_card->stop_source();
+    auto source_stats = sw_card->get_source_stats();
+    TLOG() << "Software source: " << source_stats.blocks_written << " blocks, " << source_stats.blocks_dropped
+           << " dropped on a full ring";
+  }
+  card_wrapper.stop(); // waits for the recorder
+  auto stats = recorder->get_stats();
+  TLOG() << "Recorded " << stats.written_bytes << " bytes in " << stats.writes << " writes ("
+         << stats.bounced_writes << " through a bounce buffer), " << stats.segments << " segments in "
+         << recorder_settings.directory;
+  return stats.write_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,277 @@
+/**
+ * @file flx_block_replay.cxx Replays a raw block capture through the FELIX
+ * readout chain (block router, ElinkModel parsers) without a card.
+ *
+ * The capture (BlockRecorder segments, or any files of whole blocks) is
+ * memory-mapped and its blocks handed out zero-copy at a set rate, or as fast
+ * as the parsers take them. Every elink found in the capture gets an
+ * ElinkModel of the chosen payload type, with a sink that counts payloads.
+ * Reports parsed chunks, errors and drops per elink, for reproducing
+ * detector data problems and profiling parsers on real traffic.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "BlockReplaySource.hpp"
+#include "BlockRouter.hpp"
+#include "CreateElink.hpp"
+#include "ElinkModel.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+#include "flxlibs/BlockFormat.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+std::atomic<bool> stop_requested{ false };
+
+void
+signal_handler(int /*signal*/)
+{
+  stop_requested = true;
+}
+
+/**
+ * @brief Counts the payloads it is given and discards them.
+ */
+template<typename Datatype>
+class CountingSink : public iomanager::SenderConcept<Datatype>
+{
+public:
+  CountingSink()
+    : iomanager::SenderConcept<Datatype>(iomanager::ConnectionId{ "replay_sink", "Replay" })
+  {}
+
+  void send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override { consume(std::move(data)); }
+  bool try_send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override
+  {
+    consume(std::move(data));
+    return true;
+  }
+  void send_with_topic(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/, std::string /*topic*/) override
+  {
+    consume(std::move(data));
+  }
+  void stop() override {}
+  bool is_ready_for_sending(iomanager::Sender::timeout_t /*timeout*/) override { return true; }
+
+  uint64_t get_payloads() const { return m_payloads.load(); } // NOLINT(build/unsigned)
+
+private:
+  void consume(Datatype&& data)
+  {
+    Datatype dropped(std::move(data));
+    m_payloads.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> m_payloads{ 0 }; // NOLINT(build/unsigned)
+};
+
+struct Options
+{
+  std::string type{ "varsize" };
+  double seconds{ 0 }; // 0: until the capture is played (or Ctrl-C when looping)
+  std::size_t block_queue_capacity{ 100000 };
+};
+
+struct CaptureInfo
+{
+  std::map<uint32_t, uint64_t> elink_blocks; // NOLINT(build/unsigned)
+  bool trailer_32b{ true };
+  uint64_t bad_headers{ 0 }; // NOLINT(build/unsigned)
+};
+
+CaptureInfo
+scan_capture(const BlockReplaySource& source)
+{
+  CaptureInfo info;
+  uint64_t blocks_32b = 0; // NOLINT(build/unsigned)
+  source.for_each_block([&](const char* block) {
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, block, sizeof(header));
+    const uint32_t sob = blockformat::header_sob(header); // NOLINT(build/unsigned)
+    if (sob != blockformat::sob_32b_trailers && sob != blockformat::sob_16b_trailers) {
+      info.bad_headers++;
+      return;
+    }
+    blocks_32b += (sob == blockformat::sob_32b_trailers);
+    info.elink_blocks[blockformat::header_elink(header)]++;
+  });
+  info.trailer_32b = blocks_32b * 2 >= source.get_num_blocks() - info.bad_headers;
+  return info;
+}
+
+template<class Payload, class Wiring>
+bool
+replay(BlockReplaySource& source, const CaptureInfo& info, std::size_t block_size, bool paced, const Options& opts)
+{
+  struct Elink
+  {
+    std::shared_ptr<ElinkModel<Payload>> model;
+    std::shared_ptr<CountingSink<Payload>> sink;
+  };
+  std::map<uint32_t, Elink> elinks; // NOLINT(build/unsigned)
+  typename MapBlockRouter<ElinkModel<Payload>>::elink_map_t models;
+  parsers::ParserOptions parser_opts;
+  for (auto& [elink, blocks] : info.elink_blocks) {
+    auto& e = elinks[elink];
+    e.model = std::make_shared<ElinkModel<Payload>>();
+    e.model->set_ids(0, 0, static_cast<int>(elink / 64), static_cast<int>(elink));
+    e.model->init(opts.block_queue_capacity);
+    e.sink = std::make_shared<CountingSink<Payload>>();
+    e.model->set_sink(e.sink);
+    Wiring::wire(*e.model, parser_opts);
+    e.model->conf(block_size, info.trailer_32b);
+    models[static_cast<int>(elink)] = e.model;
+  }
+
+  // The router of FelixReaderModule; unpaced, it waits for the parsers instead of dropping
+  MapBlockRouter<ElinkModel<Payload>> router(models, !paced);
+  std::function<void(uint64_t)> block_router = std::ref(router); // NOLINT(build/unsigned)
+  source.set_block_addr_handler(block_router);
+
+  for (auto& [elink, e] : elinks) {
+    e.model->start();
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  source.start();
+  uint64_t last_blocks = 0; // NOLINT(build/unsigned)
+  while (!stop_requested.load() && !source.is_done() &&
+         (opts.seconds <= 0 || std::chrono::steady_clock::now() - t0 < std::chrono::duration<double>(opts.seconds))) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t blocks = source.get_blocks_replayed(); // NOLINT(build/unsigned)
+    if (blocks / 100000 != last_blocks / 100000) {
+      TLOG() << "Replayed " << blocks << " blocks, " << source.get_loops() << " loops";
+    }
+    last_blocks = blocks;
+  }
+  source.stop();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // Let the parsers finish the queued blocks
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  for (auto& [elink, e] : elinks) {
+    e.model->stop();
+  }
+
+  bool clean = router.get_unknown_elink() == 0 && router.get_queue_full() == 0;
+  uint64_t payloads = 0; // NOLINT(build/unsigned)
+  for (auto& [elink, e] : elinks) {
+    auto snap = e.model->get_parser().get_stats().snapshot();
+    payloads += e.sink->get_payloads();
+    uint64_t errors = snap.error_chunk_ctr + snap.error_short_ctr + snap.error_block_ctr; // NOLINT(build/unsigned)
+    clean &= errors == 0 && snap.dropped_payload_ctr == 0;
+    TLOG() << "Elink " << elink << ": " << snap.block_ctr << " blocks, " << snap.chunk_ctr << " chunks, "
+           << snap.short_ctr << " shortchunks, " << e.sink->get_payloads() << " payloads, " << errors
+           << " with errors, " << snap.subchunk_crc_error_ctr << " CRC errors, " << snap.dropped_payload_ctr
+           << " dropped";
+  }
+  uint64_t blocks = source.get_blocks_replayed(); // NOLINT(build/unsigned)
+  TLOG() << "Replayed " << blocks << " blocks (" << blocks * block_size / seconds / 1e6 << " MB/s), " << payloads
+         << " payloads (" << payloads / seconds / 1e6 << " M/s); " << router.get_queue_full()
+         << " blocks dropped on full elink queues, " << router.get_unknown_elink() << " of unknown elinks";
+  return clean;
+}
+
+std::vector<std::string>
+split(const std::string& arg)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  BlockReplaySource::Settings settings;
+  Options opts;
+  std::string directory;
+  std::string prefix = "flx-blocks";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--dir" && has_value) {
+      directory = argv[++i];
+    } else if (arg == "--prefix" && has_value) {
+      prefix = argv[++i];
+    } else if (arg == "--files" && has_value) {
+      settings.files = split(argv[++i]);
+    } else if (arg == "--block-size" && has_value) {
+      settings.block_size = std::stoul(argv[++i]);
+    } else if (arg == "--rate" && has_value) {
+      settings.rate_mbps = std::stod(argv[++i]);
+    } else if (arg == "--loop") {
+      settings.loop = true;
+    } else if (arg == "--populate") {
+      settings.populate = true;
+    } else if (arg == "--seconds" && has_value) {
+      opts.seconds = std::stod(argv[++i]);
+    } else if (arg == "--type" && has_value) {
+      opts.type = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0] << " (--dir DIR [--prefix NAME] | --files F1,F2,...) [--block-size BYTES]"
+             << " [--rate MB/s (0: as fast as the parsers go)] [--loop] [--seconds S] [--populate]"
+             << " [--type varsize|daphne|daphnestream]";
+      return EXIT_FAILURE;
+    }
+  }
+  if (!directory.empty()) {
+    settings.files = BlockReplaySource::find_segments(directory, prefix);
+  }
+  if (settings.files.empty()) {
+    TLOG() << "No capture files given or found";
+    return EXIT_FAILURE;
+  }
+
+  BlockReplaySource source(settings);
+  CaptureInfo info = scan_capture(source);
+  TLOG() << "Capture of " << source.get_num_blocks() << " blocks in " << settings.files.size() << " files, "
+         << info.elink_blocks.size() << " elinks, " << (info.trailer_32b ? "32" : "16") << "-bit trailers, "
+         << info.bad_headers << " blocks with a bad header";
+
+  std::signal(SIGINT, signal_handler);
+  const bool paced = settings.rate_mbps > 0;
+  bool clean = false;
+  if (opts.type == "varsize") {
+    clean = replay<fdreadoutlibs::types::VariableSizePayloadTypeAdapter, wiring::VariableSize>(
+      source, info, settings.block_size, paced, opts);
+  } else if (opts.type == "daphne") {
+    clean = replay<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, wiring::MonotonicSuperchunk>(
+      source, info, settings.block_size, paced, opts);
+  } else if (opts.type == "daphnestream") {
+    clean = replay<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter, wiring::StridedSuperchunk>(
+      source, info, settings.block_size, paced, opts);
+  } else {
+    TLOG() << "Unknown payload type " << opts.type;
+    return EXIT_FAILURE;
+  }
+  return clean ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file flx_ring_follow.cxx Follows the DMA ring of a running readout from
+ * another process, through its shared memory export (RingExport.hpp), as
+ * FelixReaderModule publishes it with ring_export on.
+ *
+ * Reads the blocks in place, read-only, and never holds any from the card:
+ * if it falls behind, blocks are lost here and nowhere else. Counts blocks
+ * and sequence number gaps per elink, and optionally writes the intact
+ * blocks to a raw block file that flxlibs_block_replay and
+ * flxlibs_block_analyzer take. --delay-us makes it a slow consumer on
+ * purpose, to see what the primary makes of one (nothing).
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "FelixIssues.hpp"
+#include "RingExport.hpp"
+
+#include "flxlibs/BlockFormat.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+std::atomic<bool> stop_requested{ false };
+
+void
+signal_handler(int /*signal*/)
+{
+  stop_requested = true;
+}
+
+struct ElinkCount
+{
+  uint64_t blocks{ 0 };       // NOLINT(build/unsigned)
+  uint64_t seqnr_gaps{ 0 };   // NOLINT(build/unsigned) between blocks with nothing lost in between
+  uint32_t last_seqnr{ 0 };   // NOLINT(build/unsigned)
+  uint64_t last_skipped{ 0 }; // NOLINT(build/unsigned) lost and torn blocks at the last block
+};
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  std::string name = "/flxlibs-ring-0-0-0";
+  double seconds = 0;
+  double wait_seconds = 10;
+  double delay_us = 0;
+  std::set<uint32_t> elinks; // NOLINT(build/unsigned)
+  std::string output_file;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--name" && has_value) {
+      name = argv[++i];
+    } else if (arg == "--seconds" && has_value) {
+      seconds = std::stod(argv[++i]);
+    } else if (arg == "--wait" && has_value) {
+      wait_seconds = std::stod(argv[++i]);
+    } else if (arg == "--elink" && has_value) {
+      elinks.insert(std::stoul(argv[++i]));
+    } else if (arg == "--delay-us" && has_value) {
+      delay_us = std::stod(argv[++i]);
+    } else if (arg == "--output" && has_value) {
+      output_file = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--name SHM_NAME] [--seconds S (0: until the primary stops or Ctrl-C)]"
+             << " [--wait S] [--elink N]... [--delay-us US] [--output FILE]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The primary creates the export when it starts
+  std::unique_ptr<RingExportReader> reader;
+  auto t_wait = std::chrono::steady_clock::now();
+  while (reader == nullptr) {
+    try {
+      reader = std::make_unique<RingExportReader>(name);
+    } catch (const RingExportError& ex) {
+      if (std::chrono::steady_clock::now() - t_wait > std::chrono::duration<double>(wait_seconds)) {
+        ers::error(ex);
+        return EXIT_FAILURE;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+  const std::size_t block_size = reader->get_block_size();
+  TLOG() << "Following " << name << ": " << reader->get_ring_size() / 1000000 << " MB ring of " << block_size
+         << " byte blocks";
+
+  std::ofstream output;
+  if (!output_file.empty()) {
+    output.open(output_file, std::ios::binary);
+  }
+  std::vector<char> copy(block_size);
+  std::map<uint32_t, ElinkCount> counts; // NOLINT(build/unsigned)
+  uint64_t bad_blocks = 0;               // NOLINT(build/unsigned) intact, but not a block
+
+  std::signal(SIGINT, signal_handler);
+  const auto t0 = std::chrono::steady_clock::now();
+  auto t_report = t0;
+  uint64_t last_blocks = 0; // NOLINT(build/unsigned)
+  RingExportReader::Block block;
+  while (!stop_requested.load() &&
+         (seconds <= 0 || std::chrono::steady_clock::now() - t0 < std::chrono::duration<double>(seconds))) {
+    if (!reader->next(block)) {
+      if (!reader->primary_running() && reader->get_backlog() == 0) {
+        TLOG() << "The primary stopped";
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } else if (elinks.empty() || elinks.count(blockformat::header_elink(block.header)) != 0) {
+      if (!output_file.empty()) {
+        std::memcpy(copy.data(), block.data, block_size);
+      } else {
+        std::memcpy(copy.data(), block.data, blockformat::header_size);
+      }
+      if (delay_us > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(delay_us));
+      }
+      if (reader->still_valid(block)) {
+        uint32_t header; // NOLINT(build/unsigned)
+        std::memcpy(&header, copy.data(), sizeof(header));
+        const uint32_t sob = blockformat::header_sob(header); // NOLINT(build/unsigned)
+        if (header != block.header ||
+            (sob != blockformat::sob_32b_trailers && sob != blockformat::sob_16b_trailers)) {
+          bad_blocks++;
+        } else {
+          auto stats = reader->get_stats();
+          auto& count = counts[blockformat::header_elink(header)];
+          const uint32_t seqnr = blockformat::header_seqnr(header); // NOLINT(build/unsigned)
+          if (count.blocks != 0 && count.last_skipped == stats.lost_blocks + stats.torn_blocks &&
+              seqnr != ((count.last_seqnr + 1) & blockformat::max_seqnr)) {
+            count.seqnr_gaps++;
+          }
+          count.blocks++;
+          count.last_seqnr = seqnr;
+          count.last_skipped = stats.lost_blocks + stats.torn_blocks;
+          if (output.is_open()) {
+            output.write(copy.data(), static_cast<std::streamsize>(block_size));
+          }
+        }
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - t_report >= std::chrono::seconds(1)) {
+      auto stats = reader->get_stats();
+      TLOG() << (stats.blocks - last_blocks) * block_size / 1e6 << " MB/s, " << stats.blocks << " blocks, "
+             << stats.lost_blocks << " lost, " << stats.torn_blocks << " torn, backlog " << reader->get_backlog()
+             << " blocks";
+      last_blocks = stats.blocks;
+      t_report = now;
+    }
+  }
+
+  auto stats = reader->get_stats();
+  TLOG() << "Followed " << stats.blocks << " blocks: " << stats.lost_blocks << " lost to the card, "
+         << stats.torn_blocks << " overwritten while read, " << bad_blocks << " bad, " << stats.generations
+         << " runs";
+  for (const auto& [elink, count] : counts) {
+    TLOG() << "  elink " << elink << ": " << count.blocks << " blocks, " << count.seqnr_gaps << " sequence gaps";
+  }
+  return bad_blocks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
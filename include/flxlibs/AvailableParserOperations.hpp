@@ -10,6 +10,9 @@
 #define FLXLIBS_INCLUDE_FLXLIBS_AVAILABLEPARSEROPERATIONS_HPP_
 
 #include "FelixIssues.hpp"
+#include "FelixStatistics.hpp"
+#include "flxlibs/ErrorChunkPool.hpp"
+#include "flxlibs/GatherKernels.hpp"
 
 #include "iomanager/Sender.hpp"
 
@@ -18,15 +21,41 @@
 #include "packetformat/block_format.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <memory>
 #include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace dunedaq {
 namespace flxlibs {
 namespace parsers {
 
+/**
+ * @brief Tunables shared by the parser operations of an elink.
+ *
+ * In non-blocking mode a payload is offered to the sink with zero-timeout
+ * try_send calls, yielding the CPU before every retry, and dropped (and
+ * accounted for) once the retries are used up. The parser never sleeps on a
+ * stuck consumer, so it keeps up with the card and its block queue does not
+ * overflow. A backoff that sleeps between retries can be configured, but
+ * every payload pays it while the consumer stays stuck.
+ */
+struct ParserOptions
+{
+  bool non_blocking_send{ true };                ///< Use try_send instead of a blocking send
+  unsigned send_retries{ 3 };                    ///< Extra try_send attempts before a payload is dropped
+  std::chrono::microseconds send_retry_backoff{ 0 }; ///< Pause before the first retry, doubled on every further one; 0 yields
+  std::chrono::milliseconds send_timeout{ 100 }; ///< Timeout of the blocking send
+  bool check_timestamps{ false };                ///< Check superchunk timestamp continuity where supported
+  bool coalesce_shortchunks{ false };            ///< Pack the shortchunks of a block/time window into one payload
+  std::chrono::microseconds coalesce_window{ 0 }; ///< Coalescing window; 0 packs per block
+  std::size_t coalesce_max_bytes{ 64 * 1024 };   ///< Flush when this much shortchunk data is staged
+  std::size_t coalesce_max_messages{ 1024 };     ///< Flush when this many shortchunks are staged
+};
+
 inline void
 print_bytes(std::ostream& ostr, const char* title, const unsigned char* data, std::size_t length, bool format = true)
 {
@@ -41,6 +70,9 @@ print_bytes(std::ostream& ostr, const char* title, const unsigned char* data, st
   ostr << std::endl;
 }
 
+/**
+ * @brief Legacy ring-buffer aware copy. The parser operations use gather_subchunks.
+ */
 inline void
 dump_to_buffer(const char* data,
                std::size_t size,
@@ -60,12 +92,51 @@ dump_to_buffer(const char* data,
   }
 }
 
+template<class Payload>
+inline bool
+send_or_drop(std::shared_ptr<iomanager::SenderConcept<Payload>>& sink,
+             Payload&& payload,
+             std::size_t bytes,
+             stats::ParserLocalStats& stats,
+             const ParserOptions& opts)
+{
+  if (opts.non_blocking_send) {
+    // The queue leaves the payload untouched when it can't take it, so it can be offered again.
+    auto backoff = opts.send_retry_backoff;
+    for (unsigned attempt = 0; attempt <= opts.send_retries; ++attempt) {
+      if (attempt > 0) {
+        stats.send_retry_ctr++;
+        if (backoff.count() > 0) {
+          std::this_thread::sleep_for(backoff);
+          backoff *= 2;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      if (sink->try_send(std::move(payload), std::chrono::milliseconds(0))) {
+        return true;
+      }
+    }
+  } else {
+    try {
+      sink->send(std::move(payload), opts.send_timeout);
+      return true;
+    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
+      // accounted below, reported periodically by the ElinkModel
+    }
+  }
+  stats.dropped_payload_ctr++;
+  stats.dropped_bytes_ctr += bytes;
+  return false;
+}
+
 template<class TargetStruct>
 inline std::function<void(const felix::packetformat::chunk& chunk)>
 fixsizedChunkInto(std::shared_ptr<iomanager::SenderConcept<TargetStruct>>& sink,
-                  std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                  stats::ParserLocalStats& stats,
+                  const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::chunk& chunk) {
+  return [&sink, &stats, opts](const felix::packetformat::chunk& chunk) {
     // Chunk info
     auto subchunk_data = chunk.subchunks();
     auto subchunk_sizes = chunk.subchunk_lengths();
@@ -77,28 +148,67 @@ fixsizedChunkInto(std::shared_ptr<iomanager::SenderConcept<TargetStruct>>& sink,
       ers::error(UnexpectedChunk(ERS_HERE, chunk.length(), target_size));
     } else {
       TargetStruct payload;
-      uint32_t bytes_copied_chunk = 0; // NOLINT
-      for (unsigned i = 0; i < n_subchunks; i++) {
-        dump_to_buffer(
-          subchunk_data[i], subchunk_sizes[i], static_cast<void*>(&payload.data), bytes_copied_chunk, target_size);
-        bytes_copied_chunk += subchunk_sizes[i];
-      }
-      try {
-        // finally, push to sink
-        sink->send(std::move(payload), timeout);
-      } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-        // ers::error(ParserOperationQueuePushFailure(ERS_HERE, " "));
+      gather_fixed_size<sizeof(TargetStruct)>(
+        subchunk_data, subchunk_sizes, n_subchunks, static_cast<void*>(&payload.data));
+      // finally, push to sink
+      send_or_drop(sink, std::move(payload), target_size, stats, opts);
+    }
+  };
+}
+
+/**
+ * @brief Fixed size superchunks into a sink, checking timestamp continuity on the way.
+ *
+ * The first-frame timestamp is read from the payload that was just gathered,
+ * so the check touches one word that is already in cache. With a non-zero
+ * expected_stride every superchunk must be exactly that many ticks after the
+ * previous one; with zero (self-triggered streams) timestamps must only increase.
+ */
+template<class TargetStruct>
+inline std::function<void(const felix::packetformat::chunk& chunk)>
+timestampedChunkInto(std::shared_ptr<iomanager::SenderConcept<TargetStruct>>& sink,
+                     stats::ParserLocalStats& stats,
+                     const ParserOptions& opts,
+                     uint64_t expected_stride) // NOLINT(build/unsigned)
+{
+  if (!opts.check_timestamps) {
+    return fixsizedChunkInto<TargetStruct>(sink, stats, opts);
+  }
+  return [&sink, &stats, opts, expected_stride, prev_ts = uint64_t(0)](const felix::packetformat::chunk& chunk) mutable {
+    std::size_t target_size = sizeof(TargetStruct);
+    if (chunk.length() != target_size) {
+      ers::error(UnexpectedChunk(ERS_HERE, chunk.length(), target_size));
+      return;
+    }
+    TargetStruct payload;
+    gather_fixed_size<sizeof(TargetStruct)>(
+      chunk.subchunks(), chunk.subchunk_lengths(), chunk.subchunk_number(), static_cast<void*>(&payload.data));
+
+    uint64_t ts = payload.get_timestamp(); // NOLINT(build/unsigned)
+    if (prev_ts != 0) {
+      if (ts == prev_ts) {
+        stats.timestamp_frozen_ctr++;
+      } else if ((expected_stride != 0 && ts != prev_ts + expected_stride) || (expected_stride == 0 && ts < prev_ts)) {
+        stats.timestamp_discontinuity_ctr++;
       }
     }
+    if (stats.first_timestamp == 0) {
+      stats.first_timestamp = ts;
+    }
+    stats.last_timestamp = ts;
+    prev_ts = ts;
+
+    send_or_drop(sink, std::move(payload), target_size, stats, opts);
   };
 }
 
 template<class TargetStruct>
 inline std::function<void(const felix::packetformat::shortchunk& shortchunk)>
 fixsizedShortchunkInto(std::shared_ptr<iomanager::SenderConcept<TargetStruct>>& sink,
-                       std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                       stats::ParserLocalStats& stats,
+                       const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::shortchunk& shortchunk) {
+  return [&sink, &stats, opts](const felix::packetformat::shortchunk& shortchunk) {
     // Only dump to buffer if possible
     std::size_t target_size = sizeof(TargetStruct);
     if (shortchunk.length != target_size) {
@@ -108,12 +218,8 @@ fixsizedShortchunkInto(std::shared_ptr<iomanager::SenderConcept<TargetStruct>>&
     } else {
       TargetStruct payload;
       std::memcpy(static_cast<char*>(payload), shortchunk.data, target_size);
-      try {
-        // finally, push to sink
-        sink->send(std::move(payload), timeout);
-      } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-        // ers::error(ParserOperationQueuePushFailure(ERS_HERE, " "));
-      }
+      // finally, push to sink
+      send_or_drop(sink, std::move(payload), target_size, stats, opts);
     }
   };
 }
@@ -122,9 +228,10 @@ template<class TargetStruct>
 inline std::function<void(const felix::packetformat::chunk& chunk)>
 fixsizedChunkViaHeap(std::shared_ptr<iomanager::SenderConcept<TargetStruct*>>& sink,
                      // std::shared_ptr<iomanager::SenderConcept<std::unique_ptr<TargetStruct>>>& sink,
-                     std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                     stats::ParserLocalStats& stats,
+                     const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::chunk& chunk) {
+  return [&sink, &stats, opts](const felix::packetformat::chunk& chunk) {
     // Chunk info
     auto subchunk_data = chunk.subchunks();
     auto subchunk_sizes = chunk.subchunk_lengths();
@@ -138,20 +245,11 @@ fixsizedChunkViaHeap(std::shared_ptr<iomanager::SenderConcept<TargetStruct*>>& s
     } else {
       TargetStruct* payload = new TargetStruct[sizeof(TargetStruct)];
       // std::unique_ptr<TargetStruct> payload = std::make_unique<TargetStruct>();
-      uint_fast32_t bytes_copied_chunk = 0; // NOLINT
-      for (unsigned i = 0; i < n_subchunks; i++) {
-        dump_to_buffer(subchunk_data[i],
-                       subchunk_sizes[i],
-                       static_cast<void*>(payload), // static_cast<void*>(&payload_ptr->data),
-                       bytes_copied_chunk,
-                       target_size);
-        bytes_copied_chunk += subchunk_sizes[i];
-      }
-      try {
-        // finally, push to sink
-        sink->send(std::move(payload), timeout); // std::move(std::make_unique<TargetStruct>(payload)), timeout);
-      } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-        // ers::error(ParserOperationQueuePushFailure(ERS_HERE, " "));
+      gather_subchunks(subchunk_data, subchunk_sizes, n_subchunks, static_cast<void*>(payload), target_size);
+      // finally, push to sink
+      TargetStruct* sent = payload;
+      if (!send_or_drop(sink, std::move(sent), target_size, stats, opts)) {
+        delete[] payload; // NOLINT
       }
     }
   };
@@ -160,108 +258,240 @@ fixsizedChunkViaHeap(std::shared_ptr<iomanager::SenderConcept<TargetStruct*>>& s
 template<class TargetWithDatafield>
 inline std::function<void(const felix::packetformat::chunk&)>
 varsizedChunkIntoWithDatafield(std::shared_ptr<iomanager::SenderConcept<TargetWithDatafield>>& sink,
-                               std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                               stats::ParserLocalStats& stats,
+                               const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::chunk& chunk) {
+  return [&sink, &stats, opts](const felix::packetformat::chunk& chunk) {
     auto subchunk_data = chunk.subchunks();
     auto subchunk_sizes = chunk.subchunk_lengths();
     auto n_subchunks = chunk.subchunk_number();
     TargetWithDatafield twd;
     twd.get_data().reserve(chunk.length());
-    uint32_t bytes_copied_chunk = 0;
-    for (unsigned i = 0; i< n_subchunks; ++i) {
-      dump_to_buffer(subchunk_data[i],
-                     subchunk_sizes[i],
-                     static_cast<void*>(twd.get_data().data()),
-                     bytes_copied_chunk,
-                     chunk.length());
-      bytes_copied_chunk += subchunk_sizes[i];
-    }
+    auto bytes_copied_chunk =
+      gather_subchunks(subchunk_data, subchunk_sizes, n_subchunks, twd.get_data().data(), chunk.length());
     twd.set_data_size(bytes_copied_chunk);
-    try {
-      sink->send(std::move(twd), timeout);
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      // ers::error
-    }
+    send_or_drop(sink, std::move(twd), bytes_copied_chunk, stats, opts);
   };
 }
 
 template<class TargetWithDatafield>
 inline std::function<void(const felix::packetformat::shortchunk&)>
 varsizedShortchunkIntoWithDatafield(std::shared_ptr<iomanager::SenderConcept<TargetWithDatafield>>& sink,
-                               std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                                    stats::ParserLocalStats& stats,
+                                    const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::shortchunk& shortchunk) {
+  return [&sink, &stats, opts](const felix::packetformat::shortchunk& shortchunk) {
     TargetWithDatafield twd;
     twd.get_data().reserve(shortchunk.length);
     std::memcpy(static_cast<void*>(twd.get_data().data()), shortchunk.data, shortchunk.length);
     twd.set_data_size(shortchunk.length);
-    try {
-      sink->send(std::move(twd), timeout);
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      // ers::error
-    }
+    send_or_drop(sink, std::move(twd), shortchunk.length, stats, opts);
   };
 }
 
 inline std::function<void(const felix::packetformat::chunk& chunk)>
 varsizedChunkIntoWrapper(std::shared_ptr<iomanager::SenderConcept<fdreadoutlibs::types::VariableSizePayloadTypeAdapter>>& sink,
-                         std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                         stats::ParserLocalStats& stats,
+                         const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::chunk& chunk) {
+  return [&sink, &stats, opts](const felix::packetformat::chunk& chunk) {
     auto subchunk_data = chunk.subchunks();
     auto subchunk_sizes = chunk.subchunk_lengths();
     auto n_subchunks = chunk.subchunk_number();
     auto chunk_length = chunk.length();
 
     char* payload = static_cast<char*>(malloc(chunk_length * sizeof(char)));
-    uint32_t bytes_copied_chunk = 0; // NOLINT(build/unsigned)
-    for (unsigned i = 0; i < n_subchunks; ++i) {
-      dump_to_buffer(
-        subchunk_data[i], subchunk_sizes[i], static_cast<void*>(payload), bytes_copied_chunk, chunk_length);
-      bytes_copied_chunk += subchunk_sizes[i];
-    }
+    gather_subchunks(subchunk_data, subchunk_sizes, n_subchunks, static_cast<void*>(payload), chunk_length);
     fdreadoutlibs::types::VariableSizePayloadTypeAdapter payload_wrapper(chunk_length, payload);
-    try {
-      sink->send(std::move(payload_wrapper), timeout);
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      // ers
-    }
+    send_or_drop(sink, std::move(payload_wrapper), chunk_length, stats, opts);
   };
 }
 
 inline std::function<void(const felix::packetformat::shortchunk& shortchunk)>
 varsizedShortchunkIntoWrapper(std::shared_ptr<iomanager::SenderConcept<fdreadoutlibs::types::VariableSizePayloadTypeAdapter>>& sink,
-                              std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+                              stats::ParserLocalStats& stats,
+                              const ParserOptions& opts = ParserOptions())
 {
-  return [&](const felix::packetformat::shortchunk& shortchunk) {
+  return [&sink, &stats, opts](const felix::packetformat::shortchunk& shortchunk) {
     auto shortchunk_length = shortchunk.length;
     char* payload = static_cast<char*>(malloc(shortchunk_length * sizeof(char)));
     std::memcpy(payload, shortchunk.data, shortchunk_length);
     fdreadoutlibs::types::VariableSizePayloadTypeAdapter payload_wrapper(shortchunk_length, payload);
-    try {
-      sink->send(std::move(payload_wrapper), timeout);
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      // ers
+    send_or_drop(sink, std::move(payload_wrapper), shortchunk_length, stats, opts);
+  };
+}
+
+
+/**
+ * @brief Packs many shortchunks into one variable size payload.
+ *
+ * Payload layout (native endianness):
+ *   uint32_t n_messages;
+ *   uint32_t offsets[n_messages + 1]; // into the data region, offsets[n_messages] is its length
+ *   char data[];
+ *
+ * Shortchunks are staged in preallocated buffers and flushed with a single
+ * allocation and send once the window has elapsed, at a block boundary or
+ * while the parser waits for blocks, when the staging buffers fill up, and
+ * at stop (see coalescedFlush). Chunks on the same elink flush the staged
+ * shortchunks first, so message order is kept.
+ */
+class ShortchunkCoalescer
+{
+public:
+  using payload_t = fdreadoutlibs::types::VariableSizePayloadTypeAdapter;
+  using sink_t = iomanager::SenderConcept<payload_t>;
+
+  ShortchunkCoalescer(std::shared_ptr<sink_t>& sink, stats::ParserLocalStats& stats, const ParserOptions& opts)
+    : m_sink(sink)
+    , m_stats(stats)
+    , m_opts(opts)
+    , m_data(opts.coalesce_max_bytes)
+    , m_offsets(opts.coalesce_max_messages + 1, 0)
+  {}
+
+  void add(const char* data, std::size_t length)
+  {
+    if (m_count == m_opts.coalesce_max_messages || m_used + length > m_data.size()) {
+      flush();
+    }
+    if (length > m_data.size()) { // can never be staged, goes out on its own
+      const uint32_t offsets[2] = { 0, static_cast<uint32_t>(length) }; // NOLINT(build/unsigned)
+      pack(data, length, offsets, 1);
+      return;
     }
+    if (m_count == 0) {
+      m_window_start = std::chrono::steady_clock::now();
+    }
+    std::memcpy(m_data.data() + m_used, data, length);
+    m_used += length;
+    m_offsets[++m_count] = static_cast<uint32_t>(m_used); // NOLINT(build/unsigned)
+  }
+
+  void flush_if_due()
+  {
+    if (m_count != 0 && (m_opts.coalesce_window.count() == 0 ||
+                         std::chrono::steady_clock::now() - m_window_start >= m_opts.coalesce_window)) {
+      flush();
+    }
+  }
+
+  void flush()
+  {
+    if (m_count == 0) {
+      return;
+    }
+    pack(m_data.data(), m_used, m_offsets.data(), m_count);
+    m_count = 0;
+    m_used = 0;
+  }
+
+private:
+  void pack(const char* data, std::size_t length, const uint32_t* offsets, std::size_t n_messages) // NOLINT
+  {
+    const std::size_t header = sizeof(uint32_t) * (n_messages + 2);
+    const std::size_t total = header + length;
+    char* payload = static_cast<char*>(malloc(total * sizeof(char)));
+    uint32_t n = static_cast<uint32_t>(n_messages); // NOLINT(build/unsigned)
+    std::memcpy(payload, &n, sizeof(n));
+    std::memcpy(payload + sizeof(n), offsets, sizeof(uint32_t) * (n_messages + 1));
+    std::memcpy(payload + header, data, length);
+    payload_t payload_wrapper(total, payload);
+    send_or_drop(m_sink, std::move(payload_wrapper), total, m_stats, m_opts);
+    m_stats.coalesced_payload_ctr++;
+  }
+
+  std::shared_ptr<sink_t>& m_sink;
+  stats::ParserLocalStats& m_stats;
+  ParserOptions m_opts;
+
+  std::vector<char> m_data;
+  std::vector<uint32_t> m_offsets; // NOLINT(build/unsigned)
+  std::size_t m_used{ 0 };
+  std::size_t m_count{ 0 };
+  std::chrono::steady_clock::time_point m_window_start;
+};
+
+inline std::function<void(const felix::packetformat::shortchunk& shortchunk)>
+coalescedShortchunkInto(std::shared_ptr<ShortchunkCoalescer> coalescer)
+{
+  return [coalescer](const felix::packetformat::shortchunk& shortchunk) {
+    coalescer->add(shortchunk.data, shortchunk.length);
   };
 }
 
+inline std::function<void(const felix::packetformat::block& block)>
+coalescedBlockBoundary(std::shared_ptr<ShortchunkCoalescer> coalescer)
+{
+  return [coalescer](const felix::packetformat::block& /*block*/) { coalescer->flush_if_due(); };
+}
 
-inline std::function<void(const felix::packetformat::chunk& chunk)>
-errorChunkIntoSink(std::shared_ptr<iomanager::SenderConcept<felix::packetformat::chunk>>& sink,
-                   std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
+inline std::function<void(bool force)>
+coalescedFlush(std::shared_ptr<ShortchunkCoalescer> coalescer)
 {
-  return [&](const felix::packetformat::chunk& chunk) {
-    try {
-      auto payload = chunk;
-      sink->send(std::move(payload), timeout);
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      // ers
+  return [coalescer](bool force) {
+    if (force) {
+      coalescer->flush();
+    } else {
+      coalescer->flush_if_due();
     }
   };
 }
 
+inline std::function<void(const felix::packetformat::chunk& chunk)>
+coalescedChunkIntoWrapper(std::shared_ptr<ShortchunkCoalescer> coalescer,
+                          std::shared_ptr<iomanager::SenderConcept<fdreadoutlibs::types::VariableSizePayloadTypeAdapter>>& sink,
+                          stats::ParserLocalStats& stats,
+                          const ParserOptions& opts = ParserOptions())
+{
+  auto chunk_into = varsizedChunkIntoWrapper(sink, stats, opts);
+  return [coalescer, chunk_into](const felix::packetformat::chunk& chunk) {
+    coalescer->flush();
+    chunk_into(chunk);
+  };
+}
+
+/**
+ * @brief Deep copies malformed chunks into records of a preallocated pool and
+ * sends them to the error sink, if there is one.
+ *
+ * The chunk only points into the DMA ring, which the card overwrites once the
+ * read pointer moves on, so its bytes are copied before leaving the parser
+ * thread. Nothing is allocated here: without a free record (pool exhausted, or
+ * rate limit reached) the chunk is only counted.
+ */
+inline std::function<void(const felix::packetformat::chunk& chunk)>
+errorChunkIntoSink(std::shared_ptr<iomanager::SenderConcept<ErrorChunkHandle>>& sink,
+                   std::shared_ptr<ErrorChunkPool>& pool,
+                   const uint32_t& block_header, // NOLINT(build/unsigned)
+                   stats::ParserLocalStats& stats,
+                   const ParserOptions& opts = ParserOptions())
+{
+  return [&sink, &pool, &block_header, &stats, opts](const felix::packetformat::chunk& chunk) {
+    if (sink == nullptr || pool == nullptr) {
+      return;
+    }
+    auto record = pool->acquire();
+    if (!record) {
+      stats.error_capture_skipped_ctr++;
+      return;
+    }
+    record->capture_time_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record->block_header = block_header;
+    record->chunk_length = chunk.length();
+    record->n_subchunks = chunk.subchunk_number();
+    record->captured_length = static_cast<uint32_t>(gather_subchunks(chunk.subchunks(), // NOLINT(build/unsigned)
+                                                                     chunk.subchunk_lengths(),
+                                                                     chunk.subchunk_number(),
+                                                                     record->data,
+                                                                     ErrorChunkRecord::max_captured_bytes)); // NOLINT
+    std::size_t bytes = record->captured_length;
+    if (send_or_drop(sink, std::move(record), bytes, stats, opts)) {
+      stats.error_capture_ctr++;
+    }
+  };
+}
 
 //// Implement here any other DUNE specific FELIX chunk/block to User payload parsers
 
@@ -0,0 +1,94 @@
+/**
+ * @file BlockEncoder.hpp Software FELIX to-host block encoder: packs
+ * per-elink chunk streams into blocks the way the card's firmware does.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_BLOCKENCODER_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_BLOCKENCODER_HPP_
+
+#include "flxlibs/BlockFormat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace dunedaq {
+namespace flxlibs {
+
+/**
+ * @brief Every elink has one open block. A chunk is appended to it as a
+ * single BOTH subchunk when it fits; otherwise it is split into FIRST,
+ * MIDDLE and LAST subchunks over consecutive blocks of the same elink.
+ * A block is closed, and handed to the block handler, once there is no
+ * room for another subchunk or on flush(); the rest of it is filled with
+ * a null subchunk. Sequence numbers count closed blocks per elink.
+ */
+class BlockEncoder
+{
+public:
+  using block_handler_t = std::function<void(const char* block)>;
+
+  // Error flags of a chunk, set on the trailer of its last subchunk
+  struct ChunkFlags
+  {
+    bool truncated{ false };
+    bool error{ false };
+    bool crc_error{ false };
+  };
+
+  /**
+   * @param block_size Block size in bytes (1024 with 16-bit trailers on
+   *        older firmware, 4096 with 32-bit trailers)
+   * @param trailer_32b Trailer size
+   * @param handler Called with every closed block, valid during the call only
+   */
+  BlockEncoder(std::size_t block_size, bool trailer_32b, block_handler_t handler);
+
+  void add_chunk(uint32_t elink, const char* data, std::size_t length); // NOLINT(build/unsigned)
+  void add_chunk(uint32_t elink, const char* data, std::size_t length, const ChunkFlags& flags); // NOLINT
+
+  // Caps the subchunk length below what the trailer allows, to split chunks into more subchunks
+  void set_max_subchunk_length(std::size_t length);
+
+  // Closes the open block of an elink, as the card does on a timeout
+  void flush(uint32_t elink); // NOLINT(build/unsigned)
+  void flush_all();
+
+  std::size_t get_block_size() const { return m_block_size; }
+  bool is_32b_trailers() const { return m_trailer_32b; }
+  uint64_t get_num_blocks() const { return m_num_blocks; }       // NOLINT(build/unsigned)
+  uint64_t get_num_subchunks() const { return m_num_subchunks; } // NOLINT(build/unsigned)
+
+private:
+  struct OpenBlock
+  {
+    std::vector<char> data;
+    std::size_t used{ 0 };
+    uint32_t seqnr{ 0 }; // NOLINT(build/unsigned)
+    bool open{ false };
+  };
+
+  OpenBlock& open_block(uint32_t elink); // NOLINT(build/unsigned)
+  void close_block(OpenBlock& block);
+  void write_trailer(OpenBlock& block, const blockformat::Trailer& trailer);
+
+  const std::size_t m_block_size;
+  const bool m_trailer_32b;
+  const std::size_t m_trailer_size;
+  std::size_t m_max_subchunk_length;
+  const uint32_t m_sob; // NOLINT(build/unsigned)
+  block_handler_t m_handler;
+
+  std::vector<OpenBlock> m_elinks; // indexed by elink
+  uint64_t m_num_blocks{ 0 };      // NOLINT(build/unsigned)
+  uint64_t m_num_subchunks{ 0 };   // NOLINT(build/unsigned)
+};
+
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_BLOCKENCODER_HPP_
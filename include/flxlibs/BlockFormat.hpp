@@ -0,0 +1,129 @@
+/**
+ * @file BlockFormat.hpp Layout of FELIX to-host blocks: header word,
+ * subchunk trailers and their fields.
+ *
+ * A block starts with a 32-bit header (elink, sequence number, start of
+ * block marker). Subchunks follow, each padded to the trailer size and
+ * followed by its trailer; parsers walk the trailers back from the end of
+ * the block. Unused space at the end is a null subchunk.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_BLOCKFORMAT_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_BLOCKFORMAT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace flxlibs {
+namespace blockformat {
+
+constexpr std::size_t header_size = 4;
+constexpr uint32_t sob_16b_trailers = 0xABCD; // NOLINT(build/unsigned) start of block, 16-bit trailers
+constexpr uint32_t sob_32b_trailers = 0xC0CE; // NOLINT(build/unsigned) start of block, 32-bit trailers
+constexpr uint32_t max_elink = 0x7FF;         // NOLINT(build/unsigned)
+constexpr uint32_t max_seqnr = 0x1F;          // NOLINT(build/unsigned)
+
+enum class SubchunkType : uint32_t // NOLINT(build/unsigned)
+{
+  null = 0,
+  first = 1,
+  last = 2,
+  both = 3,
+  middle = 4,
+  timeout = 5,
+  oob = 7
+};
+
+// Header word: elink [10:0], sequence number [15:11], start of block [31:16]
+constexpr uint32_t                                          // NOLINT(build/unsigned)
+make_header(uint32_t elink, uint32_t seqnr, uint32_t sob) // NOLINT(build/unsigned)
+{
+  return (elink & max_elink) | ((seqnr & max_seqnr) << 11) | (sob << 16);
+}
+constexpr uint32_t header_elink(uint32_t header) { return header & max_elink; }         // NOLINT(build/unsigned)
+constexpr uint32_t header_seqnr(uint32_t header) { return (header >> 11) & max_seqnr; } // NOLINT(build/unsigned)
+constexpr uint32_t header_sob(uint32_t header) { return header >> 16; }                 // NOLINT(build/unsigned)
+
+// Start of block marker for a trailer size
+constexpr uint32_t start_of_block(bool trailer_32b) // NOLINT(build/unsigned)
+{
+  return trailer_32b ? sob_32b_trailers : sob_16b_trailers;
+}
+
+/**
+ * @brief Subchunk trailer fields; the bit positions depend on the trailer size.
+ * 16-bit: length [9:0], crcerr 10, err 11, trunc 12, type [15:13]
+ * 32-bit: length [15:0], busy 25, crcerr 26, err 27, trunc 28, type [31:29]
+ */
+struct Trailer
+{
+  uint32_t length{ 0 }; // NOLINT(build/unsigned)
+  SubchunkType type{ SubchunkType::null };
+  bool truncated{ false };
+  bool error{ false };
+  bool crc_error{ false };
+  bool busy{ false }; // 32-bit trailers only
+};
+
+constexpr std::size_t
+trailer_size(bool trailer_32b)
+{
+  return trailer_32b ? 4 : 2;
+}
+
+constexpr uint32_t
+max_subchunk_length(bool trailer_32b) // NOLINT(build/unsigned)
+{
+  return trailer_32b ? 0xFFFF : 0x3FF;
+}
+
+constexpr uint32_t                                      // NOLINT(build/unsigned)
+encode_trailer(const Trailer& trailer, bool trailer_32b)
+{
+  const uint32_t type = static_cast<uint32_t>(trailer.type); // NOLINT(build/unsigned)
+  if (trailer_32b) {
+    return (trailer.length & 0xFFFF) | (uint32_t{ trailer.busy } << 25) | (uint32_t{ trailer.crc_error } << 26) | // NOLINT
+           (uint32_t{ trailer.error } << 27) | (uint32_t{ trailer.truncated } << 28) | (type << 29);             // NOLINT
+  }
+  return (trailer.length & 0x3FF) | (uint32_t{ trailer.crc_error } << 10) | (uint32_t{ trailer.error } << 11) | // NOLINT
+         (uint32_t{ trailer.truncated } << 12) | (type << 13);                                                  // NOLINT
+}
+
+constexpr Trailer
+decode_trailer(uint32_t value, bool trailer_32b) // NOLINT(build/unsigned)
+{
+  Trailer trailer;
+  if (trailer_32b) {
+    trailer.length = value & 0xFFFF;
+    trailer.busy = (value >> 25) & 1;
+    trailer.crc_error = (value >> 26) & 1;
+    trailer.error = (value >> 27) & 1;
+    trailer.truncated = (value >> 28) & 1;
+    trailer.type = static_cast<SubchunkType>((value >> 29) & 0x7);
+  } else {
+    trailer.length = value & 0x3FF;
+    trailer.crc_error = (value >> 10) & 1;
+    trailer.error = (value >> 11) & 1;
+    trailer.truncated = (value >> 12) & 1;
+    trailer.type = static_cast<SubchunkType>((value >> 13) & 0x7);
+  }
+  return trailer;
+}
+
+// Subchunk data is padded so that the trailer after it is aligned to its size
+constexpr std::size_t
+padded_length(std::size_t length, bool trailer_32b)
+{
+  const std::size_t align = trailer_size(trailer_32b);
+  return (length + align - 1) / align * align;
+}
+
+} // namespace blockformat
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_BLOCKFORMAT_HPP_
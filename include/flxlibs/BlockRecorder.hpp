@@ -0,0 +1,138 @@
+/**
+ * @file BlockRecorder.hpp Streams raw FELIX DMA blocks to disk, straight
+ * from the DMA ring, in segment files with an elink/sequence index each.
+ *
+ * A recording is a series of segment files <prefix>-<NNNNNN>.blocks holding
+ * whole blocks exactly as the card wrote them, in DMA order. Next to every
+ * segment, <prefix>-<NNNNNN>.blocks.json indexes it: block size, block count
+ * and, per elink, the number of blocks, the first block and the first and
+ * last sequence numbers, and the number of sequence number gaps.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_BLOCKRECORDER_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_BLOCKRECORDER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq {
+namespace flxlibs {
+
+/**
+ * @brief Writes are issued from the submitted memory itself, with O_DIRECT
+ * where the file system allows it, by a pool of writer threads so several
+ * requests are outstanding at any time. Nothing is copied unless the memory
+ * is not aligned for O_DIRECT.
+ *
+ * Submitted memory has to stay untouched until it is retired: the bytes
+ * retired so far, in submission order, are get_retired_bytes(). The
+ * CardWrapper holds the DMA read pointer back accordingly, so a slow disk
+ * fills the ring rather than having blocks overwritten under the writers.
+ */
+class BlockRecorder
+{
+public:
+  struct Settings
+  {
+    std::string directory{ "." };
+    std::string prefix{ "flx-blocks" };
+    std::size_t block_size{ 4096 };
+    std::size_t segment_size{ 1UL << 30 };  // bytes, rounded down to whole blocks
+    std::size_t max_write_size{ 4UL << 20 }; // submissions are split into writes of at most this
+    unsigned writer_threads{ 4 };
+    bool direct_io{ true };
+  };
+
+  struct Stats
+  {
+    uint64_t submitted_bytes{ 0 }; // NOLINT(build/unsigned)
+    uint64_t written_bytes{ 0 };   // NOLINT(build/unsigned)
+    uint64_t writes{ 0 };          // NOLINT(build/unsigned)
+    uint64_t bounced_writes{ 0 };  // NOLINT(build/unsigned) copied for O_DIRECT alignment
+    uint64_t write_errors{ 0 };    // NOLINT(build/unsigned)
+    uint64_t segments{ 0 };        // NOLINT(build/unsigned)
+  };
+
+  explicit BlockRecorder(const Settings& settings);
+  ~BlockRecorder();
+  BlockRecorder(const BlockRecorder&) = delete;            ///< BlockRecorder is not copy-constructible
+  BlockRecorder& operator=(const BlockRecorder&) = delete; ///< BlockRecorder is not copy-assignable
+  BlockRecorder(BlockRecorder&&) = delete;                 ///< BlockRecorder is not move-constructible
+  BlockRecorder& operator=(BlockRecorder&&) = delete;      ///< BlockRecorder is not move-assignable
+
+  // Queues whole blocks for writing; called from one thread only
+  void submit(const char* data, std::size_t length);
+
+  uint64_t get_submitted_bytes() const { return m_submitted_bytes.load(); } // NOLINT(build/unsigned)
+  uint64_t get_retired_bytes() const { return m_retired_bytes.load(); }     // NOLINT(build/unsigned)
+
+  // Waits for the outstanding writes and closes the current segment; the next submit opens a new one
+  void flush();
+
+  Stats get_stats() const;
+  const Settings& get_settings() const { return m_settings; }
+
+private:
+  struct Segment;
+  struct Request
+  {
+    const char* data;
+    std::size_t length;
+    std::shared_ptr<Segment> segment;
+    std::size_t offset; // in the segment
+    std::size_t part;   // index of this write in the segment
+    uint64_t seq;       // NOLINT(build/unsigned) submission order
+  };
+
+  void open_segment();
+  void seal_segment();
+  void write(const Request& request, char* bounce);
+  void retire(uint64_t seq); // NOLINT(build/unsigned)
+  void run_writer();
+
+  Settings m_settings;
+
+  // Submitting thread
+  std::shared_ptr<Segment> m_segment;
+  std::size_t m_segment_used{ 0 };
+  uint64_t m_next_seq{ 0 };     // NOLINT(build/unsigned)
+  uint64_t m_segment_number{ 0 }; // NOLINT(build/unsigned)
+  bool m_warned_buffered{ false };
+
+  // Write requests
+  std::mutex m_queue_mutex;
+  std::condition_variable m_queue_cv;
+  std::deque<Request> m_queue;
+  bool m_stop{ false };
+  std::vector<std::thread> m_writers;
+
+  // In order retirement of completed writes
+  std::mutex m_retire_mutex;
+  std::condition_variable m_retire_cv;
+  uint64_t m_retire_seq{ 0 };                         // NOLINT(build/unsigned) next sequence to retire
+  std::deque<std::pair<bool, std::size_t>> m_pending; // completion flag and length, from m_retire_seq on
+
+  std::atomic<uint64_t> m_submitted_bytes{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_retired_bytes{ 0 };   // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_written_bytes{ 0 };   // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_writes{ 0 };          // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_bounced_writes{ 0 };  // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_write_errors{ 0 };    // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_segments{ 0 };        // NOLINT(build/unsigned)
+};
+
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_BLOCKRECORDER_HPP_
@@ -0,0 +1,115 @@
+/**
+ * @file Crc20.hpp Table-driven CRC-20 of the FELIX front-end chunk format,
+ * as checked by the card on the EOP word of every chunk.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_CRC20_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_CRC20_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace flxlibs {
+namespace crc {
+
+constexpr uint32_t crc20_width = 20;                              // NOLINT(build/unsigned)
+constexpr uint32_t crc20_mask = (1U << crc20_width) - 1;         // NOLINT(build/unsigned)
+constexpr uint32_t crc20_init = 0xFFFFF;                          // NOLINT(build/unsigned)
+constexpr uint32_t crc20_polynomial_old = 0xC1ACF;                // NOLINT(build/unsigned)
+constexpr uint32_t crc20_polynomial_new = 0x8359F;                // NOLINT(build/unsigned)
+
+/**
+ * @brief MSB-first CRC-20 over 32-bit words, sliced by four bytes.
+ *
+ * Each word is folded into the register and reduced with four lookups:
+ * table k holds byte b followed by 8*k + 20 zero bits, modulo the
+ * polynomial. The result equals the bit-serial augmented form that the
+ * firmware reference code uses, with its initial value and final 20-bit
+ * flush.
+ */
+template<uint32_t Polynomial> // NOLINT(build/unsigned)
+class Crc20
+{
+public:
+  using table_t = std::array<std::array<uint32_t, 256>, 4>; // NOLINT(build/unsigned)
+
+  static uint32_t compute(const uint32_t* words, std::size_t n) // NOLINT(build/unsigned)
+  {
+    uint32_t crc = crc20_init; // NOLINT(build/unsigned)
+    for (std::size_t i = 0; i < n; ++i) {
+      crc = update(crc, words[i]);
+    }
+    return crc;
+  }
+
+  // EMU RAM layout: data in the low 32 bits of every entry
+  static uint32_t compute(const uint64_t* words, std::size_t n) // NOLINT(build/unsigned)
+  {
+    uint32_t crc = crc20_init; // NOLINT(build/unsigned)
+    for (std::size_t i = 0; i < n; ++i) {
+      crc = update(crc, static_cast<uint32_t>(words[i])); // NOLINT(build/unsigned)
+    }
+    return crc;
+  }
+
+  static uint32_t update(uint32_t crc, uint32_t word) // NOLINT(build/unsigned)
+  {
+    uint32_t v = (crc << (32 - crc20_width)) ^ word; // NOLINT(build/unsigned)
+    return s_tables[3][v >> 24] ^ s_tables[2][(v >> 16) & 0xFF] ^ s_tables[1][(v >> 8) & 0xFF] ^
+           s_tables[0][v & 0xFF];
+  }
+
+private:
+  static constexpr table_t make_tables()
+  {
+    table_t tables{};
+    for (uint32_t b = 0; b < 256; ++b) { // NOLINT(build/unsigned)
+      // b * x^20: shift the byte through the top of the register
+      uint32_t crc = b << (crc20_width - 8); // NOLINT(build/unsigned)
+      for (int k = 0; k < 8; ++k) {
+        crc = shift_zero(crc);
+      }
+      tables[0][b] = crc;
+      for (std::size_t t = 1; t < 4; ++t) {
+        for (int k = 0; k < 8; ++k) {
+          crc = shift_zero(crc);
+        }
+        tables[t][b] = crc;
+      }
+    }
+    return tables;
+  }
+
+  static constexpr uint32_t shift_zero(uint32_t crc) // NOLINT(build/unsigned)
+  {
+    return ((crc << 1) ^ ((crc & (1U << (crc20_width - 1))) ? Polynomial : 0)) & crc20_mask;
+  }
+
+  static constexpr table_t s_tables = make_tables();
+};
+
+/**
+ * @brief CRC-20 of n words of EMU RAM data, with the old or the new polynomial.
+ */
+inline uint32_t                                           // NOLINT(build/unsigned)
+crc20(const uint64_t* data, std::size_t n, bool crc_new) // NOLINT(build/unsigned)
+{
+  return crc_new ? Crc20<crc20_polynomial_new>::compute(data, n) : Crc20<crc20_polynomial_old>::compute(data, n);
+}
+
+inline uint32_t                                           // NOLINT(build/unsigned)
+crc20(const uint32_t* data, std::size_t n, bool crc_new) // NOLINT(build/unsigned)
+{
+  return crc_new ? Crc20<crc20_polynomial_new>::compute(data, n) : Crc20<crc20_polynomial_old>::compute(data, n);
+}
+
+} // namespace crc
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_CRC20_HPP_
@@ -0,0 +1,88 @@
+/**
+ * @file EmuPatternGenerator.hpp Builds FELIX front-end emulator (EMU RAM)
+ * images: FM-encoded chunks framed by SOP/EOP K-characters with CRC-20.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_EMUPATTERNGENERATOR_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_EMUPATTERNGENERATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace dunedaq {
+namespace flxlibs {
+namespace emu {
+
+// IDLE=K28.5, SOP=K28.1, EOP=K28.6, SOB=K28.2, EOB=K28.3
+constexpr uint64_t fm_kchar_idle = ((uint64_t{ 1 } << 32) | 0xBC); // NOLINT(build/unsigned)
+constexpr uint64_t fm_kchar_sop = ((uint64_t{ 1 } << 32) | 0x3C);  // NOLINT(build/unsigned)
+constexpr uint64_t fm_kchar_eop = ((uint64_t{ 1 } << 32) | 0xDC);  // NOLINT(build/unsigned)
+constexpr uint64_t fm_kchar_sob = ((uint64_t{ 1 } << 32) | 0x5C);  // NOLINT(build/unsigned)
+constexpr uint64_t fm_kchar_eob = ((uint64_t{ 1 } << 32) | 0x7C);  // NOLINT(build/unsigned)
+
+constexpr std::size_t chunk_header_size = 8;
+constexpr std::size_t emu_ram_size = 8192;
+
+struct EmuPatternConfig
+{
+  uint32_t chunk_size{ 464 }; // NOLINT(build/unsigned) bytes, including the 8-byte chunk header
+  uint32_t pattern_id{ 0 };   // NOLINT(build/unsigned) 0 incremental, 1 0xAA55AA55, 2 0xFFFFFFFF, 3 0x00000000
+  uint32_t idle_chars{ 1 };   // NOLINT(build/unsigned) IDLEs between chunks
+  std::size_t emu_size{ emu_ram_size };
+  bool random_size{ false }; // chunk sizes between chunk_size/2 and chunk_size
+  uint32_t seed{ 1 };        // NOLINT(build/unsigned) for random_size; images are reproducible
+  bool crc_new{ true };
+  bool use_streamid{ false };
+  // Error injection, for testing the card's decoder
+  bool add_busy{ false };
+  bool omit_one_soc{ false };
+  bool omit_one_eoc{ false };
+  bool add_crc_err{ false };
+};
+
+struct EmuImage
+{
+  EmuPatternConfig config;
+  std::vector<uint64_t> data; // NOLINT(build/unsigned)
+  std::size_t chunks{ 0 };
+  bool complete{ false }; // all chunks that should fit were generated
+};
+
+/**
+ * @brief Builds the EMU RAM image of one configuration.
+ * @return the image; complete is false if fewer chunks than expected fit.
+ */
+EmuImage
+generate_emu_image(const EmuPatternConfig& config);
+
+/**
+ * @brief Generates one image per configuration, on up to n_threads threads
+ * (0: one per hardware thread). Images come back in the order of configs.
+ */
+std::vector<EmuImage>
+generate_emu_images(const std::vector<EmuPatternConfig>& configs, unsigned n_threads = 0);
+
+/**
+ * @brief The chunks of an image as the card's emulator delivers them to the
+ * host: the data words between each SOP and EOP, 4 bytes per word, chunk
+ * header included. Chunks with broken framing or a wrong CRC are left out.
+ */
+std::vector<std::vector<char>>
+emu_image_chunks(const EmuImage& image);
+
+/**
+ * @brief Writes an image as flx-config register writes.
+ */
+void
+write_flx_config(std::ostream& out, const EmuImage& image);
+
+} // namespace emu
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_EMUPATTERNGENERATOR_HPP_
@@ -0,0 +1,146 @@
+/**
+ * @file ErrorChunkPool.hpp Preallocated pool of deep copies of malformed
+ * FELIX chunks, handed to an optional error connection.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_ERRORCHUNKPOOL_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_ERRORCHUNKPOOL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dunedaq {
+namespace flxlibs {
+
+/**
+ * @brief A malformed chunk copied out of the DMA ring, with the context of
+ * the block it was found in.
+ */
+struct ErrorChunkRecord
+{
+  static constexpr std::size_t max_captured_bytes = 8192;
+
+  uint64_t capture_time_ns{ 0 };   // NOLINT(build/unsigned) system clock at capture
+  uint32_t block_header{ 0 };      // NOLINT(build/unsigned) raw header word (elink, seqnr, SOB) of the current block
+  uint32_t chunk_length{ 0 };      // NOLINT(build/unsigned) length reported by the parser
+  uint32_t captured_length{ 0 };   // NOLINT(build/unsigned) bytes in data, at most max_captured_bytes
+  uint32_t n_subchunks{ 0 };       // NOLINT(build/unsigned)
+  uint32_t suppressed_before{ 0 }; // NOLINT(build/unsigned) captures skipped since the previous record
+  char data[max_captured_bytes];
+};
+
+/**
+ * @brief Fixed number of ErrorChunkRecord slots, allocated once.
+ *
+ * acquire() is called by the single parser thread of an elink and never
+ * allocates. Records go back to the pool when the handle sent downstream is
+ * destroyed, from whichever thread that happens. A token bucket limits the
+ * number of captures per second, so a corruption storm can't flood the
+ * error connection.
+ */
+class ErrorChunkPool : public std::enable_shared_from_this<ErrorChunkPool>
+{
+public:
+  struct Releaser
+  {
+    std::shared_ptr<ErrorChunkPool> pool;
+    void operator()(ErrorChunkRecord* record) const
+    {
+      if (pool) {
+        pool->release(record);
+      }
+    }
+  };
+  using Handle = std::unique_ptr<ErrorChunkRecord, Releaser>;
+
+  ErrorChunkPool(std::size_t slots, uint32_t max_captures_per_second) // NOLINT(build/unsigned)
+    : m_slots(slots)
+    , m_in_use(new std::atomic<bool>[slots])
+    , m_max_per_second(max_captures_per_second)
+    , m_tokens(max_captures_per_second)
+    , m_last_refill(std::chrono::steady_clock::now())
+  {
+    for (std::size_t i = 0; i < slots; ++i) {
+      m_in_use[i].store(false);
+    }
+  }
+
+  ErrorChunkPool(const ErrorChunkPool&) = delete;            ///< ErrorChunkPool is not copy-constructible
+  ErrorChunkPool& operator=(const ErrorChunkPool&) = delete; ///< ErrorChunkPool is not copy-assignable
+  ErrorChunkPool(ErrorChunkPool&&) = delete;                 ///< ErrorChunkPool is not move-constructible
+  ErrorChunkPool& operator=(ErrorChunkPool&&) = delete;      ///< ErrorChunkPool is not move-assignable
+
+  /**
+   * @brief A free record, or an empty handle if the rate limit is hit or all
+   * records are still held downstream.
+   */
+  Handle acquire()
+  {
+    // A token is only taken for a free record: one lost on a full pool would throttle capture below the rate
+    const std::size_t n = m_slots.size();
+    for (std::size_t i = 0; i < n; ++i) {
+      std::size_t idx = (m_cursor + i) % n;
+      if (m_in_use[idx].load(std::memory_order_acquire)) {
+        continue;
+      }
+      if (!take_token()) {
+        break;
+      }
+      // Only this thread claims records, so the free one stays free until here
+      m_in_use[idx].store(true, std::memory_order_relaxed);
+      m_cursor = (idx + 1) % n;
+      ErrorChunkRecord* record = &m_slots[idx];
+      record->suppressed_before = m_suppressed;
+      m_suppressed = 0;
+      return Handle(record, Releaser{ shared_from_this() });
+    }
+    ++m_suppressed;
+    return Handle(nullptr, Releaser{ nullptr });
+  }
+
+  std::size_t size() const { return m_slots.size(); }
+
+private:
+  void release(ErrorChunkRecord* record)
+  {
+    m_in_use[static_cast<std::size_t>(record - m_slots.data())].store(false, std::memory_order_release);
+  }
+
+  bool take_token()
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_refill >= std::chrono::seconds(1)) {
+      m_tokens = m_max_per_second;
+      m_last_refill = now;
+    }
+    if (m_tokens == 0) {
+      return false;
+    }
+    --m_tokens;
+    return true;
+  }
+
+  std::vector<ErrorChunkRecord> m_slots;
+  std::unique_ptr<std::atomic<bool>[]> m_in_use;
+  std::size_t m_cursor{ 0 };
+
+  // Rate limiting, parser thread only
+  uint32_t m_max_per_second;  // NOLINT(build/unsigned)
+  uint32_t m_tokens;          // NOLINT(build/unsigned)
+  uint32_t m_suppressed{ 0 }; // NOLINT(build/unsigned) rate-limited, or no free record
+  std::chrono::steady_clock::time_point m_last_refill;
+};
+
+using ErrorChunkHandle = ErrorChunkPool::Handle;
+
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_ERRORCHUNKPOOL_HPP_
@@ -0,0 +1,155 @@
+/**
+ * @file GatherKernels.hpp Copy kernels that gather the subchunks of a FELIX
+ * chunk into a single contiguous user payload.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_INCLUDE_FLXLIBS_GATHERKERNELS_HPP_
+#define FLXLIBS_INCLUDE_FLXLIBS_GATHERKERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dunedaq {
+namespace flxlibs {
+namespace parsers {
+
+/**
+ * @brief Payloads above this size are written with non-temporal stores.
+ *
+ * Such payloads don't fit in a per-core L2 and are consumed by another core,
+ * so pulling the destination lines into this core's caches only evicts the
+ * DMA ring data the parser is still working on.
+ */
+constexpr std::size_t streaming_store_threshold = 1024 * 1024; // NOLINT(build/unsigned)
+
+/**
+ * @brief Copies n bytes with non-temporal stores where the target supports them.
+ * The caller issues the store fence (see gather_subchunks).
+ */
+inline void
+copy_streaming(char* dst, const char* src, std::size_t n)
+{
+#if defined(__SSE2__)
+  // Head: reach 16B alignment of the destination
+  std::size_t head = (16 - (reinterpret_cast<std::uintptr_t>(dst) & 15)) & 15; // NOLINT
+  if (head > n) {
+    head = n;
+  }
+  std::memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  n -= head;
+
+  // Body: 64B per iteration, one cache line
+  while (n >= 64) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));      // NOLINT
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)); // NOLINT
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)); // NOLINT
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)); // NOLINT
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);                    // NOLINT
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);               // NOLINT
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);               // NOLINT
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);               // NOLINT
+    dst += 64;
+    src += 64;
+    n -= 64;
+  }
+#endif
+  // Tail (or everything, without SSE2)
+  std::memcpy(dst, src, n);
+}
+
+/**
+ * @brief Gathers the subchunks of a chunk into dst, without wraparound.
+ *
+ * Subchunks that are contiguous in memory are coalesced into a single copy.
+ * At most dst_size bytes are written.
+ *
+ * @return the number of bytes copied into dst
+ */
+template<class DataPtrs, class Sizes>
+inline std::size_t
+gather_subchunks(DataPtrs data, Sizes sizes, unsigned n_subchunks, void* dst, std::size_t dst_size)
+{
+  std::size_t total = 0;
+  for (unsigned i = 0; i < n_subchunks; ++i) {
+    total += sizes[i];
+  }
+  const bool streaming = total > streaming_store_threshold;
+
+  char* out = static_cast<char*>(dst);
+  std::size_t copied = 0;
+  unsigned i = 0;
+  while (i < n_subchunks && copied < dst_size) {
+    // Extend the run while the next subchunk starts where this one ends
+    const char* run = data[i];
+    std::size_t run_len = sizes[i];
+    ++i;
+    while (i < n_subchunks && data[i] == run + run_len) {
+      run_len += sizes[i];
+      ++i;
+    }
+    if (run_len > dst_size - copied) {
+      run_len = dst_size - copied;
+    }
+    if (streaming) {
+      copy_streaming(out + copied, run, run_len);
+    } else {
+      std::memcpy(out + copied, run, run_len);
+    }
+    copied += run_len;
+  }
+#if defined(__SSE2__)
+  if (streaming) {
+    _mm_sfence(); // make the streamed payload visible before it is handed to the consumer
+  }
+#endif
+  return copied;
+}
+
+/**
+ * @brief Gathers the subchunks of a chunk of compile-time known size into dst.
+ *
+ * Used by the fixed size superchunk paths, where the caller has already
+ * checked that the chunk is exactly Size bytes long. The single subchunk
+ * case becomes one constant-size copy, and the choice of stores is resolved
+ * at compile time.
+ */
+template<std::size_t Size, class DataPtrs, class Sizes>
+inline std::size_t
+gather_fixed_size(DataPtrs data, Sizes sizes, unsigned n_subchunks, void* dst)
+{
+  if constexpr (Size > streaming_store_threshold) {
+    return gather_subchunks(data, sizes, n_subchunks, dst, Size);
+  } else {
+    char* out = static_cast<char*>(dst);
+    if (n_subchunks == 1) {
+      std::memcpy(out, data[0], Size);
+      return Size;
+    }
+    std::size_t copied = 0;
+    for (unsigned i = 0; i < n_subchunks && copied < Size; ++i) {
+      std::size_t len = static_cast<std::size_t>(sizes[i]);
+      if (len > Size - copied) {
+        len = Size - copied;
+      }
+      std::memcpy(out + copied, data[i], len);
+      copied += len;
+    }
+    return copied;
+  }
+}
+
+} // namespace parsers
+} // namespace flxlibs
+} // namespace dunedaq
+
+#endif // FLXLIBS_INCLUDE_FLXLIBS_GATHERKERNELS_HPP_
@@ -6,7 +6,7 @@
  * received with this code.
  */
 #include "flxlibs/felixcardcontroller/Nljs.hpp"
-#include "flxlibs/felixcardcontrollerinfo/InfoNljs.hpp"
+#include "flxlibs/opmon/FelixCardController.pb.h"
 
 #include "FelixCardController.hpp"
 #include "FelixIssues.hpp"
@@ -15,10 +15,14 @@
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <bitset>
+#include <chrono>
+#include <future>
 #include <iomanip>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <utility>
 
@@ -42,11 +46,14 @@ namespace flxlibs {
 
 FelixCardController::FelixCardController(const std::string& name)
   : DAQModule(name)
+  , m_alignment_monitor(0)
 {
   //m_card_wrapper = std::make_unique<CardControllerWrapper>();
 
   register_command("conf", &FelixCardController::do_configure);
-  register_command("start", &FelixCardController::gth_reset);
+  register_command("start", &FelixCardController::do_start);
+  register_command("stop", &FelixCardController::do_stop);
+  register_command("scrap", &FelixCardController::do_scrap);
   register_command("getregister", &FelixCardController::get_reg);
   register_command("setregister", &FelixCardController::set_reg);
   register_command("getbitfield", &FelixCardController::get_bf);
@@ -54,54 +61,182 @@ FelixCardController::FelixCardController(const std::string& name)
   register_command("gthreset", &FelixCardController::gth_reset);
 }
 
+FelixCardController::~FelixCardController()
+{
+  stop_alignment_monitor();
+}
+
 void
-FelixCardController::init(const data_t& /*args*/)
+FelixCardController::init(const std::shared_ptr<appfwk::ModuleConfiguration> /*mcfg*/)
 {
+  // The card, its logical units and links are configured from the conf command payload
 }
 
 void
 FelixCardController::do_configure(const data_t& args)
 {
+  stop_alignment_monitor();
   m_cfg = args.get<felixcardcontroller::Conf>();
-  // get the number of misaligned links, this is needed since we only run init on device 0 but it checks alignment for both
-  int misalignment_size = 0;
-  for(auto lu : m_cfg.logical_units) {
-    misalignment_size += lu.ignore_alignment_mask.size();
+  if (m_cfg.logical_units.empty()) {
+    return;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Open all devices concurrently: each one also resolves its register cache
+  std::vector<std::future<std::unique_ptr<CardControllerWrapper>>> opened;
+  for (const auto& lu : m_cfg.logical_units) {
+    uint32_t id = m_cfg.card_id + lu.log_unit_id; // NOLINT(build/unsigned)
+    opened.push_back(std::async(std::launch::async, [this, id]() {
+      return std::make_unique<CardControllerWrapper>(id, m_card_factory(id));
+    }));
   }
-  for (auto lu : m_cfg.logical_units) {
-     uint32_t id = m_cfg.card_id+lu.log_unit_id;
-     m_card_wrappers.emplace(std::make_pair(id,std::make_unique<CardControllerWrapper>(id)));
-     if(m_card_wrappers.size() == 1) {
-	 // Do the init only for the first device (whole card)
-         m_card_wrappers.begin()->second->init();
-     }
-     uint64_t aligned = m_card_wrappers.at(id)->get_register(REG_GBT_ALIGNMENT_DONE);
-     m_card_wrappers.at(id)->configure(lu);
-     m_card_wrappers.at(id)->check_alignment(lu, aligned);
+  for (std::size_t i = 0; i < opened.size(); ++i) {
+    uint32_t id = m_cfg.card_id + m_cfg.logical_units[i].log_unit_id; // NOLINT(build/unsigned)
+    m_card_wrappers.emplace(id, opened[i].get());
+  }
+
+  // Barrier: the whole-card init is done once, through the first device, before any logical unit is touched
+  auto first_id = m_cfg.card_id + m_cfg.logical_units.front().log_unit_id;
+  m_card_wrappers.at(first_id)->init();
+
+  // Logical units are independent from here on
+  std::vector<std::future<void>> configured;
+  for (const auto& lu : m_cfg.logical_units) {
+    uint32_t id = m_cfg.card_id + lu.log_unit_id; // NOLINT(build/unsigned)
+    auto* wrapper = m_card_wrappers.at(id).get();
+    configured.push_back(std::async(std::launch::async, [wrapper, lu]() {
+      uint64_t aligned = wrapper->get_alignment(); // NOLINT(build/unsigned)
+      wrapper->configure(lu);
+      wrapper->check_alignment(lu, aligned);
+    }));
+  }
+  for (auto& f : configured) {
+    f.get(); // rethrows anything raised while configuring a logical unit
+  }
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Configured " << m_cfg.logical_units.size() << " logical units of card "
+                              << m_cfg.card_id << " in "
+                              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now() - t0).count()
+                              << " ms";
+
+  start_alignment_monitor();
+}
+
+void
+FelixCardController::do_start(const data_t& args)
+{
+  gth_reset(args);
+  // Monitored from conf on; back on after a stop
+  if (!m_monitor_running.load()) {
+    start_alignment_monitor();
   }
 }
 
 void
-FelixCardController::get_info(opmonlib::InfoCollector& ci, int /*level*/)
-{
-  for (auto lu : m_cfg.logical_units) {
-     uint32_t id = m_cfg.card_id+lu.log_unit_id;
-     uint64_t aligned = m_card_wrappers.at(id)->get_register(REG_GBT_ALIGNMENT_DONE);
-
-     m_card_wrappers.at(id)->check_alignment(lu, aligned); // check links are aligned
-
-     for( auto li : lu.links) {
-        std::stringstream info_name;
-        info_name << "device_" << id << "_link_" << li.link_id;
-        felixcardcontrollerinfo::LinkInfo info;
-        info.device_id = id;
-        info.link_id = li.link_id;
-        info.enabled = li.enabled;
-        info.aligned = aligned & (1<<li.link_id);
-        opmonlib::InfoCollector tmp_ic;
-        tmp_ic.add(info);
-        ci.add(info_name.str(),tmp_ic);
-     }
+FelixCardController::do_stop(const data_t& /*args*/)
+{
+  stop_alignment_monitor();
+}
+
+void
+FelixCardController::do_scrap(const data_t& /*args*/)
+{
+  stop_alignment_monitor();
+}
+
+void
+FelixCardController::start_alignment_monitor()
+{
+  const std::lock_guard<std::mutex> lock(m_alignment_mutex);
+  m_alignment.clear();
+  for (const auto& lu : m_cfg.logical_units) {
+    auto state = std::make_unique<AlignmentState>();
+    state->device_id = m_cfg.card_id + lu.log_unit_id;
+    if (!lu.emu_fanout) { // no alignment with the emulator fanout
+      for (const auto& li : lu.links) {
+        auto ignored = std::find(lu.ignore_alignment_mask.begin(), lu.ignore_alignment_mask.end(), li.link_id);
+        if (li.enabled && ignored == lu.ignore_alignment_mask.end()) {
+          state->expected_mask |= (1ULL << li.link_id);
+        }
+      }
+    }
+    m_alignment.push_back(std::move(state));
+  }
+  // A zero cadence would spin on BAR2 under the card lock, starving register commands
+  m_alignment_poll = std::chrono::milliseconds(std::max(m_cfg.alignment_poll_ms, m_min_alignment_poll_ms));
+
+  m_monitor_running = true;
+  m_alignment_monitor.set_name(m_alignment_monitor_name, m_cfg.card_id);
+  m_alignment_monitor.set_work(&FelixCardController::monitor_alignment, this);
+}
+
+void
+FelixCardController::stop_alignment_monitor()
+{
+  if (m_monitor_running.exchange(false)) {
+    while (!m_alignment_monitor.get_readiness()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+}
+
+void
+FelixCardController::monitor_alignment()
+{
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Alignment monitor of card " << m_cfg.card_id << " started, cadence "
+                              << m_alignment_poll.count() << " ms";
+  while (m_monitor_running.load()) {
+    for (auto& state : m_alignment) {
+      sample_alignment(*state);
+    }
+    std::this_thread::sleep_for(m_alignment_poll);
+  }
+}
+
+void
+FelixCardController::sample_alignment(AlignmentState& state)
+{
+  uint64_t aligned = m_card_wrappers.at(state.device_id)->get_alignment(); // NOLINT(build/unsigned)
+  state.aligned_mask.store(aligned, std::memory_order_relaxed);
+  state.sample_ctr++;
+
+  uint64_t changed = (aligned ^ state.previous_mask) & state.expected_mask; // NOLINT(build/unsigned)
+  if (state.sampled && changed != 0) {
+    uint64_t lost = changed & state.previous_mask; // NOLINT(build/unsigned)
+    uint64_t regained = changed & aligned;         // NOLINT(build/unsigned)
+    state.lost_mask |= lost;
+    state.lost_ctr += __builtin_popcountll(lost);
+    state.regained_ctr += __builtin_popcountll(regained);
+    state.last_transition_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count();
+    for (unsigned link = 0; link < 64; ++link) {
+      if (lost & (1ULL << link)) {
+        ers::warning(flxlibs::ChannelAlignment(ERS_HERE, link));
+      } else if (regained & (1ULL << link)) {
+        TLOG() << "Link " << link << " of device " << state.device_id << " regained alignment";
+      }
+    }
+  }
+  state.previous_mask = aligned;
+  state.sampled = true;
+}
+
+void
+FelixCardController::generate_opmon_data()
+{
+  const std::lock_guard<std::mutex> lock(m_alignment_mutex);
+  for (auto& state : m_alignment) {
+    opmon::LinkAlignmentInfo info;
+    info.set_aligned_mask(state->aligned_mask.load());
+    info.set_expected_mask(state->expected_mask);
+    info.set_lost_mask(state->lost_mask.exchange(0));
+    info.set_num_lost(state->lost_ctr.exchange(0));
+    info.set_num_regained(state->regained_ctr.exchange(0));
+    info.set_num_samples(state->sample_ctr.exchange(0));
+    info.set_last_transition_time(state->last_transition_ns.load());
+    publish(std::move(info), { { "card", std::to_string(m_cfg.card_id) },
+                               { "device", std::to_string(state->device_id) } });
   }
 }
 
@@ -110,9 +245,9 @@ FelixCardController::get_reg(const data_t& args)
 {
   auto conf = args.get<felixcardcontroller::GetRegisters>();
   auto id = conf.card_id + conf.log_unit_id;
-  for (auto reg_name : conf.reg_names) {
-    auto reg_val = m_card_wrappers.at(id)->get_register(reg_name);
-    TLOG() << reg_name << "        0x" << std::hex << reg_val;
+  auto reg_vals = m_card_wrappers.at(id)->get_registers(conf.reg_names);
+  for (std::size_t i = 0; i < conf.reg_names.size(); ++i) {
+    TLOG() << conf.reg_names[i] << "        0x" << std::hex << reg_vals[i];
   }
 }
 
@@ -122,9 +257,11 @@ FelixCardController::set_reg(const data_t& args)
   auto conf = args.get<felixcardcontroller::SetRegisters>();
   auto id = conf.card_id + conf.log_unit_id;
 
-  for (auto p : conf.reg_val_pairs) {
-    m_card_wrappers.at(id)->set_register(p.reg_name, p.reg_val);
+  CardControllerWrapper::reg_val_pairs_t values;
+  for (const auto& p : conf.reg_val_pairs) {
+    values.emplace_back(p.reg_name, p.reg_val);
   }
+  m_card_wrappers.at(id)->set_registers(values);
 }
 
 void
@@ -133,9 +270,9 @@ FelixCardController::get_bf(const data_t& args)
   auto conf = args.get<felixcardcontroller::GetBFs>();
   auto id = conf.card_id + conf.log_unit_id;
 
-  for (auto bf_name : conf.bf_names) {
-    auto bf_val = m_card_wrappers.at(id)->get_bitfield(bf_name);
-    TLOG() << bf_name << "        0x" << std::hex << bf_val;
+  auto bf_vals = m_card_wrappers.at(id)->get_bitfields(conf.bf_names);
+  for (std::size_t i = 0; i < conf.bf_names.size(); ++i) {
+    TLOG() << conf.bf_names[i] << "        0x" << std::hex << bf_vals[i];
   }
 }
 
@@ -145,9 +282,11 @@ FelixCardController::set_bf(const data_t& args)
   auto conf = args.get<felixcardcontroller::SetBFs>();
   auto id = conf.card_id + conf.log_unit_id;
 
-  for (auto p : conf.bf_val_pairs) {
-    m_card_wrappers.at(id)->set_bitfield(p.reg_name, p.reg_val);
+  CardControllerWrapper::reg_val_pairs_t values;
+  for (const auto& p : conf.bf_val_pairs) {
+    values.emplace_back(p.reg_name, p.reg_val);
   }
+  m_card_wrappers.at(id)->set_bitfields(values);
 }
 
 void
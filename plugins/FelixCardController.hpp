@@ -9,7 +9,6 @@
 #ifndef FLXLIBS_PLUGINS_FELIXCARDCONTROLLER_HPP_
 #define FLXLIBS_PLUGINS_FELIXCARDCONTROLLER_HPP_
 
-#include "appfwk/app/Nljs.hpp"
 #include "appfwk/cmd/Nljs.hpp"
 #include "appfwk/cmd/Structs.hpp"
 
@@ -17,11 +16,21 @@
 
 // From appfwk
 #include "appfwk/DAQModule.hpp"
+#include "appfwk/ModuleConfiguration.hpp"
+#include "datahandlinglibs/utils/ReusableThread.hpp"
 
 #include "CardControllerWrapper.hpp"
+#include "CardInterface.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace dunedaq {
 namespace flxlibs {
@@ -36,7 +45,16 @@ public:
   FelixCardController(FelixCardController&&) = delete;            ///< FelixCardController is not move-constructible
   FelixCardController& operator=(FelixCardController&&) = delete; ///< FelixCardController is not move-assignable
 
-  void init(const data_t&) override;
+  ~FelixCardController();
+
+  void init(const std::shared_ptr<appfwk::ModuleConfiguration> mcfg) override;
+
+  // Card of each device opened on conf: the real FELIX card unless replaced, e.g. by a mock in tests
+  using card_factory_t = std::function<std::unique_ptr<CardInterface>(uint32_t)>; // NOLINT(build/unsigned)
+  void set_card_factory(card_factory_t factory) { m_card_factory = std::move(factory); }
+
+protected:
+  void generate_opmon_data() override;
 
 private:
   // Types
@@ -44,7 +62,9 @@ private:
 
   // Commands
   void do_configure(const data_t& args);
-  void get_info(opmonlib::InfoCollector& ci, int level);
+  void do_start(const data_t& args);
+  void do_stop(const data_t& args);
+  void do_scrap(const data_t& args);
   void get_reg(const data_t& args);
   void set_reg(const data_t& args);
   void get_bf(const data_t& args);
@@ -55,7 +75,35 @@ private:
   module_conf_t m_cfg;
 
   // FELIX Card
+  card_factory_t m_card_factory = [](uint32_t /*device_id*/) { return make_flx_card(); }; // NOLINT(build/unsigned)
   std::map<uint32_t, std::unique_ptr<CardControllerWrapper> > m_card_wrappers;
+
+  // Link alignment monitor: samples every logical unit at the configured cadence
+  struct AlignmentState
+  {
+    uint32_t device_id{ 0 };     // NOLINT(build/unsigned)
+    uint64_t expected_mask{ 0 }; // NOLINT(build/unsigned) enabled links, minus ignored ones
+    uint64_t previous_mask{ 0 }; // NOLINT(build/unsigned) monitor thread only
+    bool sampled{ false };       // monitor thread only
+    std::atomic<uint64_t> aligned_mask{ 0 };         // NOLINT(build/unsigned)
+    std::atomic<uint64_t> lost_mask{ 0 };            // NOLINT(build/unsigned)
+    std::atomic<uint64_t> lost_ctr{ 0 };             // NOLINT(build/unsigned)
+    std::atomic<uint64_t> regained_ctr{ 0 };         // NOLINT(build/unsigned)
+    std::atomic<uint64_t> sample_ctr{ 0 };           // NOLINT(build/unsigned)
+    std::atomic<uint64_t> last_transition_ns{ 0 };   // NOLINT(build/unsigned)
+  };
+  void start_alignment_monitor();
+  void stop_alignment_monitor();
+  void monitor_alignment();
+  void sample_alignment(AlignmentState& state);
+
+  std::vector<std::unique_ptr<AlignmentState>> m_alignment;
+  std::mutex m_alignment_mutex; // m_alignment is rebuilt on conf while opmon may read it
+  std::chrono::milliseconds m_alignment_poll{ 100 };
+  static constexpr uint32_t m_min_alignment_poll_ms = 1; // NOLINT(build/unsigned)
+  std::atomic<bool> m_monitor_running{ false };
+  inline static const std::string m_alignment_monitor_name = "flx-align";
+  datahandlinglibs::ReusableThread m_alignment_monitor;
 };
 
 } // namespace flxlibs
@@ -16,6 +16,9 @@
 #include "appmodel/FelixInterface.hpp"
 #include "appmodel/FelixDataSender.hpp"
 
+#include "flxlibs/felixcardreader/Nljs.hpp"
+#include "flxlibs/opmon/FelixReaderModule.pb.h"
+
 #include "CreateElink.hpp"
 #include "FelixReaderModule.hpp"
 #include "FelixIssues.hpp"
@@ -25,6 +28,7 @@
 #include "flxcard/FlxException.h"
 
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <string>
 #include <thread>
@@ -54,6 +58,7 @@ FelixReaderModule::FelixReaderModule(const std::string& name)
   , m_configured(false)
   , m_card_id(0)
   , m_logical_unit(0)
+  , m_dma_id(0)
   , m_links_enabled({0})
   , m_num_links(0)
   , m_block_size(0)
@@ -98,9 +103,11 @@ FelixReaderModule::init(const std::shared_ptr<appfwk::ModuleConfiguration> mcfg)
     const appmodel::FelixInterface* interface = resources->cast<appmodel::FelixInterface>();
     const confmodel::ResourceSetAND* det_senders = resources->cast<confmodel::ResourceSetAND>();
     if (interface != nullptr) {
-      m_card_wrapper = std::make_unique<CardWrapper>(interface);
+      m_card_wrapper = std::make_shared<CardWrapper>(interface);
+      register_node(interface->UID(), m_card_wrapper);
       m_card_id = interface->get_card();
       m_logical_unit = interface->get_slr();
+      m_dma_id = interface->get_dma_id();
       m_links_enabled = interface->get_links_enabled();
       m_num_links = m_links_enabled.size();
       m_block_size = interface->get_dma_block_size() * m_1kb_block_size;
@@ -121,9 +128,15 @@ FelixReaderModule::init(const std::shared_ptr<appfwk::ModuleConfiguration> mcfg)
     } 
   }
 
+  std::string error_conn_uid;
   for (auto qi : modconf->get_outputs()) {
     auto q_with_id = qi->cast<confmodel::QueueWithSourceId>();
-    if (q_with_id == nullptr) continue;
+    if (q_with_id == nullptr) {
+      if (qi->get_data_type() == m_error_chunk_data_type) {
+        error_conn_uid = qi->UID();
+      }
+      continue;
+    }
     TLOG_DEBUG(TLVL_WORK_STEPS) << ": CardReader output queue is " << q_with_id->UID();
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Creating ElinkModel for target queue: " << q_with_id->UID() << " DLH number: " << q_with_id->get_source_id();
     auto elink = src_id_to_elink_map[q_with_id->get_source_id()];
@@ -136,39 +149,26 @@ FelixReaderModule::init(const std::shared_ptr<appfwk::ModuleConfiguration> mcfg)
     //m_elinks[q_with_id->get_source_id()]->init(args, m_block_queue_capacity);
   }
 
-  // Router function of block to appropriate ElinkHandlers
-  m_block_router = [&](uint64_t block_addr) { // NOLINT
-    // block_counter++;
-    const auto* block = const_cast<felix::packetformat::block*>(
-      felix::packetformat::block_from_bytes(reinterpret_cast<const char*>(block_addr)) // NOLINT
-    );
-    auto elink = block->elink;
-    if (m_elinks.count(elink) != 0) {
-      m_elinks[elink]->queue_in_block_address(block_addr);
-    } else {
-      // Really bad -> unexpeced ELINK ID in Block.
-      // This check is needed in order to avoid dynamically add thousands
-      // of ELink parser implementations on the fly, in case the data
-      // corruption is extremely severe.
-      //
-      // Possible causes:
-      //   -> enabled links that don't connect to anything
-      //   -> unexpected format (fw/sw version missmatch)
-      //   -> data corruption from FE
-      //   -> data corruption from CR (really rare, last possible cause)
-
-      // NO TLOG_DEBUG, but should count and periodically report corrupted DMA blocks.
+  // Optional connection for malformed chunks, shared by all elinks (needs a multi-producer queue)
+  if (!error_conn_uid.empty()) {
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Malformed chunks are captured to " << error_conn_uid;
+    for (auto& [id, elink] : m_elinks) {
+      elink->set_error_sink(error_conn_uid);
     }
-  };
+  }
+
+  // Router function of block to appropriate ElinkHandlers
+  m_router = std::make_unique<MapBlockRouter<ElinkConcept>>(m_elinks);
+  m_block_router = std::ref(*m_router);
 
   // Set function for the CardWrapper's block processor.
   m_card_wrapper->set_block_addr_handler(m_block_router);
 }
 
 void
-FelixReaderModule::do_configure(const data_t& /*args*/)
+FelixReaderModule::do_configure(const data_t& args)
 {
-   
+    m_cfg = args.get<felixcardreader::Conf>();
     bool is_32b_trailer = false;
 
     TLOG(TLVL_BOOKKEEPING) << "Number of elinks specified in configuration: " << m_links_enabled.size();
@@ -191,6 +191,40 @@ FelixReaderModule::do_configure(const data_t& /*args*/)
     TLOG(TLVL_WORK_STEPS) << "Configuring components with Block size:" << m_block_size
                           << " & trailer size: " << m_chunk_trailer_size;
     m_card_wrapper->configure();
+
+    // By default parser threads never block on downstream consumers: payloads are dropped and accounted for instead
+    parsers::ParserOptions parser_opts;
+    parser_opts.non_blocking_send = m_cfg.non_blocking_send;
+    parser_opts.send_retries = m_cfg.send_retries;
+    parser_opts.send_retry_backoff = std::chrono::microseconds(m_cfg.send_retry_backoff_us);
+    parser_opts.send_timeout = std::chrono::milliseconds(m_cfg.send_timeout_ms);
+    TLOG(TLVL_WORK_STEPS) << "Parser sends are " << (parser_opts.non_blocking_send ? "non-blocking" : "blocking")
+                          << " with " << parser_opts.send_retries << " retries";
+
+    // In-ring lookback, off unless configured
+    std::shared_ptr<RingLookback> lookback;
+    if (m_cfg.lookback_mb > 0) {
+      RingLookback::Settings lookback_settings;
+      lookback_settings.lookback_bytes = static_cast<std::size_t>(m_cfg.lookback_mb) << 20;
+      if (lookback_settings.lookback_bytes > m_card_wrapper->get_max_lookback_bytes()) {
+        throw ConfigurationError(ERS_HERE,
+                                 "lookback of " + std::to_string(m_cfg.lookback_mb) + " MiB exceeds the " +
+                                   std::to_string(m_card_wrapper->get_max_lookback_bytes()) +
+                                   " bytes of the DMA ring not reserved for block_threshold + margin_blocks");
+      }
+      lookback = std::make_shared<RingLookback>(lookback_settings);
+      TLOG(TLVL_WORK_STEPS) << "Keeping " << m_cfg.lookback_mb << " MiB of the DMA ring as lookback";
+    }
+    m_card_wrapper->set_lookback(lookback);
+
+    // Read-only export of the ring to other processes, off unless configured
+    std::shared_ptr<RingExport> ring_export;
+    if (m_cfg.ring_export) {
+      ring_export = std::make_shared<RingExport>("/flxlibs-ring-" + std::to_string(m_card_id) + "-" +
+                                                 std::to_string(m_logical_unit) + "-" + std::to_string(m_dma_id));
+    }
+    m_card_wrapper->set_ring_export(ring_export);
+
     // get linkids defined by queues
     std::vector<int> linkids;
     for(auto& [id, elink] : m_elinks) {
@@ -203,8 +237,34 @@ FelixReaderModule::do_configure(const data_t& /*args*/)
       elink.key() = tag;
       m_elinks.insert(std::move(elink));
       m_elinks[tag]->set_ids(m_card_id, m_logical_unit, m_links_enabled[i], tag);
+      auto link_opts = parser_opts;
+      for (const auto& link_cfg : m_cfg.links) {
+        if (link_cfg.link == m_links_enabled[i]) {
+          link_opts.check_timestamps = link_cfg.check_timestamps;
+          link_opts.coalesce_shortchunks = link_cfg.coalesce_shortchunks;
+          link_opts.coalesce_window = std::chrono::microseconds(link_cfg.coalesce_window_us);
+          link_opts.coalesce_max_bytes = link_cfg.coalesce_max_bytes;
+          link_opts.coalesce_max_messages = link_cfg.coalesce_max_messages;
+        }
+      }
+      if (link_opts.coalesce_shortchunks && link_opts.coalesce_max_messages == 0) {
+        throw ConfigurationError(ERS_HERE,
+                                 "link " + std::to_string(m_links_enabled[i]) + ": coalesce_max_messages must be > 0");
+      }
+      TLOG(TLVL_WORK_STEPS) << "Link " << m_links_enabled[i] << " timestamp continuity check: "
+                            << (link_opts.check_timestamps ? "on" : "off") << ", shortchunk coalescing: "
+                            << (link_opts.coalesce_shortchunks ? "on" : "off");
+      m_elinks[tag]->set_parser_options(link_opts);
+      // Payloads always go on to the sink: nothing serves window requests from the lookback yet
+      if (lookback != nullptr) {
+        m_elinks[tag]->set_lookback(lookback, true);
+      }
       m_elinks[tag]->conf(m_block_size, is_32b_trailer);
     }
+
+    const std::lock_guard<std::mutex> lock(m_lookback_mutex);
+    m_lookback = lookback;
+    m_last_lookback_stats = RingLookback::Stats();
 }
 
 void
@@ -225,6 +285,45 @@ FelixReaderModule::do_stop(const data_t& /*args*/)
     }
 }
 
+void
+FelixReaderModule::generate_opmon_data()
+{
+  if (!m_router) {
+    return;
+  }
+  opmon::BlockRouterInfo info;
+  uint64_t unknown_elink = m_router->get_unknown_elink(); // NOLINT(build/unsigned)
+  uint64_t queue_full = m_router->get_queue_full();       // NOLINT(build/unsigned)
+  info.set_num_blocks_unknown_elink(unknown_elink - m_last_unknown_elink);
+  info.set_num_blocks_queue_full(queue_full - m_last_queue_full);
+  m_last_unknown_elink = unknown_elink;
+  m_last_queue_full = queue_full;
+
+  // Reported once per monitoring interval, never from the block handler thread
+  if (info.num_blocks_unknown_elink() > 0 || info.num_blocks_queue_full() > 0) {
+    ers::warning(BlocksNotRouted(ERS_HERE,
+                                 std::to_string(m_card_id) + "-" + std::to_string(m_logical_unit),
+                                 info.num_blocks_unknown_elink(),
+                                 info.num_blocks_queue_full()));
+  }
+  publish(std::move(info));
+
+  const std::lock_guard<std::mutex> lock(m_lookback_mutex);
+  if (m_lookback != nullptr) {
+    opmon::RingLookbackInfo lookback_info;
+    auto stats = m_lookback->get_stats();
+    const auto& prev = m_last_lookback_stats;
+    lookback_info.set_lookback_bytes(m_lookback->get_settings().lookback_bytes);
+    lookback_info.set_num_indexed_chunks(stats.indexed_chunks - prev.indexed_chunks);
+    lookback_info.set_num_unindexed_chunks(stats.unindexed_chunks - prev.unindexed_chunks);
+    lookback_info.set_num_requests(stats.requests - prev.requests);
+    lookback_info.set_num_served_chunks(stats.served_chunks - prev.served_chunks);
+    lookback_info.set_num_served_bytes(stats.served_bytes - prev.served_bytes);
+    lookback_info.set_num_stale_chunks(stats.stale_chunks - prev.stale_chunks);
+    m_last_lookback_stats = stats;
+    publish(std::move(lookback_info));
+  }
+}
 
 } // namespace flxlibs
 } // namespace dunedaq
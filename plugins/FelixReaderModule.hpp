@@ -11,7 +11,7 @@
 #include "appfwk/cmd/Nljs.hpp"
 #include "appfwk/cmd/Structs.hpp"
 
-//#include "flxlibs/felixcardreader/Structs.hpp"
+#include "flxlibs/felixcardreader/Structs.hpp"
 
 // From appfwk
 #include "appfwk/DAQModule.hpp"
@@ -22,12 +22,15 @@
 // FELIX Software Suite provided
 #include "packetformat/block_format.hpp"
 
+#include "BlockRouter.hpp"
 #include "CardWrapper.hpp"
 #include "ElinkConcept.hpp"
+#include "RingLookback.hpp"
 
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -49,13 +52,19 @@ public:
 
   void init(const std::shared_ptr<appfwk::ModuleConfiguration> mcfg) override;
 
+protected:
+  void generate_opmon_data() override;
+
 private:
- 
+  // Types
+  using module_conf_t = dunedaq::flxlibs::felixcardreader::Conf;
+
   // Constants
   static constexpr int m_elink_multiplier = 64;
   static constexpr size_t m_block_queue_capacity = 1000000;
   static constexpr size_t m_1kb_block_size = 1024;
   static constexpr int m_32b_trailer_size = 32;
+  inline static const std::string m_error_chunk_data_type = "FelixErrorChunk";
 
   // Commands
   void do_configure(const data_t& args);
@@ -64,9 +73,11 @@ private:
 
   // Configuration
   bool m_configured;
+  module_conf_t m_cfg;
   
   int m_card_id;
   int m_logical_unit;
+  int m_dma_id;
 
   std::vector<unsigned int> m_links_enabled;
   unsigned m_num_links;
@@ -74,13 +85,21 @@ private:
   int m_chunk_trailer_size;
 
   // FELIX Cards
-  std::unique_ptr<CardWrapper> m_card_wrapper;
+  std::shared_ptr<CardWrapper> m_card_wrapper;
 
   // ElinkConcept
   std::map<int, std::shared_ptr<ElinkConcept>> m_elinks;
 
   // Function for routing block addresses from card to elink handler
+  std::unique_ptr<MapBlockRouter<ElinkConcept>> m_router;
   std::function<void(uint64_t)> m_block_router; // NOLINT
+  uint64_t m_last_unknown_elink{ 0 }; // NOLINT(build/unsigned) router counters at the last opmon report
+  uint64_t m_last_queue_full{ 0 };    // NOLINT(build/unsigned)
+
+  // In-ring lookback, if configured
+  std::shared_ptr<RingLookback> m_lookback;
+  RingLookback::Stats m_last_lookback_stats;
+  std::mutex m_lookback_mutex; // m_lookback is replaced on conf while opmon may read it
 };
 
 } // namespace dunedaq::flxlibs
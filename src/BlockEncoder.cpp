@@ -0,0 +1,148 @@
+/**
+ * @file BlockEncoder.cpp Software FELIX to-host block encoder
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "flxlibs/BlockEncoder.hpp"
+
+// From STD
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace dunedaq {
+namespace flxlibs {
+
+using namespace blockformat;
+
+BlockEncoder::BlockEncoder(std::size_t block_size, bool trailer_32b, block_handler_t handler)
+  : m_block_size(block_size)
+  , m_trailer_32b(trailer_32b)
+  , m_trailer_size(trailer_size(trailer_32b))
+  , m_max_subchunk_length(max_subchunk_length(trailer_32b))
+  , m_sob(start_of_block(trailer_32b))
+  , m_handler(std::move(handler))
+  , m_elinks(max_elink + 1)
+{}
+
+void
+BlockEncoder::add_chunk(uint32_t elink, const char* data, std::size_t length) // NOLINT(build/unsigned)
+{
+  add_chunk(elink, data, length, ChunkFlags());
+}
+
+void
+BlockEncoder::add_chunk(uint32_t elink, const char* data, std::size_t length, const ChunkFlags& flags) // NOLINT
+{
+  std::size_t offset = 0;
+  do {
+    OpenBlock& block = open_block(elink);
+
+    // Room left for data, in front of the subchunk's trailer
+    const std::size_t room = std::min(m_block_size - block.used - m_trailer_size, m_max_subchunk_length);
+    const std::size_t n = std::min(length - offset, room);
+    const bool first = offset == 0;
+    const bool last = offset + n == length;
+
+    std::memcpy(block.data.data() + block.used, data + offset, n);
+    const std::size_t padded = padded_length(n, m_trailer_32b);
+    std::memset(block.data.data() + block.used + n, 0, padded - n);
+    block.used += padded;
+
+    Trailer trailer;
+    trailer.length = n;
+    trailer.type = first ? (last ? SubchunkType::both : SubchunkType::first)
+                         : (last ? SubchunkType::last : SubchunkType::middle);
+    if (last) {
+      trailer.truncated = flags.truncated;
+      trailer.error = flags.error;
+      trailer.crc_error = flags.crc_error;
+    }
+    write_trailer(block, trailer);
+    ++m_num_subchunks;
+    offset += n;
+
+    // The card closes a block that can't take another subchunk
+    if (m_block_size - block.used < 2 * m_trailer_size) {
+      close_block(block);
+    }
+  } while (offset < length);
+}
+
+void
+BlockEncoder::set_max_subchunk_length(std::size_t length)
+{
+  m_max_subchunk_length = std::clamp<std::size_t>(length, 1, max_subchunk_length(m_trailer_32b));
+}
+
+void
+BlockEncoder::flush(uint32_t elink) // NOLINT(build/unsigned)
+{
+  OpenBlock& block = m_elinks[elink & max_elink];
+  if (block.open) {
+    close_block(block);
+  }
+}
+
+void
+BlockEncoder::flush_all()
+{
+  for (auto& block : m_elinks) {
+    if (block.open) {
+      close_block(block);
+    }
+  }
+}
+
+BlockEncoder::OpenBlock&
+BlockEncoder::open_block(uint32_t elink) // NOLINT(build/unsigned)
+{
+  OpenBlock& block = m_elinks[elink & max_elink];
+  if (!block.open) {
+    if (block.data.empty()) {
+      block.data.resize(m_block_size);
+    }
+    const uint32_t header = make_header(elink, block.seqnr, m_sob); // NOLINT(build/unsigned)
+    std::memcpy(block.data.data(), &header, header_size);
+    block.used = header_size;
+    block.open = true;
+  }
+  return block;
+}
+
+void
+BlockEncoder::close_block(OpenBlock& block)
+{
+  // Null subchunk over the unused space
+  const std::size_t free = m_block_size - block.used;
+  if (free >= m_trailer_size) {
+    std::memset(block.data.data() + block.used, 0, free - m_trailer_size);
+    block.used += free - m_trailer_size;
+    Trailer filler;
+    filler.length = free - m_trailer_size;
+    write_trailer(block, filler);
+  }
+  m_handler(block.data.data());
+  ++m_num_blocks;
+  block.seqnr = (block.seqnr + 1) & max_seqnr;
+  block.open = false;
+}
+
+void
+BlockEncoder::write_trailer(OpenBlock& block, const Trailer& trailer)
+{
+  const uint32_t value = encode_trailer(trailer, m_trailer_32b); // NOLINT(build/unsigned)
+  if (m_trailer_32b) {
+    std::memcpy(block.data.data() + block.used, &value, sizeof(uint32_t)); // NOLINT(build/unsigned)
+  } else {
+    const uint16_t value16 = static_cast<uint16_t>(value); // NOLINT(build/unsigned)
+    std::memcpy(block.data.data() + block.used, &value16, sizeof(uint16_t)); // NOLINT(build/unsigned)
+  }
+  block.used += m_trailer_size;
+}
+
+} // namespace flxlibs
+} // namespace dunedaq
@@ -0,0 +1,370 @@
+/**
+ * @file BlockRecorder.cpp Raw FELIX DMA block recording to disk
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "flxlibs/BlockRecorder.hpp"
+#include "flxlibs/BlockFormat.hpp"
+
+#include "FelixIssues.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <nlohmann/json.hpp>
+
+// From STD
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <utility>
+
+// From POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dunedaq {
+namespace flxlibs {
+
+namespace {
+
+// O_DIRECT needs buffers, offsets and lengths aligned to the device's logical block size
+constexpr std::size_t direct_io_alignment = 4096;
+
+struct ElinkIndex
+{
+  uint64_t blocks{ 0 };     // NOLINT(build/unsigned)
+  uint64_t first_block{ 0 }; // NOLINT(build/unsigned)
+  uint32_t first_seqnr{ 0 }; // NOLINT(build/unsigned)
+  uint32_t last_seqnr{ 0 };  // NOLINT(build/unsigned)
+  uint64_t seqnr_gaps{ 0 };  // NOLINT(build/unsigned)
+};
+
+// Index of the blocks of one write
+struct PartIndex
+{
+  std::map<uint32_t, ElinkIndex> elinks; // NOLINT(build/unsigned)
+  uint64_t bad_headers{ 0 };             // NOLINT(build/unsigned)
+};
+
+inline bool
+is_next_seqnr(uint32_t prev, uint32_t seqnr) // NOLINT(build/unsigned)
+{
+  return ((prev + 1) & blockformat::max_seqnr) == seqnr;
+}
+
+PartIndex
+index_blocks(const char* data, std::size_t length, std::size_t block_size, uint64_t first_block) // NOLINT
+{
+  PartIndex part;
+  for (std::size_t pos = 0; pos < length; pos += block_size) {
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, data + pos, sizeof(header));
+    const uint32_t sob = blockformat::header_sob(header); // NOLINT(build/unsigned)
+    if (sob != blockformat::sob_32b_trailers && sob != blockformat::sob_16b_trailers) {
+      part.bad_headers++;
+      continue;
+    }
+    const uint32_t seqnr = blockformat::header_seqnr(header); // NOLINT(build/unsigned)
+    auto [it, inserted] = part.elinks.try_emplace(blockformat::header_elink(header));
+    ElinkIndex& e = it->second;
+    if (inserted) {
+      e.first_block = first_block + pos / block_size;
+      e.first_seqnr = seqnr;
+    } else if (!is_next_seqnr(e.last_seqnr, seqnr)) {
+      e.seqnr_gaps++;
+    }
+    e.last_seqnr = seqnr;
+    e.blocks++;
+  }
+  return part;
+}
+
+} // namespace
+
+struct BlockRecorder::Segment
+{
+  int fd{ -1 };
+  std::string path;
+  bool direct{ false };
+
+  std::mutex mutex;
+  std::size_t parts{ 0 };
+  std::size_t done{ 0 };
+  std::size_t size{ 0 };
+  bool sealed{ false };
+  std::map<std::size_t, PartIndex> index; // by part
+
+  // Called with the mutex held, once sealed and all writes are done
+  void finalize(std::size_t block_size)
+  {
+    if (fd < 0) {
+      return;
+    }
+    // Drop what was preallocated beyond the data
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      ers::warning(BlockRecordingError(ERS_HERE, path + ": ftruncate failed: " + std::strerror(errno)));
+    }
+    close(fd);
+    fd = -1;
+
+    // Merge the write indices in file order
+    std::map<uint32_t, ElinkIndex> elinks; // NOLINT(build/unsigned)
+    uint64_t bad_headers = 0;              // NOLINT(build/unsigned)
+    for (auto& [n, part] : index) {
+      bad_headers += part.bad_headers;
+      for (auto& [elink, e] : part.elinks) {
+        auto [it, inserted] = elinks.try_emplace(elink, e);
+        if (!inserted) {
+          ElinkIndex& m = it->second;
+          m.seqnr_gaps += e.seqnr_gaps + (is_next_seqnr(m.last_seqnr, e.first_seqnr) ? 0 : 1);
+          m.last_seqnr = e.last_seqnr;
+          m.blocks += e.blocks;
+        }
+      }
+    }
+
+    nlohmann::json j;
+    j["file"] = path.substr(path.find_last_of('/') + 1);
+    j["block_size"] = block_size;
+    j["blocks"] = size / block_size;
+    j["bad_headers"] = bad_headers;
+    j["elinks"] = nlohmann::json::array();
+    for (auto& [elink, e] : elinks) {
+      j["elinks"].push_back({ { "elink", elink },
+                              { "blocks", e.blocks },
+                              { "first_block", e.first_block },
+                              { "first_seqnr", e.first_seqnr },
+                              { "last_seqnr", e.last_seqnr },
+                              { "seqnr_gaps", e.seqnr_gaps } });
+    }
+    std::ofstream out(path + ".json");
+    out << j.dump(2) << std::endl;
+    if (!out) {
+      ers::warning(BlockRecordingError(ERS_HERE, path + ".json: index could not be written"));
+    }
+    index.clear();
+  }
+};
+
+BlockRecorder::BlockRecorder(const Settings& settings)
+  : m_settings(settings)
+{
+  m_settings.segment_size = std::max(m_settings.block_size, m_settings.segment_size / m_settings.block_size * m_settings.block_size);
+  m_settings.max_write_size =
+    std::max(m_settings.block_size, m_settings.max_write_size / m_settings.block_size * m_settings.block_size);
+  m_settings.writer_threads = std::max(1U, m_settings.writer_threads);
+  for (unsigned i = 0; i < m_settings.writer_threads; ++i) {
+    m_writers.emplace_back(&BlockRecorder::run_writer, this);
+  }
+}
+
+BlockRecorder::~BlockRecorder()
+{
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_stop = true;
+  }
+  m_queue_cv.notify_all();
+  for (auto& writer : m_writers) {
+    writer.join();
+  }
+}
+
+void
+BlockRecorder::submit(const char* data, std::size_t length)
+{
+  while (length > 0) {
+    if (m_segment == nullptr || m_segment_used == m_settings.segment_size) {
+      seal_segment();
+      open_segment();
+    }
+    const std::size_t n = std::min({ length, m_settings.max_write_size, m_settings.segment_size - m_segment_used });
+
+    Request request{ data, n, m_segment, m_segment_used, 0, m_next_seq++ };
+    {
+      std::lock_guard<std::mutex> lock(m_segment->mutex);
+      request.part = m_segment->parts++;
+      m_segment->size += n;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_retire_mutex);
+      m_pending.emplace_back(false, n);
+    }
+    m_submitted_bytes += n;
+    {
+      std::lock_guard<std::mutex> lock(m_queue_mutex);
+      m_queue.push_back(std::move(request));
+    }
+    m_queue_cv.notify_one();
+
+    m_segment_used += n;
+    data += n;
+    length -= n;
+  }
+}
+
+void
+BlockRecorder::flush()
+{
+  seal_segment();
+  std::unique_lock<std::mutex> lock(m_retire_mutex);
+  m_retire_cv.wait(lock, [this] { return m_pending.empty(); });
+}
+
+BlockRecorder::Stats
+BlockRecorder::get_stats() const
+{
+  Stats stats;
+  stats.submitted_bytes = m_submitted_bytes.load();
+  stats.written_bytes = m_written_bytes.load();
+  stats.writes = m_writes.load();
+  stats.bounced_writes = m_bounced_writes.load();
+  stats.write_errors = m_write_errors.load();
+  stats.segments = m_segments.load();
+  return stats;
+}
+
+void
+BlockRecorder::open_segment()
+{
+  std::ostringstream path;
+  path << m_settings.directory << "/" << m_settings.prefix << "-" << std::setw(6) << std::setfill('0')
+       << m_segment_number++ << ".blocks";
+
+  auto segment = std::make_shared<Segment>();
+  segment->path = path.str();
+
+  // Direct I/O needs every write aligned, which whole blocks of 4 KiB multiples are
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (m_settings.direct_io && m_settings.block_size % direct_io_alignment == 0) {
+    segment->fd = open(segment->path.c_str(), flags | O_DIRECT, 0644); // NOLINT
+    segment->direct = segment->fd >= 0;
+  }
+  if (segment->fd < 0) {
+    segment->fd = open(segment->path.c_str(), flags, 0644); // NOLINT
+    if (segment->fd >= 0 && m_settings.direct_io && !m_warned_buffered) {
+      TLOG() << "BlockRecorder: no direct I/O for " << segment->path << ", writing through the page cache";
+      m_warned_buffered = true;
+    }
+  }
+  if (segment->fd < 0) {
+    ers::error(BlockRecordingError(ERS_HERE, segment->path + ": " + std::strerror(errno)));
+  } else {
+    // Reserve the space up front where the file system can; the tail is cut on finalize
+    fallocate(segment->fd, 0, 0, static_cast<off_t>(m_settings.segment_size));
+    m_segments++;
+  }
+  m_segment = std::move(segment);
+  m_segment_used = 0;
+}
+
+void
+BlockRecorder::seal_segment()
+{
+  if (m_segment == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_segment->mutex);
+    m_segment->sealed = true;
+    if (m_segment->done == m_segment->parts) {
+      m_segment->finalize(m_settings.block_size);
+    }
+  }
+  m_segment.reset();
+}
+
+void
+BlockRecorder::write(const Request& request, char* bounce)
+{
+  Segment& segment = *request.segment;
+  PartIndex part = index_blocks(
+    request.data, request.length, m_settings.block_size, request.offset / m_settings.block_size);
+
+  bool ok = segment.fd >= 0;
+  if (ok) {
+    const char* src = request.data;
+    if (segment.direct && reinterpret_cast<uintptr_t>(src) % direct_io_alignment != 0) { // NOLINT
+      std::memcpy(bounce, src, request.length);
+      src = bounce;
+      m_bounced_writes++;
+    }
+    std::size_t written = 0;
+    while (written < request.length) {
+      ssize_t n = pwrite(segment.fd, src + written, request.length - written, request.offset + written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        ers::error(BlockRecordingError(ERS_HERE, segment.path + ": write failed: " + std::strerror(errno)));
+        ok = false;
+        break;
+      }
+      written += n;
+    }
+    m_written_bytes += written;
+  }
+  m_writes++;
+  if (!ok) {
+    m_write_errors++;
+  }
+
+  std::lock_guard<std::mutex> lock(segment.mutex);
+  segment.index[request.part] = std::move(part);
+  if (++segment.done == segment.parts && segment.sealed) {
+    segment.finalize(m_settings.block_size);
+  }
+}
+
+void
+BlockRecorder::retire(uint64_t seq) // NOLINT(build/unsigned)
+{
+  std::lock_guard<std::mutex> lock(m_retire_mutex);
+  m_pending[seq - m_retire_seq].first = true;
+  while (!m_pending.empty() && m_pending.front().first) {
+    m_retired_bytes += m_pending.front().second;
+    m_pending.pop_front();
+    ++m_retire_seq;
+  }
+  if (m_pending.empty()) {
+    m_retire_cv.notify_all();
+  }
+}
+
+void
+BlockRecorder::run_writer()
+{
+  // For memory that is not aligned for O_DIRECT
+  const std::size_t bounce_size =
+    (m_settings.max_write_size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+  std::unique_ptr<char, decltype(&std::free)> bounce(
+    static_cast<char*>(std::aligned_alloc(direct_io_alignment, bounce_size)), &std::free);
+
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      m_queue_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty()) {
+        return;
+      }
+      request = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    write(request, bounce.get());
+    request.segment.reset();
+    retire(request.seq);
+  }
+}
+
+} // namespace flxlibs
+} // namespace dunedaq
@@ -0,0 +1,168 @@
+/**
+ * @file BlockReplaySource.cpp Replay of recorded raw FELIX blocks
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "BlockReplaySource.hpp"
+#include "FelixIssues.hpp"
+
+#include "logging/Logging.hpp"
+
+// From STD
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+// From POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dunedaq::flxlibs {
+
+namespace {
+// Blocks handed out between two checks of the pace and the stop flag
+constexpr std::size_t batch_blocks = 64;
+} // namespace
+
+BlockReplaySource::BlockReplaySource(const Settings& settings)
+  : m_settings(settings)
+{
+  if (m_settings.block_size == 0) {
+    throw BlockReplayError(ERS_HERE, "block size must not be 0");
+  }
+  for (const auto& file : m_settings.files) {
+    int fd = open(file.c_str(), O_RDONLY); // NOLINT
+    if (fd < 0) {
+      throw BlockReplayError(ERS_HERE, file + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    fstat(fd, &st);
+    std::size_t size = static_cast<std::size_t>(st.st_size) / m_settings.block_size * m_settings.block_size;
+    if (size != static_cast<std::size_t>(st.st_size)) {
+      TLOG() << "BlockReplaySource: " << file << " ends in a partial block, which is left out";
+    }
+    if (size == 0) {
+      close(fd);
+      continue;
+    }
+    int flags = MAP_PRIVATE | (m_settings.populate ? MAP_POPULATE : 0);
+    void* data = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      throw BlockReplayError(ERS_HERE, file + ": mmap failed: " + std::strerror(errno));
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    m_mappings.push_back({ static_cast<const char*>(data), size });
+    m_first_blocks.push_back(m_num_blocks);
+    m_num_blocks += size / m_settings.block_size;
+  }
+}
+
+BlockReplaySource::~BlockReplaySource()
+{
+  stop();
+  for (auto& mapping : m_mappings) {
+    munmap(const_cast<char*>(mapping.data), mapping.size); // NOLINT
+  }
+}
+
+void
+BlockReplaySource::start()
+{
+  if (m_running.load()) {
+    return;
+  }
+  m_done = false;
+  m_running = true;
+  m_replayer = std::thread(&BlockReplaySource::replay, this);
+}
+
+void
+BlockReplaySource::stop()
+{
+  m_running = false;
+  if (m_replayer.joinable()) {
+    m_replayer.join();
+  }
+}
+
+void
+BlockReplaySource::for_each_block(const std::function<void(const char*)>& f) const
+{
+  for (const auto& mapping : m_mappings) {
+    for (std::size_t pos = 0; pos < mapping.size; pos += m_settings.block_size) {
+      f(mapping.data + pos);
+    }
+  }
+}
+
+const char*
+BlockReplaySource::get_block(std::size_t index) const
+{
+  auto it = std::upper_bound(m_first_blocks.begin(), m_first_blocks.end(), index);
+  std::size_t n = std::distance(m_first_blocks.begin(), it) - 1;
+  return m_mappings[n].data + (index - m_first_blocks[n]) * m_settings.block_size;
+}
+
+std::vector<std::string>
+BlockReplaySource::find_segments(const std::string& directory, const std::string& prefix)
+{
+  std::vector<std::string> files;
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    const std::string name = entry.path().filename().string();
+    if (name.rfind(prefix + "-", 0) == 0 && entry.path().extension() == ".blocks") {
+      files.push_back(entry.path().string());
+    }
+  }
+  // Segment numbers are zero padded, so name order is recording order
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+void
+BlockReplaySource::replay()
+{
+  if (!m_handle_block_addr || m_num_blocks == 0) {
+    TLOG() << "BlockReplaySource: no block handler or no blocks, nothing to replay";
+    m_done = true;
+    return;
+  }
+
+  const double bytes_per_s = m_settings.rate_mbps * 1e6;
+  uint64_t bytes = 0; // NOLINT(build/unsigned)
+  const auto t0 = std::chrono::steady_clock::now();
+  do {
+    for (const auto& mapping : m_mappings) {
+      for (std::size_t pos = 0; pos < mapping.size && m_running.load();) {
+        // Wait for the pace to catch up
+        if (bytes_per_s > 0) {
+          const double due = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * bytes_per_s;
+          if (bytes >= due) {
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            continue;
+          }
+        }
+        const std::size_t end = std::min(mapping.size, pos + batch_blocks * m_settings.block_size);
+        bytes += end - pos;
+        m_blocks_replayed += (end - pos) / m_settings.block_size;
+        for (; pos < end; pos += m_settings.block_size) {
+          m_handle_block_addr(reinterpret_cast<uint64_t>(mapping.data + pos)); // NOLINT
+        }
+      }
+    }
+    if (m_running.load()) {
+      m_loops++;
+    }
+  } while (m_settings.loop && m_running.load());
+  m_done = !m_settings.loop && m_running.load();
+}
+
+} // namespace dunedaq::flxlibs
@@ -0,0 +1,98 @@
+/**
+ * @file BlockReplaySource.hpp Replays recorded raw FELIX blocks from
+ * memory-mapped files, in place of a card.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_BLOCKREPLAYSOURCE_HPP_
+#define FLXLIBS_SRC_BLOCKREPLAYSOURCE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Maps the segment files of a BlockRecorder capture (or any file of
+ * whole blocks) read-only and hands the address of every block, in file
+ * order, to a block address handler, like CardWrapper does with the DMA
+ * ring. Blocks are never copied: the addresses point into the mappings,
+ * which stay valid for the lifetime of the source.
+ *
+ * The pace is a data rate, or as fast as the handler takes the blocks. With
+ * looping the capture starts over at the end, until stop().
+ */
+class BlockReplaySource
+{
+public:
+  struct Settings
+  {
+    std::vector<std::string> files;
+    std::size_t block_size{ 4096 };
+    double rate_mbps{ 0 }; // MB/s of blocks; 0 for as fast as possible
+    bool loop{ false };
+    bool populate{ false }; // read the files in when mapping, rather than on first access
+  };
+
+  explicit BlockReplaySource(const Settings& settings);
+  ~BlockReplaySource();
+  BlockReplaySource(const BlockReplaySource&) = delete;            ///< BlockReplaySource is not copy-constructible
+  BlockReplaySource& operator=(const BlockReplaySource&) = delete; ///< BlockReplaySource is not copy-assignable
+  BlockReplaySource(BlockReplaySource&&) = delete;                 ///< BlockReplaySource is not move-constructible
+  BlockReplaySource& operator=(BlockReplaySource&&) = delete;      ///< BlockReplaySource is not move-assignable
+
+  // Same handler as CardWrapper::set_block_addr_handler
+  void set_block_addr_handler(std::function<void(uint64_t)>& handle) { m_handle_block_addr = handle; } // NOLINT
+
+  void start();
+  void stop();
+
+  // The capture was played to the end (never with looping)
+  bool is_done() const { return m_done.load(); }
+
+  uint64_t get_blocks_replayed() const { return m_blocks_replayed.load(); } // NOLINT(build/unsigned)
+  uint64_t get_loops() const { return m_loops.load(); }                     // NOLINT(build/unsigned)
+  std::size_t get_num_blocks() const { return m_num_blocks; }
+
+  // Calls f with the address of every block once, for scanning the capture up front
+  void for_each_block(const std::function<void(const char*)>& f) const;
+
+  // Address of a block, counting over all files in order
+  const char* get_block(std::size_t index) const;
+  std::size_t get_block_size() const { return m_settings.block_size; }
+
+  // The <prefix>-NNNNNN.blocks segments of a BlockRecorder capture in a directory, in order
+  static std::vector<std::string> find_segments(const std::string& directory, const std::string& prefix);
+
+private:
+  struct Mapping
+  {
+    const char* data{ nullptr };
+    std::size_t size{ 0 };
+  };
+
+  void replay();
+
+  Settings m_settings;
+  std::vector<Mapping> m_mappings;
+  std::vector<std::size_t> m_first_blocks; // index of the first block of every mapping
+  std::size_t m_num_blocks{ 0 };
+  std::function<void(uint64_t)> m_handle_block_addr; // NOLINT(build/unsigned)
+
+  std::atomic<bool> m_running{ false };
+  std::atomic<bool> m_done{ false };
+  std::thread m_replayer;
+  std::atomic<uint64_t> m_blocks_replayed{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_loops{ 0 };           // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_BLOCKREPLAYSOURCE_HPP_
@@ -0,0 +1,135 @@
+/**
+ * @file BlockRouter.hpp Block routers: the fan-out of DMA block addresses to
+ * the elink handlers of a logical unit.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_BLOCKROUTER_HPP_
+#define FLXLIBS_SRC_BLOCKROUTER_HPP_
+
+#include "FelixStatistics.hpp"
+#include "flxlibs/BlockFormat.hpp"
+
+#include "packetformat/block_format.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Routes every block to the handler of its elink through the elink map,
+ * as FelixReaderModule always has. The map is looked up on every block, so the
+ * map may be rekeyed (as at configure) while the router is set.
+ *
+ * Routers run on the single block handler thread of CardWrapper and are
+ * called with the address of every block; Target has
+ * bool queue_in_block_address(uint64_t). Their counters may be read from
+ * any thread, e.g. by opmon.
+ *
+ * A block its handler's queue has no room for is dropped, or with
+ * wait_when_full, retried until the handler takes it: for sources that can
+ * be held back, like a replay, never for the DMA ring.
+ */
+template<class Target>
+class MapBlockRouter
+{
+public:
+  using elink_map_t = std::map<int, std::shared_ptr<Target>>;
+
+  explicit MapBlockRouter(elink_map_t& elinks, bool wait_when_full = false)
+    : m_elinks(elinks)
+    , m_wait_when_full(wait_when_full)
+  {}
+
+  void operator()(uint64_t block_addr) // NOLINT(build/unsigned)
+  {
+    const auto* block = felix::packetformat::block_from_bytes(reinterpret_cast<const char*>(block_addr)); // NOLINT
+    auto elink = block->elink;
+    if (m_elinks.count(elink) != 0) {
+      auto& target = m_elinks[elink];
+      while (!target->queue_in_block_address(block_addr)) {
+        if (!m_wait_when_full) {
+          m_queue_full++;
+          return;
+        }
+        std::this_thread::yield();
+      }
+    } else {
+      // Really bad -> unexpeced ELINK ID in Block.
+      // This check is needed in order to avoid dynamically add thousands
+      // of ELink parser implementations on the fly, in case the data
+      // corruption is extremely severe.
+      //
+      // Possible causes:
+      //   -> enabled links that don't connect to anything
+      //   -> unexpected format (fw/sw version missmatch)
+      //   -> data corruption from FE
+      //   -> data corruption from CR (really rare, last possible cause)
+      m_unknown_elink++;
+    }
+  }
+
+  // Blocks of elinks without a handler, and blocks the handler's queue had no room for
+  uint64_t get_unknown_elink() const { return m_unknown_elink.load(); } // NOLINT(build/unsigned)
+  uint64_t get_queue_full() const { return m_queue_full.load(); }       // NOLINT(build/unsigned)
+
+private:
+  elink_map_t& m_elinks;
+  const bool m_wait_when_full;
+  stats::MonotonicCounter m_unknown_elink;
+  stats::MonotonicCounter m_queue_full;
+};
+
+/**
+ * @brief Routes through a table of handlers indexed by the 11-bit elink
+ * field of the block header: one load instead of two tree walks per block.
+ * The table is a copy of the elink map when the router is built, so it has
+ * to be rebuilt if the map is rekeyed.
+ */
+template<class Target>
+class ArrayBlockRouter
+{
+public:
+  using elink_map_t = std::map<int, std::shared_ptr<Target>>;
+
+  explicit ArrayBlockRouter(const elink_map_t& elinks)
+    : m_table(blockformat::max_elink + 1, nullptr)
+  {
+    for (const auto& [elink, target] : elinks) {
+      if (elink >= 0 && static_cast<uint32_t>(elink) <= blockformat::max_elink) { // NOLINT(build/unsigned)
+        m_table[elink] = target.get();
+      }
+    }
+  }
+
+  void operator()(uint64_t block_addr) // NOLINT(build/unsigned)
+  {
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, reinterpret_cast<const void*>(block_addr), sizeof(header)); // NOLINT
+    Target* target = m_table[blockformat::header_elink(header)];
+    if (target == nullptr) {
+      m_unknown_elink++;
+    } else if (!target->queue_in_block_address(block_addr)) {
+      m_queue_full++;
+    }
+  }
+
+  uint64_t get_unknown_elink() const { return m_unknown_elink.load(); } // NOLINT(build/unsigned)
+  uint64_t get_queue_full() const { return m_queue_full.load(); }       // NOLINT(build/unsigned)
+
+private:
+  std::vector<Target*> m_table;
+  stats::MonotonicCounter m_unknown_elink;
+  stats::MonotonicCounter m_queue_full;
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_BLOCKROUTER_HPP_
@@ -13,11 +13,15 @@
 #include "logging/Logging.hpp"
 
 #include "flxcard/FlxException.h"
+#include "regmap/regmap.h"
 
 // From STD
+#include <cstdio>
 #include <iomanip>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 /**
  * @brief TRACE debug levels used in this source file
@@ -32,16 +36,30 @@ enum
 namespace dunedaq {
 namespace flxlibs {
 
-CardControllerWrapper::CardControllerWrapper(uint32_t device_id) : m_device_id(device_id)
+namespace {
+
+// Written by configure()
+constexpr const char* bf_emu_tofrontend = "FE_EMU_ENA_EMU_TOFRONTEND";
+constexpr const char* bf_emu_tohost = "FE_EMU_ENA_EMU_TOHOST";
+constexpr const char* bf_tofrontend_fanout = "GBT_TOFRONTEND_FANOUT_SEL";
+constexpr const char* bf_tohost_fanout = "GBT_TOHOST_FANOUT_SEL";
+constexpr const char* epath_ena_format = "DECODING_LINK%02zu_EGROUP0_CTRL_EPATH_ENA";
+constexpr const char* superchunk_factor_format = "SUPER_CHUNK_FACTOR_LINK_%02zu";
+
+} // namespace
+
+CardControllerWrapper::CardControllerWrapper(uint32_t device_id, std::unique_ptr<CardInterface> card)
+  : m_device_id(device_id)
+  , m_flx_card(std::move(card))
 {
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS)
     << "CardControllerWrapper constructor called. Open card " << m_device_id;
-	
-  m_flx_card = std::make_unique<FlxCard>();
+
   if (m_flx_card == nullptr) {
     ers::fatal(flxlibs::CardError(ERS_HERE, "Couldn't create FlxCard object."));
   }
   open_card();
+  build_register_cache();
   TLOG_DEBUG(TLVL_ENTER_EXIT_METHODS) << "CardControllerWrapper constructed.";
 
 }
@@ -61,12 +79,16 @@ CardControllerWrapper::init() {
  // this is complicated....should we repeat all code in flx_init?
  // For now do not do the configs of the clock chips
  const std::lock_guard<std::mutex> lock(m_card_mutex);
- m_flx_card->cfg_set_option( BF_MMCM_MAIN_LCLK_SEL, 1 ); // local clock
+ if (m_main_lclk_sel != nullptr) {
+   write(*m_main_lclk_sel, 1); // local clock
+ }
  m_flx_card->soft_reset();
  //si5328_configure();
  //si5345_configure(0);
- m_flx_card->cfg_set_option(BF_GBT_SOFT_RESET, 0xFFFFFFFFFFFF);
- m_flx_card->cfg_set_option(BF_GBT_SOFT_RESET, 0);
+ if (m_gbt_soft_reset != nullptr) {
+   write(*m_gbt_soft_reset, 0xFFFFFFFFFFFF);
+   write(*m_gbt_soft_reset, 0);
+ }
 
  int bad_channels = m_flx_card->gbt_setup( FLX_GBT_ALIGNMENT_ONE, FLX_GBT_TMODE_FEC ); //What does this do?
  if(bad_channels) {
@@ -79,49 +101,60 @@ CardControllerWrapper::init() {
 void
 CardControllerWrapper::configure(const felixcardcontroller::LogicalUnit & lu_cfg)
 {
+  // Everything is resolved before the first write: a missing name leaves the card untouched
+  auto required = [](const RegisterHandle* handle, const char* name) {
+    if (handle == nullptr) {
+      throw flxlibs::UnknownRegister(ERS_HERE, name);
+    }
+    return handle;
+  };
+  handle_val_pairs_t values;
 
- // Disable all links
- for(size_t i=0 ; i<12; ++i) {
-  std::stringstream ss;
-  ss << "DECODING_LINK" << std::setw(2) << std::setfill('0') << i << "_EGROUP0_CTRL_EPATH_ENA";
-  set_bitfield(ss.str(), 0);
- }
+  // Disable all links
+  for (std::size_t link = 0; link < m_max_links; ++link) {
+    auto* epath_ena = find_link_bitfield(m_epath_ena, epath_ena_format, link, false);
+    if (epath_ena != nullptr) {
+      values.emplace_back(epath_ena, 0);
+    }
+  }
 
   // Enable/disable emulation
+  auto* tofrontend_fanout = required(m_tofrontend_fanout, bf_tofrontend_fanout);
+  auto* tohost_fanout = required(m_tohost_fanout, bf_tohost_fanout);
+  auto* emu_tofrontend = required(m_emu_tofrontend, bf_emu_tofrontend);
+  auto* emu_tohost = required(m_emu_tohost, bf_emu_tohost);
   if(lu_cfg.emu_fanout) {
     //set_bitfield("FE_EMU_LOGIC_IDLES", 0); // FIXME
     //set_bitfield("FE_EMU_LOGIC_CHUNK_LENGTH", 0);
     //set_bitfield("FE_EMU_LOGIC_ENA", 0);
     //set_bitfield("FE_EMU_LOGIC_L1A_TRIGGERED", 0);
 
-    set_bitfield("GBT_TOFRONTEND_FANOUT_SEL", 0);
-    set_bitfield("GBT_TOHOST_FANOUT_SEL", 0xffffff);
-    set_bitfield("FE_EMU_ENA_EMU_TOFRONTEND", 0);
-    set_bitfield("FE_EMU_ENA_EMU_TOHOST", 1);
+    values.emplace_back(tofrontend_fanout, 0);
+    values.emplace_back(tohost_fanout, 0xffffff);
+    values.emplace_back(emu_tofrontend, 0);
+    values.emplace_back(emu_tohost, 1);
   }
   else {
-    //set_register("FE_EMU_LOGIC_ENA", 0);
-    //set_register("FE_EMU_LOGIC_L1A_TRIGGERED", 0);
-    //set_register("FE_EMU_LOGIC_IDLES", 0);
-    //set_register("FE_EMU_LOGIC_CHUNK_LENGTH", 0);
-
-    set_bitfield("FE_EMU_ENA_EMU_TOFRONTEND", 0);
-    set_bitfield("FE_EMU_ENA_EMU_TOHOST", 0);
-    set_bitfield("GBT_TOFRONTEND_FANOUT_SEL", 0);
-    set_bitfield("GBT_TOHOST_FANOUT_SEL", 0);
+    values.emplace_back(emu_tofrontend, 0);
+    values.emplace_back(emu_tohost, 0);
+    values.emplace_back(tofrontend_fanout, 0);
+    values.emplace_back(tohost_fanout, 0);
   }
+
   // Enable and configure the right links
- 
   for(auto li : lu_cfg.links) {
     if(li.enabled) {
-      std::stringstream sc_stream;
-      sc_stream << "SUPER_CHUNK_FACTOR_LINK_"<< std::setw(2) << std::setfill('0') << li.link_id;
-      std::stringstream ena_stream;
-      ena_stream<< "DECODING_LINK" << std::setw(2) << std::setfill('0') << li.link_id << "_EGROUP0_CTRL_EPATH_ENA";
-      set_bitfield(sc_stream.str(), li.superchunk_factor);
-      set_bitfield(ena_stream.str(), 1);
+      if (li.link_id >= m_max_links) {
+        ers::error(flxlibs::ConfigurationError(ERS_HERE, "Link id out of range: " + std::to_string(li.link_id)));
+        continue;
+      }
+      values.emplace_back(find_link_bitfield(m_superchunk_factor, superchunk_factor_format, li.link_id, true),
+                          li.superchunk_factor);
+      values.emplace_back(find_link_bitfield(m_epath_ena, epath_ena_format, li.link_id, true), 1);
     }
   }
+
+  write_batch(values);
 }
 
 void
@@ -150,38 +183,222 @@ CardControllerWrapper::close_card()
   }
 }
 
+void
+CardControllerWrapper::build_register_cache()
+{
+  // BAR2 holds the register map; the regmap tables give the offsets within it
+  m_bar2_base = m_flx_card->register_base();
+
+  for (const regmap_register_t* reg = regmap_registers; reg->name != nullptr; ++reg) {
+    RegisterHandle handle;
+    handle.name = reg->name;
+    handle.address = reg->address;
+    handle.writable = reg->flags & REGMAP_REG_WRITE;
+    m_registers.emplace(reg->name, handle);
+  }
+  for (const regmap_bitfield_t* bf = regmap_bitfields; bf->name != nullptr; ++bf) {
+    RegisterHandle handle;
+    handle.name = bf->name;
+    handle.address = bf->address;
+    handle.mask = bf->mask;
+    handle.shift = bf->shift;
+    handle.writable = bf->flags & REGMAP_REG_WRITE;
+    m_bitfields.emplace(bf->name, handle);
+  }
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Register cache of card " << m_device_id << ": " << m_registers.size()
+                              << " registers, " << m_bitfields.size() << " bitfields";
+
+  // Names used by configure() and the alignment poll, resolved once
+  m_alignment_done = find_register(REG_GBT_ALIGNMENT_DONE);
+  m_main_lclk_sel = find_bitfield(BF_MMCM_MAIN_LCLK_SEL);
+  m_gbt_soft_reset = find_bitfield(BF_GBT_SOFT_RESET);
+  m_emu_tofrontend = find_bitfield(bf_emu_tofrontend);
+  m_emu_tohost = find_bitfield(bf_emu_tohost);
+  m_tofrontend_fanout = find_bitfield(bf_tofrontend_fanout);
+  m_tohost_fanout = find_bitfield(bf_tohost_fanout);
+}
+
+const CardControllerWrapper::RegisterHandle*
+CardControllerWrapper::find_register(const std::string& key) const
+{
+  auto it = m_registers.find(key);
+  if (it == m_registers.end()) {
+    ers::error(flxlibs::UnknownRegister(ERS_HERE, key));
+    return nullptr;
+  }
+  return &it->second;
+}
+
+const CardControllerWrapper::RegisterHandle*
+CardControllerWrapper::find_bitfield(const std::string& key) const
+{
+  auto it = m_bitfields.find(key);
+  if (it == m_bitfields.end()) {
+    ers::error(flxlibs::UnknownRegister(ERS_HERE, key));
+    return nullptr;
+  }
+  return &it->second;
+}
+
+const CardControllerWrapper::RegisterHandle*
+CardControllerWrapper::find_link_bitfield(std::array<const RegisterHandle*, m_max_links>& cache,
+                                          const char* format,
+                                          std::size_t link,
+                                          bool required)
+{
+  if (cache[link] != nullptr) {
+    return cache[link];
+  }
+  char name[64];
+  std::snprintf(name, sizeof(name), format, link);
+  auto it = m_bitfields.find(name);
+  if (it == m_bitfields.end()) {
+    if (required) {
+      throw flxlibs::UnknownRegister(ERS_HERE, name);
+    }
+    TLOG_DEBUG(TLVL_BOOKKEEPING) << "No " << name << " in the regmap of card " << m_device_id;
+    return nullptr;
+  }
+  cache[link] = &it->second;
+  return cache[link];
+}
+
+uint64_t // NOLINT(build/unsigned)
+CardControllerWrapper::read(const RegisterHandle& handle) const
+{
+  auto value = *reinterpret_cast<volatile uint64_t*>(m_bar2_base + handle.address); // NOLINT
+  return (value & handle.mask) >> handle.shift;
+}
+
+void
+CardControllerWrapper::write(const RegisterHandle& handle, uint64_t value) // NOLINT(build/unsigned)
+{
+  auto* reg = reinterpret_cast<volatile uint64_t*>(m_bar2_base + handle.address); // NOLINT
+  if (handle.mask == ~0ULL) {
+    *reg = value;
+  } else {
+    *reg = (*reg & ~handle.mask) | ((value << handle.shift) & handle.mask);
+  }
+}
+
+CardControllerWrapper::handle_val_pairs_t
+CardControllerWrapper::resolve_writes(const reg_val_pairs_t& values,
+                                      const std::unordered_map<std::string, RegisterHandle>& table) const
+{
+  handle_val_pairs_t resolved;
+  resolved.reserve(values.size());
+  for (const auto& [key, value] : values) {
+    auto it = table.find(key);
+    if (it == table.end()) {
+      throw flxlibs::UnknownRegister(ERS_HERE, key);
+    }
+    resolved.emplace_back(&it->second, value);
+  }
+  return resolved;
+}
+
+void
+CardControllerWrapper::write_batch(const handle_val_pairs_t& values)
+{
+  // A batch is written whole or not at all
+  for (const auto& [handle, value] : values) {
+    if (handle == nullptr) {
+      throw flxlibs::CardError(ERS_HERE, "Unresolved register handle in a batch write");
+    }
+    if (!handle->writable) {
+      throw flxlibs::ReadOnlyRegister(ERS_HERE, handle->name);
+    }
+  }
+  const std::lock_guard<std::mutex> lock(m_card_mutex);
+  for (const auto& [handle, value] : values) {
+    write(*handle, value);
+  }
+}
+
 uint64_t // NOLINT(build/unsigned)
 CardControllerWrapper::get_register(std::string key)
 {
   TLOG_DEBUG(TLVL_WORK_STEPS) << "Reading value of register " << key;
-  const std::lock_guard<std::mutex> lock(m_card_mutex);
-  auto reg_val = m_flx_card->cfg_get_reg(key.c_str());
-  return reg_val;
+  return get_registers({ key }).front();
 }
 
 void
 CardControllerWrapper::set_register(std::string key, uint64_t value) // NOLINT(build/unsigned)
 {
   TLOG_DEBUG(TLVL_WORK_STEPS) << "Setting value of register " << key << " to " << value;
-  const std::lock_guard<std::mutex> lock(m_card_mutex);
-  m_flx_card->cfg_set_reg(key.c_str(), value);
+  set_registers({ { key, value } });
 }
 
 uint64_t // NOLINT(build/unsigned)
 CardControllerWrapper::get_bitfield(std::string key)
 {
   TLOG_DEBUG(TLVL_WORK_STEPS) << "Reading value of bitfield " << key;
-  const std::lock_guard<std::mutex> lock(m_card_mutex);
-  auto bf_val = m_flx_card->cfg_get_option(key.c_str(), false);
-  return bf_val;
+  return get_bitfields({ key }).front();
 }
 
 void
 CardControllerWrapper::set_bitfield(std::string key, uint64_t value) // NOLINT(build/unsigned)
 {
-  TLOG_DEBUG(TLVL_WORK_STEPS) << "Setting value of bitfield " << key << " to " << value;;
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Setting value of bitfield " << key << " to " << value;
+  set_bitfields({ { key, value } });
+}
+
+std::vector<uint64_t> // NOLINT(build/unsigned)
+CardControllerWrapper::get_registers(const std::vector<std::string>& keys)
+{
+  std::vector<const RegisterHandle*> handles;
+  handles.reserve(keys.size());
+  for (const auto& key : keys) {
+    handles.push_back(find_register(key));
+  }
+  std::vector<uint64_t> values(keys.size(), 0); // NOLINT(build/unsigned)
+  const std::lock_guard<std::mutex> lock(m_card_mutex);
+  for (std::size_t i = 0; i < handles.size(); ++i) {
+    if (handles[i] != nullptr) {
+      values[i] = read(*handles[i]);
+    }
+  }
+  return values;
+}
+
+void
+CardControllerWrapper::set_registers(const reg_val_pairs_t& values)
+{
+  write_batch(resolve_writes(values, m_registers));
+}
+
+std::vector<uint64_t> // NOLINT(build/unsigned)
+CardControllerWrapper::get_bitfields(const std::vector<std::string>& keys)
+{
+  std::vector<const RegisterHandle*> handles;
+  handles.reserve(keys.size());
+  for (const auto& key : keys) {
+    handles.push_back(find_bitfield(key));
+  }
+  std::vector<uint64_t> values(keys.size(), 0); // NOLINT(build/unsigned)
+  const std::lock_guard<std::mutex> lock(m_card_mutex);
+  for (std::size_t i = 0; i < handles.size(); ++i) {
+    if (handles[i] != nullptr) {
+      values[i] = read(*handles[i]);
+    }
+  }
+  return values;
+}
+
+void
+CardControllerWrapper::set_bitfields(const reg_val_pairs_t& values)
+{
+  write_batch(resolve_writes(values, m_bitfields));
+}
+
+uint64_t // NOLINT(build/unsigned)
+CardControllerWrapper::get_alignment()
+{
+  if (m_alignment_done == nullptr) {
+    return 0;
+  }
   const std::lock_guard<std::mutex> lock(m_card_mutex);
-  m_flx_card->cfg_set_option(key.c_str(), value, false);
+  return read(*m_alignment_done);
 }
 
 void
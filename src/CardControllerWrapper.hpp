@@ -11,13 +11,17 @@
 #include "flxlibs/felixcardcontroller/Nljs.hpp"
 #include "flxlibs/felixcardcontroller/Structs.hpp"
 
-#include "flxcard/FlxCard.h"
+#include "CardInterface.hpp"
 
 #include <nlohmann/json.hpp>
 
+#include <array>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace dunedaq::flxlibs {
 
@@ -26,8 +30,10 @@ class CardControllerWrapper
 public:
   /**
    * @brief CardControllerWrapper Constructor
+   * @param device_id Device (card + logical unit) to open
+   * @param card Card implementation; the real FELIX card unless a mock is given
    */
-  CardControllerWrapper(uint32_t device_id);
+  explicit CardControllerWrapper(uint32_t device_id, std::unique_ptr<CardInterface> card = make_flx_card()); // NOLINT
   ~CardControllerWrapper();
   CardControllerWrapper(const CardControllerWrapper&) = delete;            ///< Not copy-constructible
   CardControllerWrapper& operator=(const CardControllerWrapper&) = delete; ///< Not copy-assignable
@@ -35,6 +41,21 @@ public:
   CardControllerWrapper& operator=(CardControllerWrapper&&) = delete;      ///< Not move-assignable
 
   using data_t = nlohmann::json;
+  using reg_val_pairs_t = std::vector<std::pair<std::string, uint64_t>>; // NOLINT(build/unsigned)
+
+  /**
+   * @brief A register or bitfield resolved once from the regmap tables:
+   * BAR2 offset, in-place mask and shift. Plain registers have a full mask.
+   */
+  struct RegisterHandle
+  {
+    const char* name{ nullptr }; // regmap name, for reporting
+    uint64_t address{ 0 }; // NOLINT(build/unsigned)
+    uint64_t mask{ ~0ULL }; // NOLINT(build/unsigned)
+    unsigned shift{ 0 };
+    bool writable{ false };
+  };
+
   void init();
   void configure(const felixcardcontroller::LogicalUnit & lu_cfg);
 
@@ -42,19 +63,61 @@ public:
   void set_register(std::string key, uint64_t value); // NOLINT(build/unsigned)
   uint64_t get_bitfield(std::string key);             // NOLINT(build/unsigned)
   void set_bitfield(std::string key, uint64_t value); // NOLINT(build/unsigned)
+
+  // Batch access: all names are resolved first, then accessed under a single lock. A batch
+  // write with an unknown or read-only name throws UnknownRegister or ReadOnlyRegister and
+  // writes nothing.
+  std::vector<uint64_t> get_registers(const std::vector<std::string>& keys); // NOLINT(build/unsigned)
+  void set_registers(const reg_val_pairs_t& values);
+  std::vector<uint64_t> get_bitfields(const std::vector<std::string>& keys); // NOLINT(build/unsigned)
+  void set_bitfields(const reg_val_pairs_t& values);
+
+  uint64_t get_alignment(); // NOLINT(build/unsigned) GBT_ALIGNMENT_DONE, through the cached handle
+
   void gth_reset();
   void check_alignment(const felixcardcontroller::LogicalUnit & lu_cfg, const uint64_t & aligned);
 
 private:
+  static constexpr std::size_t m_max_links = 12;
 
   // Card
   void open_card();
   void close_card();
 
+  // Register handle cache
+  void build_register_cache();
+  const RegisterHandle* find_register(const std::string& key) const;
+  const RegisterHandle* find_bitfield(const std::string& key) const;
+  const RegisterHandle* find_link_bitfield(std::array<const RegisterHandle*, m_max_links>& cache,
+                                           const char* format,
+                                           std::size_t link,
+                                           bool required);
+  uint64_t read(const RegisterHandle& handle) const;       // NOLINT(build/unsigned) caller holds m_card_mutex
+  void write(const RegisterHandle& handle, uint64_t value); // NOLINT(build/unsigned) caller holds m_card_mutex
+  using handle_val_pairs_t = std::vector<std::pair<const RegisterHandle*, uint64_t>>; // NOLINT(build/unsigned)
+  handle_val_pairs_t resolve_writes(const reg_val_pairs_t& values,
+                                    const std::unordered_map<std::string, RegisterHandle>& table) const;
+  void write_batch(const handle_val_pairs_t& values); // throws before any write if a handle can't be written
+
+  uint64_t m_bar2_base{ 0 }; // NOLINT(build/unsigned)
+  std::unordered_map<std::string, RegisterHandle> m_registers;
+  std::unordered_map<std::string, RegisterHandle> m_bitfields;
+
+  // Handles used by configure and the alignment poll
+  const RegisterHandle* m_alignment_done{ nullptr };
+  const RegisterHandle* m_main_lclk_sel{ nullptr };
+  const RegisterHandle* m_gbt_soft_reset{ nullptr };
+  const RegisterHandle* m_emu_tofrontend{ nullptr };
+  const RegisterHandle* m_emu_tohost{ nullptr };
+  const RegisterHandle* m_tofrontend_fanout{ nullptr };
+  const RegisterHandle* m_tohost_fanout{ nullptr };
+  // Per-link bitfields exist only for the links of the firmware: resolved on first use
+  std::array<const RegisterHandle*, m_max_links> m_epath_ena{};
+  std::array<const RegisterHandle*, m_max_links> m_superchunk_factor{};
+
   // Card object
   uint32_t m_device_id;
-  using UniqueFlxCard = std::unique_ptr<FlxCard>;
-  UniqueFlxCard m_flx_card;
+  std::unique_ptr<CardInterface> m_flx_card;
   std::mutex m_card_mutex;
 };
 
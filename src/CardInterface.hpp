@@ -0,0 +1,71 @@
+/**
+ * @file CardInterface.hpp Narrow interface to a FELIX card: the subset of
+ * FlxCard and CMEM that CardWrapper and CardControllerWrapper use.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_CARDINTERFACE_HPP_
+#define FLXLIBS_SRC_CARDINTERFACE_HPP_
+
+#include "flxcard/FlxCard.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace dunedaq::flxlibs {
+
+class CardInterface
+{
+public:
+  virtual ~CardInterface() = default;
+
+  // Device
+  virtual void card_open(int device, unsigned lock_mask) = 0;
+  virtual void card_close() = 0;
+  virtual unsigned get_lock_mask(int device) = 0;
+  virtual void soft_reset() = 0;
+
+  // Registers: base address of the register BAR, to be used with the regmap offsets
+  virtual uint64_t register_base() = 0; // NOLINT(build/unsigned)
+
+  // Links
+  virtual int gbt_setup(int alignment, int mode) = 0;
+  virtual void gth_rx_reset(int quad) = 0;
+
+  // Interrupts
+  virtual void irq_enable(unsigned irq) = 0;
+  virtual void irq_disable(unsigned irq) = 0;
+  virtual void irq_wait(unsigned irq) = 0;
+  virtual void irq_reset_counters() = 0;
+
+  // DMA
+  virtual void dma_reset() = 0;
+  virtual void dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t size, unsigned flags) = 0; // NOLINT
+  virtual void dma_stop(unsigned dma_id) = 0;
+  virtual void dma_set_ptr(unsigned dma_id, uint64_t phys_addr) = 0; // NOLINT(build/unsigned)
+  virtual uint64_t dma_current_address(unsigned dma_id) = 0;         // NOLINT(build/unsigned)
+
+  // DMA memory: returns false if the buffer couldn't be allocated
+  virtual bool allocate_dma_buffer(uint8_t numa,       // NOLINT(build/unsigned)
+                                   std::size_t size,
+                                   const std::string& name,
+                                   int& handle,
+                                   uint64_t& phys_addr, // NOLINT(build/unsigned)
+                                   uint64_t& virt_addr) = 0; // NOLINT(build/unsigned)
+  // File another process can map an allocated buffer from, at offset; empty if there is none
+  virtual std::string dma_buffer_file(int handle, uint64_t& offset) = 0; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief The real card, through FlxCard and the CMEM driver.
+ */
+std::unique_ptr<CardInterface>
+make_flx_card();
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_CARDINTERFACE_HPP_
@@ -16,6 +16,7 @@
 #include "packetformat/block_format.hpp"
 
 // From STD
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <string>
@@ -33,23 +34,55 @@ enum
 namespace dunedaq {
 namespace flxlibs {
 
-CardWrapper::CardWrapper(const appmodel::FelixInterface * cfg)
+namespace {
+
+inline uint64_t // NOLINT(build/unsigned)
+ns_since(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // namespace
+
+CardWrapper::Settings
+CardWrapper::settings_from(const appmodel::FelixInterface* cfg)
+{
+  Settings settings;
+  settings.card_id = cfg->get_card();
+  settings.logical_unit = cfg->get_slr();
+  settings.dma_id = cfg->get_dma_id();
+  settings.margin_blocks = cfg->get_dma_margin_blocks();
+  settings.block_threshold = cfg->get_dma_block_threshold();
+  settings.interrupt_mode = cfg->get_interrupt_mode();
+  settings.poll_time = cfg->get_poll_time();
+  settings.numa_id = cfg->get_numa_id();
+  settings.dma_memory_size = cfg->get_dma_memory_size_gb() * 1024 * 1024 * 1024UL;
+  settings.links_enabled = cfg->get_links_enabled();
+  return settings;
+}
+
+CardWrapper::CardWrapper(const appmodel::FelixInterface* cfg, std::unique_ptr<CardInterface> card)
+  : CardWrapper(settings_from(cfg), std::move(card))
+{}
+
+CardWrapper::CardWrapper(const Settings& settings, std::unique_ptr<CardInterface> card)
   : m_run_marker{ false }
-  , m_card_id(cfg->get_card())
-  , m_logical_unit(cfg->get_slr())
-  , m_dma_id(cfg->get_dma_id())
-  , m_margin_blocks(cfg->get_dma_margin_blocks())
-  , m_block_threshold(cfg->get_dma_block_threshold())
-  , m_interrupt_mode(cfg->get_interrupt_mode())
-  , m_poll_time(cfg->get_poll_time())
-  , m_numa_id(cfg->get_numa_id())
+  , m_card_id(settings.card_id)
+  , m_logical_unit(settings.logical_unit)
+  , m_dma_id(settings.dma_id)
+  , m_margin_blocks(settings.margin_blocks)
+  , m_block_threshold(settings.block_threshold)
+  , m_interrupt_mode(settings.interrupt_mode)
+  , m_poll_time(settings.poll_time)
+  , m_numa_id(settings.numa_id)
+  , m_links_enabled(settings.links_enabled)
   , m_info_str("")
+  , m_flx_card(std::move(card))
+  , m_dma_memory_size(settings.dma_memory_size)
   , m_run_lock{ false }
   , m_dma_processor(0)
   , m_handle_block_addr(nullptr)
 {
-  m_dma_memory_size = cfg->get_dma_memory_size_gb() * 1024 * 1024 * 1024UL;
-  m_links_enabled = cfg->get_links_enabled();
 
   std::ostringstream tnoss;
   tnoss << m_dma_processor_name << "-" << std::to_string(m_card_id); // append physical card id
@@ -59,7 +92,6 @@ CardWrapper::CardWrapper(const appmodel::FelixInterface * cfg)
   cardoss << "[id:" << std::to_string(m_card_id) << " slr:" << std::to_string(m_logical_unit) << "]";
   m_card_id_str = cardoss.str();
 
-  m_flx_card = std::make_unique<FlxCard>();
   if (m_flx_card == nullptr) {
     throw flxlibs::CardError(ERS_HERE, "Couldn't create FlxCard object.");
   }
@@ -108,6 +140,28 @@ CardWrapper::start()
     if (!m_block_addr_handler_available) {
       TLOG() << "Block Address handler is not set! Is it intentional?";
     }
+    // A card held back by the recorder raises no interrupt, and blocks are only released after the wait
+    if (m_block_recorder != nullptr && m_interrupt_mode) {
+      throw ConfigurationError(ERS_HERE, "Card[" + m_card_id_str + "] block recording needs poll mode, not interrupt mode");
+    }
+    if (m_lookback != nullptr) {
+      m_lookback->attach(reinterpret_cast<const char*>(m_virt_addr), m_dma_memory_size, m_block_size); // NOLINT
+    }
+    if (m_ring_export != nullptr) {
+      uint64_t ring_offset = 0; // NOLINT(build/unsigned)
+      std::string ring_file = m_flx_card->dma_buffer_file(m_cmem_handle, ring_offset);
+      try {
+        m_ring_export->start(reinterpret_cast<const char*>(m_virt_addr), // NOLINT
+                             m_dma_memory_size,
+                             m_block_size,
+                             ring_file,
+                             ring_offset);
+        TLOG() << "Card[" << m_card_id_str << "] DMA ring exported as " << m_ring_export->get_name();
+      } catch (const RingExportError& ex) {
+        ers::warning(ex); // the readout goes on without it
+        m_ring_export.reset();
+      }
+    }
     start_DMA();
     set_running(true);
     m_dma_processor.set_work(&CardWrapper::process_DMA, this);
@@ -127,6 +181,13 @@ CardWrapper::graceful_stop()
       std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
     stop_DMA();
+    if (m_ring_export != nullptr) {
+      m_ring_export->stop();
+    }
+    if (m_block_recorder != nullptr) {
+      m_block_recorder->flush(); // the ring is reused after init_DMA
+      m_recorder_holding = false;
+    }
     init_DMA();
     TLOG_DEBUG(TLVL_WORK_STEPS) << "Stopped CardWrapper of card " << m_card_id_str << "!";
   } else {
@@ -184,22 +245,11 @@ CardWrapper::close_card()
 }
 
 int
-CardWrapper::allocate_CMEM(uint8_t numa, u_long bsize, u_long* paddr, u_long* vaddr) // NOLINT
+CardWrapper::allocate_CMEM(uint8_t numa, uint64_t bsize, uint64_t* paddr, uint64_t* vaddr) // NOLINT
 {
   TLOG_DEBUG(TLVL_WORK_STEPS) << "Allocating CMEM buffer " << m_card_id_str << " dma id:" << std::to_string(m_dma_id);
-  int handle;
-  unsigned ret = CMEM_Open(); // cmem_rcc.h
-  if (!ret) {
-    ret = CMEM_NumaSegmentAllocate(bsize, numa, const_cast<char*>(m_card_id_str.c_str()), &handle); // NUMA aware
-    // ret = CMEM_GFPBPASegmentAllocate(bsize, const_cast<char*>(m_card_id_str.c_str()), &handle); // non NUMA aware
-  }
-  if (!ret) {
-    ret = CMEM_SegmentPhysicalAddress(handle, paddr);
-  }
-  if (!ret) {
-    ret = CMEM_SegmentVirtualAddress(handle, vaddr);
-  }
-  if (ret) {
+  int handle = 0;
+  if (!m_flx_card->allocate_dma_buffer(numa, bsize, m_card_id_str, handle, *paddr, *vaddr)) {
     // rcc_error_print(stdout, ret);
     m_card_mutex.lock();
     m_flx_card->card_close();
@@ -233,7 +283,7 @@ CardWrapper::init_DMA()
 #endif
     TLOG_DEBUG(TLVL_WORK_STEPS) << "flxCard.irq_enable issued.";
   } else {
-    m_flx_card->irq_disable();
+    m_flx_card->irq_disable(ALL_IRQS);
     TLOG_DEBUG(TLVL_WORK_STEPS) << "flxCard.irq_disable issued.";
   }
   m_card_mutex.unlock();
@@ -273,10 +323,63 @@ void
 CardWrapper::read_current_address()
 {
   m_card_mutex.lock();
-  m_current_addr = m_flx_card->m_bar0->DMA_DESC_STATUS[m_dma_id].current_address;
+  m_current_addr = m_flx_card->dma_current_address(m_dma_id);
   m_card_mutex.unlock();
 }
 
+void
+CardWrapper::generate_opmon_data()
+{
+  opmon::CardWrapperInfo info;
+  auto snap = m_stats.snapshot();
+  const auto& prev = m_last_snapshot;
+  // The next maximum of the ring occupancy starts from here
+  m_stats.interval++;
+
+  // Exact interval between the two snapshots the deltas are taken from
+  double seconds = std::chrono::duration_cast<std::chrono::microseconds>(snap.taken - prev.taken).count() / 1000000.;
+
+  info.set_num_bytes_dma(snap.bytes_ctr - prev.bytes_ctr);
+  info.set_num_blocks_dma(snap.block_ctr - prev.block_ctr);
+  if (seconds > 0) {
+    info.set_rate_dma_mbytes(info.num_bytes_dma() / seconds / 1000000.);
+    info.set_rate_dma_blocks(info.num_blocks_dma() / seconds / 1000.);
+  }
+
+  info.set_ring_size_bytes(m_dma_memory_size);
+  info.set_ring_occupancy_bytes(snap.occupancy_bytes);
+  info.set_max_ring_occupancy_bytes(snap.max_occupancy_bytes);
+  if (m_dma_memory_size > 0) {
+    info.set_max_ring_occupancy(static_cast<double>(info.max_ring_occupancy_bytes()) / m_dma_memory_size);
+  }
+
+  info.set_num_polls(snap.poll_ctr - prev.poll_ctr);
+  info.set_num_irq_waits(snap.irq_wait_ctr - prev.irq_wait_ctr);
+  info.set_num_batches(snap.batch_ctr - prev.batch_ctr);
+  if (info.num_batches() > 0) {
+    info.set_avg_blocks_per_batch(static_cast<double>(info.num_blocks_dma()) / info.num_batches());
+  }
+  info.set_num_dma_set_ptr(snap.set_ptr_ctr - prev.set_ptr_ctr);
+
+  info.set_time_wait_ms((snap.wait_ns - prev.wait_ns) / 1000000.);
+  info.set_time_read_address_ms((snap.read_address_ns - prev.read_address_ns) / 1000000.);
+  info.set_time_dispatch_ms((snap.dispatch_ns - prev.dispatch_ns) / 1000000.);
+  info.set_time_set_ptr_ms((snap.set_ptr_ns - prev.set_ptr_ns) / 1000000.);
+
+  m_last_snapshot = snap;
+
+  TLOG_DEBUG(TLVL_BOOKKEEPING) << "Card" << m_card_id_str << " DMA stats ->"
+                               << " Rate: " << info.rate_dma_mbytes() << " [MB/s]"
+                               << " Max occupancy: " << info.max_ring_occupancy() * 100. << " [%]"
+                               << " Blocks/batch: " << info.avg_blocks_per_batch()
+                               << " Polls: " << info.num_polls() << " IRQ waits: " << info.num_irq_waits();
+
+  publish(std::move(info),
+          { { "card", std::to_string(m_card_id) },
+            { "logical_unit", std::to_string(m_logical_unit) },
+            { "dma", std::to_string(m_dma_id) } });
+}
+
 void
 CardWrapper::process_DMA()
 {
@@ -297,6 +400,7 @@ CardWrapper::process_DMA()
     // Loop or wait for interrupt while there are not enough data
     while (bytes_available() < m_block_threshold * m_block_size) {
       if (m_run_marker.load()) {
+        auto t_wait = std::chrono::steady_clock::now();
         if (m_interrupt_mode) {
           m_card_mutex.lock();
 #if REGMAP_VERSION < 0x500
@@ -305,18 +409,47 @@ CardWrapper::process_DMA()
           m_flx_card->irq_wait(IRQ_DATA_AVAILABLE + m_dma_id);
 #endif // REGMAP_VERSION
           m_card_mutex.unlock();
+          m_stats.irq_wait_ctr++;
         } else { // poll mode
           std::this_thread::sleep_for(std::chrono::microseconds(m_poll_time));
+          m_stats.poll_ctr++;
         }
+        // A full ring only drains once the recorder lets go of the blocks it still writes
+        if (m_recorder_holding) {
+          release_blocks();
+        }
+        auto t_read = std::chrono::steady_clock::now();
+        m_stats.wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t_read - t_wait).count();
         read_current_address();
+        m_stats.read_address_ns += ns_since(t_read);
       } else {
         TLOG_DEBUG(TLVL_WORK_STEPS) << "Stop issued during waiting for data! Returning...";
         return;
       }
     }
 
+    // Ring occupancy as seen by this pass
+    uint64_t occupancy = bytes_available(); // NOLINT(build/unsigned)
+    m_stats.occupancy_bytes.store(occupancy);
+    const uint64_t interval = m_stats.interval.load(); // NOLINT(build/unsigned)
+    if (interval != m_occupancy_interval || occupancy > m_stats.max_occupancy_bytes.load()) {
+      m_stats.max_occupancy_bytes.store(occupancy); // the maximum starts over with every opmon interval
+      m_occupancy_interval = interval;
+    }
+
     // Set write index and start DMA advancing
+    auto t_dispatch = std::chrono::steady_clock::now();
     u_long write_index = (m_current_addr - m_phys_addr) / m_block_size;
+    if (m_block_recorder != nullptr) {
+      record_blocks(m_read_index, write_index);
+    }
+    if (m_lookback != nullptr) {
+      const u_long ring_blocks = m_dma_memory_size / m_block_size;
+      m_lookback->dispatching((write_index + ring_blocks - m_read_index) % ring_blocks);
+    }
+    if (m_ring_export != nullptr) {
+      m_ring_export->publish(m_read_index, write_index);
+    }
     uint64_t bytes = 0; // NOLINT
     while (m_read_index != write_index) {
       uint64_t from_address = m_virt_addr + (m_read_index * m_block_size); // NOLINT
@@ -330,20 +463,60 @@ CardWrapper::process_DMA()
       m_read_index = (m_read_index + 1) % (m_dma_memory_size / m_block_size);
       bytes += m_block_size;
     }
+    m_stats.dispatch_ns += ns_since(t_dispatch);
+    m_stats.bytes_ctr += bytes;
+    m_stats.block_ctr += bytes / m_block_size;
+    m_stats.batch_ctr++;
 
-    // here check if we can move the read pointer in the circular buffer
-    m_destination = m_phys_addr + (write_index * m_block_size) - (m_margin_blocks * m_block_size);
-    if (m_destination < m_phys_addr) {
-      m_destination += m_dma_memory_size;
-    }
-
-    // Finally, set new pointer
-    m_card_mutex.lock();
-    m_flx_card->dma_set_ptr(m_dma_id, m_destination);
-    m_card_mutex.unlock();
+    // Finally, move the read pointer in the circular buffer
+    release_blocks();
   }
   TLOG_DEBUG(TLVL_WORK_STEPS) << "CardWrapper processor thread finished.";
 }
 
+void
+CardWrapper::record_blocks(unsigned from_index, unsigned to_index)
+{
+  // Contiguous spans of the ring, split where it wraps around
+  const char* ring = reinterpret_cast<const char*>(m_virt_addr); // NOLINT
+  if (to_index < from_index) {
+    m_block_recorder->submit(ring + from_index * m_block_size, m_dma_memory_size - from_index * m_block_size);
+    from_index = 0;
+  }
+  if (to_index > from_index) {
+    m_block_recorder->submit(ring + from_index * m_block_size, (to_index - from_index) * m_block_size);
+  }
+}
+
+void
+CardWrapper::release_blocks()
+{
+  // Everything before the read index was handed out; keep the margin, whatever is still being recorded
+  // and the lookback
+  uint64_t hold = m_margin_blocks * m_block_size; // NOLINT(build/unsigned)
+  if (m_block_recorder != nullptr) {
+    uint64_t recording = m_block_recorder->get_submitted_bytes() - m_block_recorder->get_retired_bytes(); // NOLINT
+    m_recorder_holding = recording > hold;
+    hold = std::min<uint64_t>(std::max(hold, recording), m_dma_memory_size - m_block_size); // NOLINT
+  }
+  if (m_lookback != nullptr) {
+    hold = m_lookback->release(hold);
+  }
+  if (m_ring_export != nullptr) {
+    m_ring_export->release(hold); // secondaries are not waited for
+  }
+  m_destination = m_phys_addr + (m_read_index * m_block_size) - hold;
+  if (m_destination < m_phys_addr) {
+    m_destination += m_dma_memory_size;
+  }
+
+  auto t_set_ptr = std::chrono::steady_clock::now();
+  m_card_mutex.lock();
+  m_flx_card->dma_set_ptr(m_dma_id, m_destination);
+  m_card_mutex.unlock();
+  m_stats.set_ptr_ns += ns_since(t_set_ptr);
+  m_stats.set_ptr_ctr++;
+}
+
 } // namespace flxlibs
 } // namespace dunedaq
@@ -11,29 +11,65 @@
 //#include "flxlibs/felixcardreader/Nljs.hpp"
 //#include "flxlibs/felixcardreader/Structs.hpp"
 
+#include "CardInterface.hpp"
+#include "FelixStatistics.hpp"
+#include "RingExport.hpp"
+#include "RingLookback.hpp"
+#include "flxlibs/BlockRecorder.hpp"
+#include "flxlibs/opmon/CardWrapper.pb.h"
+
 #include "appmodel/FelixInterface.hpp"
 #include "datahandlinglibs/utils/ReusableThread.hpp"
+#include "opmonlib/MonitorableObject.hpp"
 
-#include "flxcard/FlxCard.h"
 #include "packetformat/block_format.hpp"
 
 #include <nlohmann/json.hpp>
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace dunedaq::flxlibs {
 
-class CardWrapper
+class CardWrapper : public opmonlib::MonitorableObject
 {
 public:
   /**
    * @brief CardWrapper Constructor
-   * @param name Instance name for this CardWrapper instance
+   * @param cfg FELIX interface configuration
+   * @param card Card implementation; the real FELIX card unless a mock is given
+   */
+  explicit CardWrapper(const appmodel::FelixInterface* cfg, std::unique_ptr<CardInterface> card = make_flx_card());
+
+  /**
+   * @brief What CardWrapper takes from a FelixInterface, for use without a configuration database
+   */
+  struct Settings
+  {
+    uint8_t card_id{ 0 };      // NOLINT(build/unsigned)
+    uint8_t logical_unit{ 0 }; // NOLINT(build/unsigned)
+    uint8_t dma_id{ 0 };       // NOLINT(build/unsigned)
+    size_t margin_blocks{ 4 };
+    size_t block_threshold{ 256 };
+    bool interrupt_mode{ false };
+    size_t poll_time{ 5000 }; // microseconds
+    uint8_t numa_id{ 0 };     // NOLINT(build/unsigned)
+    std::size_t dma_memory_size{ 0 }; // bytes
+    std::vector<unsigned int> links_enabled; // NOLINT(build/unsigned)
+  };
+  static Settings settings_from(const appmodel::FelixInterface* cfg);
+
+  /**
+   * @brief CardWrapper Constructor
+   * @param settings DMA and card settings
+   * @param card Card implementation; the real FELIX card unless a mock is given
    */
-  CardWrapper(const appmodel::FelixInterface * cfg);
+  explicit CardWrapper(const Settings& settings, std::unique_ptr<CardInterface> card = make_flx_card());
   ~CardWrapper();
   CardWrapper(const CardWrapper&) = delete;            ///< CardWrapper is not copy-constructible
   CardWrapper& operator=(const CardWrapper&) = delete; ///< CardWrapper is not copy-assignable
@@ -53,6 +89,30 @@ public:
     m_block_addr_handler_available = true;
   }
 
+  // Records every block handed out, straight from the DMA ring; set before start(). Blocks
+  // still being written are held from the card, which is only rechecked often enough in poll
+  // mode: start() rejects a recorder in interrupt mode.
+  void set_block_recorder(std::shared_ptr<BlockRecorder> recorder) { m_block_recorder = std::move(recorder); }
+
+  // Keeps the lookback of the ring from the card and serves window requests from it; set before
+  // start(). The card can then only run ahead by the ring size less the lookback.
+  void set_lookback(std::shared_ptr<RingLookback> lookback) { m_lookback = std::move(lookback); }
+
+  // Largest lookback that still leaves the card room for block_threshold blocks plus the margin;
+  // with a larger one the DMA processor waits for a batch the card can never write.
+  std::size_t get_max_lookback_bytes() const
+  {
+    const std::size_t reserved = (m_block_threshold + m_margin_blocks) * m_block_size;
+    return m_dma_memory_size > reserved ? m_dma_memory_size - reserved : 0;
+  }
+
+  // Publishes the ring for read-only consumers in other processes; set before start(). They follow
+  // the blocks handed out but never hold any from the card, so a slow one loses blocks.
+  void set_ring_export(std::shared_ptr<RingExport> ring_export) { m_ring_export = std::move(ring_export); }
+
+protected:
+  void generate_opmon_data() override;
+
 private:
   
   // Constants
@@ -67,12 +127,14 @@ private:
   void close_card();
 
   // DMA
-  int allocate_CMEM(uint8_t numa, u_long bsize, u_long* paddr, u_long* vaddr); // NOLINT
+  int allocate_CMEM(uint8_t numa, uint64_t bsize, uint64_t* paddr, uint64_t* vaddr); // NOLINT
   void init_DMA();
   void start_DMA();
   void stop_DMA();
   uint64_t bytes_available(); // NOLINT
   void read_current_address();
+  void record_blocks(unsigned from_index, unsigned to_index);
+  void release_blocks();
 
   // Configuration and internals
   
@@ -91,8 +153,7 @@ private:
   std::string m_info_str;
 
   // Card object
-  using UniqueFlxCard = std::unique_ptr<FlxCard>;
-  UniqueFlxCard m_flx_card;
+  std::unique_ptr<CardInterface> m_flx_card;
   std::mutex m_card_mutex;
 
   // DMA: CMEM
@@ -102,7 +163,7 @@ private:
   uint64_t m_phys_addr;          // NOLINT physical address of the DMA memory block
   uint64_t m_current_addr;       // NOLINT pointer to the current write position for the card
   unsigned m_read_index;         // NOLINT
-  u_long m_destination;          // u_long -> FlxCard.h
+  uint64_t m_destination;        // NOLINT
 
   // Processor
   inline static const std::string m_dma_processor_name = "flx-dma";
@@ -111,6 +172,21 @@ private:
   std::function<void(uint64_t)> m_handle_block_addr; // NOLINT
   bool m_block_addr_handler_available{ false };
   void process_DMA();
+
+  // Recording: blocks are only released to the card once they are on disk
+  std::shared_ptr<BlockRecorder> m_block_recorder;
+  bool m_recorder_holding{ false };
+
+  // In-ring lookback: blocks are released once they leave the lookback and no request copies them
+  std::shared_ptr<RingLookback> m_lookback;
+
+  // Shared memory export of the ring, if any
+  std::shared_ptr<RingExport> m_ring_export;
+
+  // Statistics, written by the DMA processor; generate_opmon_data publishes the deltas between its snapshots
+  stats::DMAStats m_stats;
+  stats::DMAStatsSnapshot m_last_snapshot;
+  uint64_t m_occupancy_interval{ 0 }; // NOLINT(build/unsigned) DMA processor only
 };
 
 } // namespace dunedaq::flxlibs
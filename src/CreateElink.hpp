@@ -12,101 +12,172 @@
 #include "ElinkModel.hpp"
 #include "flxlibs/AvailableParserOperations.hpp"
 #include "datahandlinglibs/DataHandlingIssues.hpp"
-//#include "fdreadoutlibs/ProtoWIBSuperChunkTypeAdapter.hpp"
-//#include "fdreadoutlibs/DUNEWIBSuperChunkTypeAdapter.hpp"
+// WIB-style superchunks are only available with fdreadoutlibs releases that still ship them
+#if __has_include("fdreadoutlibs/ProtoWIBSuperChunkTypeAdapter.hpp")
+#include "fdreadoutlibs/ProtoWIBSuperChunkTypeAdapter.hpp"
+#define FLXLIBS_WITH_PROTOWIB_SUPERCHUNK 1 // NOLINT(build/define_used)
+#endif
+#if __has_include("fdreadoutlibs/DUNEWIBSuperChunkTypeAdapter.hpp")
+#include "fdreadoutlibs/DUNEWIBSuperChunkTypeAdapter.hpp"
+#define FLXLIBS_WITH_DUNEWIB_SUPERCHUNK 1 // NOLINT(build/define_used)
+#endif
 #include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
 #include "fdreadoutlibs/VariableSizePayloadTypeAdapter.hpp"
 
 #include <memory>
 #include <string>
+#include <utility>
 
 namespace dunedaq {
 
-//DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter, "WIBFrame")
-//DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter, "WIB2Frame")
+#ifdef FLXLIBS_WITH_PROTOWIB_SUPERCHUNK
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter, "WIBFrame")
+#endif
+#ifdef FLXLIBS_WITH_DUNEWIB_SUPERCHUNK
+DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter, "WIB2Frame")
+#endif
 DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, "PDSFrame")
 DUNE_DAQ_TYPESTRING(dunedaq::fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter, "PDSStreamFrame")
+DUNE_DAQ_TYPESTRING(dunedaq::flxlibs::ErrorChunkHandle, "FelixErrorChunk")
 
 namespace flxlibs {
 
-std::unique_ptr<ElinkConcept>
-createElinkModel(const std::string& conn_uid)
+/**
+ * Wiring policies: how the parser operations of an ElinkModel<Payload> are bound.
+ */
+namespace wiring {
+
+// Fixed size superchunks of self-triggered frames: timestamps only have to increase
+struct MonotonicSuperchunk
 {
-  auto datatypes = dunedaq::iomanager::IOManager::get()->get_datatypes(conn_uid);
-  if (datatypes.size() != 1) {
-    ers::error(dunedaq::datahandlinglibs::GenericConfigurationError(ERS_HERE,
-      "Multiple output data types specified! Expected only a single type!"));
+  template<class Payload>
+  static void wire(ElinkModel<Payload>& model, const parsers::ParserOptions& opts)
+  {
+    auto& parser = model.get_parser();
+    parser.process_chunk_func = parsers::timestampedChunkInto<Payload>(model.get_sink(), parser.get_local_stats(), opts, 0);
   }
-  std::string raw_dt{ *datatypes.begin() };
-  TLOG() << "Choosing specializations for ElinkModel for output connection "
-         << " [uid:" << conn_uid << " , data_type:" << raw_dt << ']';
-/*
+};
 
-  if (raw_dt.find("WIBFrame") != std::string::npos) {
-    // WIB1 specific char arrays
-    // Create Model
-    auto elink_model = std::make_unique<ElinkModel<fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter>>();
+// Fixed size superchunks of streamed frames (DAPHNEStream, WIB, WIB2), at a fixed tick stride from each other
+struct StridedSuperchunk
+{
+  template<class Payload>
+  static void wire(ElinkModel<Payload>& model, const parsers::ParserOptions& opts)
+  {
+    auto& parser = model.get_parser();
+    uint64_t stride = Payload::expected_tick_difference * Payload().get_num_frames(); // NOLINT(build/unsigned)
+    parser.process_chunk_func = parsers::timestampedChunkInto<Payload>(model.get_sink(), parser.get_local_stats(), opts, stride);
+  }
+};
 
-    // Setup sink (acquire pointer from QueueRegistry)
-    elink_model->set_sink(conn_uid);
+// Variable sized user payloads, chunks and shortchunks
+struct VariableSize
+{
+  template<class Payload>
+  static void wire(ElinkModel<Payload>& model, const parsers::ParserOptions& opts)
+  {
+    auto& parser = model.get_parser();
+    auto& sink = model.get_sink();
+    if (opts.coalesce_shortchunks) {
+      auto coalescer = std::make_shared<parsers::ShortchunkCoalescer>(sink, parser.get_local_stats(), opts);
+      parser.process_chunk_func = parsers::coalescedChunkIntoWrapper(coalescer, sink, parser.get_local_stats(), opts);
+      parser.process_shortchunk_func = parsers::coalescedShortchunkInto(coalescer);
+      parser.process_block_func = parsers::coalescedBlockBoundary(coalescer);
+      parser.flush_func = parsers::coalescedFlush(coalescer);
+    } else {
+      parser.process_chunk_func = parsers::varsizedChunkIntoWrapper(sink, parser.get_local_stats(), opts);
+      parser.process_shortchunk_func = parsers::varsizedShortchunkIntoWrapper(sink, parser.get_local_stats(), opts);
+      // Nothing is held back between blocks, also when rebound from a coalescing configuration
+      parser.process_block_func = [](const felix::packetformat::block& /*block*/) {};
+      parser.flush_func = [](bool /*force*/) {};
+    }
+  }
+};
 
-    // Get parser and sink
-    auto& parser = elink_model->get_parser();
-    auto& sink = elink_model->get_sink();
-    auto& error_sink = elink_model->get_error_sink();
+} // namespace wiring
 
-    // Modify parser as needed...
-    parser.process_chunk_func = parsers::fixsizedChunkInto<fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter>(sink);
-    if (error_sink != nullptr) {
-      parser.process_chunk_with_error_func = parsers::errorChunkIntoSink(error_sink);
-    }
-    // parser.process_block_func = ...
+/**
+ * @brief Binds a payload type, known to IOManager by its typestring, to a wiring policy.
+ */
+template<class Payload, class Wiring>
+struct ElinkRegistration
+{
+  using payload_t = Payload;
+  using wiring_t = Wiring;
+};
 
-    // Return with setup model
-    return elink_model;
+/**
+ * @brief Type list of registrations. The connection's data type is compared
+ * exactly against each payload's typestring; everything else is resolved at
+ * compile time.
+ */
+template<class... Registrations>
+struct ElinkRegistry
+{
+  static std::unique_ptr<ElinkConcept> create(const std::string& data_type,
+                                              const std::string& conn_uid,
+                                              const parsers::ParserOptions& opts)
+  {
+    std::unique_ptr<ElinkConcept> model;
+    (try_create<Registrations>(data_type, conn_uid, opts, model) || ...);
+    return model;
+  }
 
-  } else if (raw_dt.find("WIB2Frame") != std::string::npos) {
-    // WIB2 specific char arrays
-    auto elink_model = std::make_unique<ElinkModel<fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter>>();
-    elink_model->set_sink(conn_uid);
-    auto& parser = elink_model->get_parser();
-    auto& sink = elink_model->get_sink();
-    parser.process_chunk_func = parsers::fixsizedChunkInto<fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter>(sink);
-    return elink_model;
-
-  } else*/ 
-  if (raw_dt.find("PDSStreamFrame") != std::string::npos) {
-    // PDS specific char arrays
-    auto elink_model = std::make_unique<ElinkModel<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>>();
-    elink_model->set_sink(conn_uid);
-    auto& parser = elink_model->get_parser();
-    auto& sink = elink_model->get_sink();
-    parser.process_chunk_func = parsers::fixsizedChunkInto<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter>(sink);
-    return elink_model;
-
-  } else if (raw_dt.find("PDSFrame") != std::string::npos) {
-    // PDS specific char arrays
-    auto elink_model = std::make_unique<ElinkModel<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>>();
+private:
+  template<class Registration>
+  static bool try_create(const std::string& data_type,
+                         const std::string& conn_uid,
+                         const parsers::ParserOptions& opts,
+                         std::unique_ptr<ElinkConcept>& model)
+  {
+    using payload_t = typename Registration::payload_t;
+    if (data_type != datatype_to_string<payload_t>()) {
+      return false;
+    }
+    auto elink_model = std::make_unique<ElinkModel<payload_t>>();
     elink_model->set_sink(conn_uid);
-    auto& parser = elink_model->get_parser();
-    auto& sink = elink_model->get_sink();
-    parser.process_chunk_func = parsers::fixsizedChunkInto<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter>(sink);
-    return elink_model;
+    elink_model->set_wiring(&wire<Registration>);
+    elink_model->set_parser_options(opts);
+    model = std::move(elink_model);
+    return true;
+  }
 
+  template<class Registration>
+  static void wire(ElinkModel<typename Registration::payload_t>& elink_model, const parsers::ParserOptions& opts)
+  {
+    auto& parser = elink_model.get_parser();
+    parser.process_chunk_with_error_func = parsers::errorChunkIntoSink(
+      elink_model.get_error_sink(), elink_model.get_error_pool(), parser.get_block_header(), parser.get_local_stats(), opts);
+    Registration::wiring_t::wire(elink_model, opts);
+  }
+};
+
+// Adding a payload type takes one registration line
+using RegisteredElinks = ElinkRegistry<
+#ifdef FLXLIBS_WITH_PROTOWIB_SUPERCHUNK
+  ElinkRegistration<fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter, wiring::StridedSuperchunk>,
+#endif
+#ifdef FLXLIBS_WITH_DUNEWIB_SUPERCHUNK
+  ElinkRegistration<fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter, wiring::StridedSuperchunk>,
+#endif
+  ElinkRegistration<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, wiring::MonotonicSuperchunk>,
+  ElinkRegistration<fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter, wiring::StridedSuperchunk>,
+  ElinkRegistration<fdreadoutlibs::types::VariableSizePayloadTypeAdapter, wiring::VariableSize>>;
 
-  } else if (raw_dt.find("varsize") != std::string::npos) {
-    // Variable sized user payloads
-    auto elink_model = std::make_unique<ElinkModel<fdreadoutlibs::types::VariableSizePayloadTypeAdapter>>();
-    elink_model->set_sink(conn_uid);
-    auto& parser = elink_model->get_parser();
-    auto& sink = elink_model->get_sink();
-    parser.process_chunk_func = parsers::varsizedChunkIntoWrapper(sink);
-    parser.process_shortchunk_func = parsers::varsizedShortchunkIntoWrapper(sink);
-    return elink_model;
+std::unique_ptr<ElinkConcept>
+createElinkModel(const std::string& conn_uid, const parsers::ParserOptions& opts = parsers::ParserOptions())
+{
+  auto datatypes = dunedaq::iomanager::IOManager::get()->get_datatypes(conn_uid);
+  if (datatypes.size() != 1) {
+    ers::error(dunedaq::datahandlinglibs::GenericConfigurationError(ERS_HERE,
+      "Multiple output data types specified! Expected only a single type!"));
   }
+  std::string raw_dt{ *datatypes.begin() };
+  TLOG() << "Choosing specializations for ElinkModel for output connection "
+         << " [uid:" << conn_uid << " , data_type:" << raw_dt << ']';
 
-  return nullptr;
+  return RegisteredElinks::create(raw_dt, conn_uid, opts);
 }
 
 } // namespace flxlibs
@@ -30,6 +30,7 @@ DefaultParserImpl::DefaultParserImpl()
   process_subchunk_with_error_func =
     std::bind(&DefaultParserImpl::process_subchunk_with_error, this, std::placeholders::_1);
   process_block_with_error_func = std::bind(&DefaultParserImpl::process_block_with_error, this, std::placeholders::_1);
+  flush_func = std::bind(&DefaultParserImpl::flush, this, std::placeholders::_1);
 }
 
 DefaultParserImpl::~DefaultParserImpl() {}
@@ -40,39 +41,84 @@ DefaultParserImpl::get_stats()
   return std::ref(m_stats);
 }
 
+void
+DefaultParserImpl::flush_local_stats()
+{
+  auto& local = m_local_stats;
+  m_stats.begin_update();
+  m_stats.packet_ctr += local.packet_ctr;
+  m_stats.short_ctr += local.short_ctr;
+  m_stats.chunk_ctr += local.chunk_ctr;
+  m_stats.subchunk_ctr += local.subchunk_ctr;
+  m_stats.block_ctr += local.block_ctr;
+  m_stats.error_short_ctr += local.error_short_ctr;
+  m_stats.error_chunk_ctr += local.error_chunk_ctr;
+  m_stats.error_subchunk_ctr += local.error_subchunk_ctr;
+  m_stats.error_block_ctr += local.error_block_ctr;
+  m_stats.bad_header_ctr += local.bad_header_ctr;
+  m_stats.subchunk_crc_error_ctr += local.subchunk_crc_error_ctr;
+  m_stats.subchunk_trunc_error_ctr += local.subchunk_trunc_error_ctr;
+  m_stats.subchunk_error_ctr += local.subchunk_error_ctr;
+  m_stats.dropped_payload_ctr += local.dropped_payload_ctr;
+  m_stats.dropped_bytes_ctr += local.dropped_bytes_ctr;
+  m_stats.send_retry_ctr += local.send_retry_ctr;
+  m_stats.timestamp_discontinuity_ctr += local.timestamp_discontinuity_ctr;
+  m_stats.timestamp_frozen_ctr += local.timestamp_frozen_ctr;
+  if (local.first_timestamp != 0 && m_stats.first_timestamp.load() == 0) {
+    m_stats.first_timestamp.store(local.first_timestamp);
+  }
+  if (local.last_timestamp != 0) {
+    m_stats.last_timestamp.store(local.last_timestamp);
+  }
+  m_stats.error_capture_ctr += local.error_capture_ctr;
+  m_stats.error_capture_skipped_ctr += local.error_capture_skipped_ctr;
+  m_stats.coalesced_payload_ctr += local.coalesced_payload_ctr;
+  m_stats.chunk_bytes_ctr += local.chunk_bytes_ctr;
+  m_stats.short_bytes_ctr += local.short_bytes_ctr;
+  for (std::size_t i = 0; i < stats::chunk_length_bins; ++i) {
+    m_stats.chunk_length_hist[i] += local.chunk_length_hist[i];
+  }
+  m_stats.end_update();
+  local = stats::ParserLocalStats();
+}
+
 void
 DefaultParserImpl::chunk_processed(const felix::packetformat::chunk& chunk)
 {
   process_chunk_func(chunk);
-  m_stats.chunk_ctr++;
+  m_local_stats.chunk_ctr++;
+  m_local_stats.chunk_bytes_ctr += chunk.length();
+  m_local_stats.chunk_length_hist[stats::chunk_length_bin(chunk.length())]++;
 }
 
 void
 DefaultParserImpl::shortchunk_processed(const felix::packetformat::shortchunk& shortchunk)
 {
   process_shortchunk_func(shortchunk);
-  m_stats.short_ctr++;
+  m_local_stats.short_ctr++;
+  m_local_stats.short_bytes_ctr += shortchunk.length;
+  m_local_stats.chunk_length_hist[stats::chunk_length_bin(shortchunk.length)]++;
 }
 
 void
 DefaultParserImpl::subchunk_processed(const felix::packetformat::subchunk& subchunk)
 {
   process_subchunk_func(subchunk);
-  m_stats.subchunk_ctr++;
+  m_local_stats.subchunk_ctr++;
 }
 
 void
 DefaultParserImpl::block_processed(const felix::packetformat::block& block)
 {
   process_block_func(block);
-  m_stats.block_ctr++;
+  m_local_stats.block_ctr++;
 }
 
 void
 DefaultParserImpl::chunk_processed_with_error(const felix::packetformat::chunk& chunk)
 {
   process_chunk_with_error_func(chunk);
-  m_stats.error_chunk_ctr++;
+  m_local_stats.error_chunk_ctr++;
 }
 
 void
@@ -80,29 +126,29 @@ DefaultParserImpl::subchunk_processed_with_error(const felix::packetformat::subc
 {
   process_subchunk_with_error_func(subchunk);
   if (subchunk.crcerr_flag) {   // NOLINT(runtime/output_format)
-    m_stats.subchunk_crc_error_ctr++;
+    m_local_stats.subchunk_crc_error_ctr++;
   }
   if (subchunk.trunc_flag) {
-    m_stats.subchunk_trunc_error_ctr++;
+    m_local_stats.subchunk_trunc_error_ctr++;
   }
   if (subchunk.err_flag) {
-    m_stats.subchunk_error_ctr++;
+    m_local_stats.subchunk_error_ctr++;
   }
-  m_stats.error_subchunk_ctr++;
+  m_local_stats.error_subchunk_ctr++;
 }
 
 void
 DefaultParserImpl::shortchunk_process_with_error(const felix::packetformat::shortchunk& shortchunk)
 {
   process_shortchunk_with_error_func(shortchunk);
-  m_stats.error_short_ctr++;
+  m_local_stats.error_short_ctr++;
 }
 
 void
 DefaultParserImpl::block_processed_with_error(const felix::packetformat::block& block)
 {
   process_block_with_error_func(block);
-  m_stats.error_block_ctr++;
+  m_local_stats.error_block_ctr++;
 }
 
 } // namespace flxlibs
@@ -16,6 +16,8 @@
 //#include "ReadoutTypes.hpp"
 #include "FelixStatistics.hpp"
 
+#include "flxlibs/BlockFormat.hpp"
+
 // From STD
 #include <functional>
 #include <iomanip>
@@ -32,7 +34,32 @@ public:
   DefaultParserImpl(DefaultParserImpl&&) = delete;                 ///< DefaultParserImpl is not move-constructible
   DefaultParserImpl& operator=(DefaultParserImpl&&) = delete;      ///< DefaultParserImpl is not move-assignable
 
+  // Published counters, for readers on any thread
   stats::ParserStats& get_stats();
+  // Counters of the parser thread, which the parser operations count into
+  stats::ParserLocalStats& get_local_stats() { return m_local_stats; }
+
+  // Publishes the counters accumulated since the last call, as one update of the published ones
+  void flush_local_stats();
+
+  // Header word of the block currently being parsed, as context for the parser operations
+  void set_block_header(uint32_t header) { m_block_header = header; } // NOLINT(build/unsigned)
+  const uint32_t& get_block_header() const { return m_block_header; } // NOLINT(build/unsigned)
+
+  // Start of block marker of the configured trailer size; 0 accepts any block
+  void set_expected_sob(uint32_t sob) { m_expected_sob = sob; } // NOLINT(build/unsigned)
+
+  // Sets the header of the next block. False, and counted, if its start of block marker is not the
+  // expected one: its trailers would be walked with the wrong width, so the block must not be parsed.
+  bool accept_block_header(uint32_t header) // NOLINT(build/unsigned)
+  {
+    m_block_header = header;
+    if (m_expected_sob != 0 && blockformat::header_sob(header) != m_expected_sob) {
+      m_local_stats.bad_header_ctr++;
+      return false;
+    }
+    return true;
+  }
 
   // Public functions for re-bind
   std::function<void(const felix::packetformat::chunk& chunk)> process_chunk_func;
@@ -43,6 +70,9 @@ public:
   std::function<void(const felix::packetformat::subchunk& subchunk)> process_subchunk_with_error_func;
   std::function<void(const felix::packetformat::shortchunk& shortchunk)> process_shortchunk_with_error_func;
   std::function<void(const felix::packetformat::block& block)> process_block_with_error_func;
+  // Sends out what the operations above hold back between blocks, e.g. coalesced shortchunks:
+  // whatever is due while the parser waits for blocks, everything when forced (at stop)
+  std::function<void(bool force)> flush_func;
 
   // Implementation of ParserOperations: They invoke the functions above
   void chunk_processed(const felix::packetformat::chunk& chunk);
@@ -64,9 +94,14 @@ private:
   void process_subchunk_with_error(const felix::packetformat::subchunk& /*subchunk*/) {}
   void process_shortchunk_with_error(const felix::packetformat::shortchunk& /*shortchunk*/) {}
   void process_block_with_error(const felix::packetformat::block& /*block*/) {}
+  void flush(bool /*force*/) {}
 
   // Statistics
   stats::ParserStats m_stats;
+  stats::ParserLocalStats m_local_stats;
+
+  uint32_t m_block_header{ 0 }; // NOLINT(build/unsigned)
+  uint32_t m_expected_sob{ 0 }; // NOLINT(build/unsigned)
 };
 
 } // namespace dunedaq::flxlibs
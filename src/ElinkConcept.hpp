@@ -11,6 +11,9 @@
 #define FLXLIBS_SRC_ELINKCONCEPT_HPP_
 
 #include "DefaultParserImpl.hpp"
+#include "RingLookback.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
 
 #include "appfwk/DAQModule.hpp"
 #include "packetformat/detail/block_parser.hpp"
@@ -46,7 +49,12 @@ public:
 
   virtual void init(const size_t block_queue_capacity) = 0;
   virtual void set_sink(const std::string& sink_name) = 0;
+  virtual void set_error_sink(const std::string& sink_name) = 0;
+  // Rebinds the parser operations with the given options; before conf, and before any lookback is set
+  virtual void set_parser_options(const parsers::ParserOptions& opts) = 0;
   virtual void conf(size_t block_size, bool is_32b_trailers) = 0;
+  // Indexes the parsed chunks in the lookback; after the parser options are set
+  virtual void set_lookback(std::shared_ptr<RingLookback> lookback, bool forward_payloads) = 0;
   virtual void start() = 0;
   virtual void stop() = 0;
 
@@ -86,7 +94,6 @@ protected:
   int m_link_tag;
   std::string m_elink_str;
   std::string m_elink_source_tid;
-  std::chrono::time_point<std::chrono::high_resolution_clock> m_t0;
 
 private:
 };
@@ -9,7 +9,10 @@
 #define FLXLIBS_SRC_ELINKMODEL_HPP_
 
 #include "ElinkConcept.hpp"
+#include "RingLookback.hpp"
 
+#include "flxlibs/BlockFormat.hpp"
+#include "flxlibs/ErrorChunkPool.hpp"
 #include "flxlibs/opmon/ElinkModel.pb.h"
 
 #include "packetformat/block_format.hpp"
@@ -24,9 +27,11 @@
 #include <nlohmann/json.hpp>
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
 
 namespace dunedaq::flxlibs {
 
@@ -35,9 +40,10 @@ class ElinkModel : public ElinkConcept
 {
 public:
   using sink_t = iomanager::SenderConcept<TargetPayloadType>;
-  using err_sink_t = iomanager::SenderConcept<felix::packetformat::chunk>;
+  using err_sink_t = iomanager::SenderConcept<ErrorChunkHandle>;
   using inherited = ElinkConcept;
   using data_t = nlohmann::json;
+  using wiring_t = std::function<void(ElinkModel&, const parsers::ParserOptions&)>;
 
   /**
    * @brief ElinkModel Constructor
@@ -60,10 +66,63 @@ public:
     }
   }
 
+  // Sender not managed by IOManager, e.g. a local queue in the pipeline benchmark
+  void set_sink(std::shared_ptr<sink_t> sink)
+  {
+    if (m_sink_is_set) {
+      TLOG_DEBUG(5) << "ElinkModel sink is already set in initialized!";
+    } else {
+      m_sink_queue = std::move(sink);
+      m_sink_is_set = true;
+    }
+  }
+
+  void set_error_sink(const std::string& sink_name) override
+  {
+    if (m_error_sink_queue != nullptr) {
+      TLOG_DEBUG(5) << "ElinkModel error sink is already set!";
+    } else {
+      // Records are only allocated for elinks that have somewhere to send them
+      m_error_pool = std::make_shared<ErrorChunkPool>(m_error_pool_size, m_error_captures_per_second);
+      m_error_sink_queue = get_iom_sender<ErrorChunkHandle>(sink_name);
+    }
+  }
+
+  // Indexes every chunk of the elink (by its tag) for window requests from the DMA ring; after the
+  // parser operations are wired. Without forwarding, chunks are only indexed and not copied out.
+  void set_lookback(std::shared_ptr<RingLookback> lookback, bool forward_payloads) override
+  {
+    m_lookback = std::move(lookback);
+    auto* index = &m_lookback->add_elink(static_cast<uint32_t>(inherited::m_link_tag)); // NOLINT(build/unsigned)
+    if (forward_payloads) {
+      auto forward = m_parser_impl.process_chunk_func;
+      m_parser_impl.process_chunk_func = [index, forward](const felix::packetformat::chunk& chunk) {
+        index->add_chunk(chunk);
+        forward(chunk);
+      };
+    } else {
+      m_parser_impl.process_chunk_func = [index](const felix::packetformat::chunk& chunk) { index->add_chunk(chunk); };
+    }
+  }
+
+  // How the parser operations are bound for this payload type, see CreateElink.hpp
+  void set_wiring(wiring_t wiring) { m_wiring = std::move(wiring); }
+
+  void set_parser_options(const parsers::ParserOptions& opts) override
+  {
+    if (m_run_marker.load()) {
+      TLOG_DEBUG(5) << "ElinkModel of link " << inherited::m_link_id << " is running, parser options are kept!";
+    } else if (m_wiring) {
+      m_wiring(*this, opts);
+    }
+  }
+
   std::shared_ptr<sink_t>& get_sink() { return m_sink_queue; }
 
   std::shared_ptr<err_sink_t>& get_error_sink() { return m_error_sink_queue; }
 
+  std::shared_ptr<ErrorChunkPool>& get_error_pool() { return m_error_pool; }
+
   void init(const size_t block_queue_capacity)
   {
     m_block_addr_queue = std::make_unique<folly::ProducerConsumerQueue<uint64_t>>(block_queue_capacity); // NOLINT
@@ -78,14 +137,16 @@ public:
       // if (inconsistency)
       // ers::fatal(ElinkConfigurationInconsistency(ERS_HERE, m_num_links));
 
+      m_block_size = block_size;
+      m_is_32b_trailers = is_32b_trailers;
       m_parser->configure(block_size, is_32b_trailers); // unsigned bsize, bool trailer_is_32bit
+      m_parser_impl.set_expected_sob(blockformat::start_of_block(is_32b_trailers));
       m_configured = true;
     }
   }
 
   void start()
   {
-    m_t0 = std::chrono::high_resolution_clock::now();
     if (!m_run_marker.load()) {
       set_running(true);
       m_parser_thread.set_work(&ElinkModel::process_elink, this);
@@ -128,26 +189,68 @@ protected:
   void generate_opmon_data() override {
 
     opmon::CardReaderInfo info;
-    auto now = std::chrono::high_resolution_clock::now();
-    auto& stats = m_parser_impl.get_stats();
+    auto snap = m_parser_impl.get_stats().snapshot();
+    const auto& prev = m_last_snapshot;
+    if (!snap.consistent) {
+      TLOG_DEBUG(2) << inherited::m_elink_str << " parser counters were read while being published";
+    }
 
-    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(now - m_t0).count() / 1000000.;
+    // Exact interval between the two snapshots the deltas are taken from
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(snap.taken - prev.taken).count() / 1000000.;
 
-    info.set_num_short_chunks_processed( stats.short_ctr.exchange(0) );
-    info.set_num_chunks_processed( stats.chunk_ctr.exchange(0) );
-    info.set_num_subchunks_processed(stats.subchunk_ctr.exchange(0));
-    info.set_num_blocks_processed(stats.block_ctr.exchange(0));
+    info.set_num_short_chunks_processed(snap.short_ctr - prev.short_ctr);
+    info.set_num_chunks_processed(snap.chunk_ctr - prev.chunk_ctr);
+    info.set_num_subchunks_processed(snap.subchunk_ctr - prev.subchunk_ctr);
+    info.set_num_blocks_processed(snap.block_ctr - prev.block_ctr);
 
-    info.set_rate_blocks_processed(info.num_blocks_processed() / seconds / 1000. );
-    info.set_rate_chunks_processed(info.num_chunks_processed() / seconds / 1000. );
+    info.set_num_chunk_bytes(snap.chunk_bytes_ctr - prev.chunk_bytes_ctr);
+    info.set_num_short_chunk_bytes(snap.short_bytes_ctr - prev.short_bytes_ctr);
 
-    info.set_num_short_chunks_processed_with_error(stats.error_short_ctr.exchange(0));
-    info.set_num_chunks_processed_with_error(stats.error_chunk_ctr.exchange(0));
-    info.set_num_subchunks_processed_with_error(stats.error_subchunk_ctr.exchange(0));
-    info.set_num_blocks_processed_with_error(stats.error_block_ctr.exchange(0));
-    info.set_num_subchunk_crc_errors(stats.subchunk_crc_error_ctr.exchange(0));
-    info.set_num_subchunk_trunc_errors(stats.subchunk_trunc_error_ctr.exchange(0));
-    info.set_num_subchunk_errors(stats.subchunk_error_ctr.exchange(0));
+    if (seconds > 0) {
+      info.set_rate_blocks_processed(info.num_blocks_processed() / seconds / 1000.);
+      info.set_rate_chunks_processed(info.num_chunks_processed() / seconds / 1000.);
+      info.set_rate_payload_mbytes((info.num_chunk_bytes() + info.num_short_chunk_bytes()) / seconds / 1000000.);
+    }
+
+    info.set_num_chunks_below_64b(snap.chunk_length_hist[0] - prev.chunk_length_hist[0]);
+    info.set_num_chunks_64b_256b(snap.chunk_length_hist[1] - prev.chunk_length_hist[1]);
+    info.set_num_chunks_256b_1kb(snap.chunk_length_hist[2] - prev.chunk_length_hist[2]);
+    info.set_num_chunks_1kb_4kb(snap.chunk_length_hist[3] - prev.chunk_length_hist[3]);
+    info.set_num_chunks_4kb_16kb(snap.chunk_length_hist[4] - prev.chunk_length_hist[4]);
+    info.set_num_chunks_16kb_64kb(snap.chunk_length_hist[5] - prev.chunk_length_hist[5]);
+    info.set_num_chunks_64kb_256kb(snap.chunk_length_hist[6] - prev.chunk_length_hist[6]);
+    info.set_num_chunks_256kb_1mb(snap.chunk_length_hist[7] - prev.chunk_length_hist[7]);
+    info.set_num_chunks_above_1mb(snap.chunk_length_hist[8] - prev.chunk_length_hist[8]);
+
+    info.set_num_short_chunks_processed_with_error(snap.error_short_ctr - prev.error_short_ctr);
+    info.set_num_chunks_processed_with_error(snap.error_chunk_ctr - prev.error_chunk_ctr);
+    info.set_num_subchunks_processed_with_error(snap.error_subchunk_ctr - prev.error_subchunk_ctr);
+    info.set_num_blocks_processed_with_error(snap.error_block_ctr - prev.error_block_ctr);
+    info.set_num_blocks_bad_header(snap.bad_header_ctr - prev.bad_header_ctr);
+    info.set_num_subchunk_crc_errors(snap.subchunk_crc_error_ctr - prev.subchunk_crc_error_ctr);
+    info.set_num_subchunk_trunc_errors(snap.subchunk_trunc_error_ctr - prev.subchunk_trunc_error_ctr);
+    info.set_num_subchunk_errors(snap.subchunk_error_ctr - prev.subchunk_error_ctr);
+
+    info.set_num_error_chunks_captured(snap.error_capture_ctr - prev.error_capture_ctr);
+    info.set_num_error_chunks_skipped(snap.error_capture_skipped_ctr - prev.error_capture_skipped_ctr);
+
+    info.set_num_coalesced_payloads(snap.coalesced_payload_ctr - prev.coalesced_payload_ctr);
+
+    info.set_num_payloads_dropped(snap.dropped_payload_ctr - prev.dropped_payload_ctr);
+    info.set_num_bytes_dropped(snap.dropped_bytes_ctr - prev.dropped_bytes_ctr);
+    info.set_num_send_retries(snap.send_retry_ctr - prev.send_retry_ctr);
+    info.set_num_timestamp_discontinuities(snap.timestamp_discontinuity_ctr - prev.timestamp_discontinuity_ctr);
+    info.set_num_timestamp_frozen(snap.timestamp_frozen_ctr - prev.timestamp_frozen_ctr);
+    info.set_first_timestamp(snap.first_timestamp);
+    info.set_last_timestamp(snap.last_timestamp);
+
+    m_last_snapshot = snap;
+
+    // Drops are reported once per monitoring interval, never from the parser thread
+    if (info.num_payloads_dropped() > 0) {
+      ers::warning(ParserOperationSinkDrops(
+        ERS_HERE, inherited::m_elink_str, info.num_payloads_dropped(), info.num_bytes_dropped()));
+    }
 
 
     TLOG_DEBUG(2) << inherited::m_elink_str // Move to TLVL_TAKE_NOTE from readout
@@ -156,13 +259,14 @@ protected:
 		  << " [kHz]"
 		  << " Chunks: " << info.num_chunks_processed() << " Chunk rate: " << info.rate_chunks_processed()
 		  << " [kHz]"
+		  << " Payload rate: " << info.rate_payload_mbytes() << " [MB/s]"
 		  << " Shorts: " << info.num_short_chunks_processed() << " Subchunks:" << info.num_subchunks_processed()
 		  << " Error Chunks: " << info.num_chunks_processed_with_error()
 		  << " Error Shorts: " << info.num_short_chunks_processed_with_error()
 		  << " Error Subchunks: " << info.num_subchunks_processed_with_error()
-		  << " Error Block: " << info.num_blocks_processed_with_error();
-
-    m_t0 = now;
+		  << " Error Block: " << info.num_blocks_processed_with_error()
+		  << " Bad headers: " << info.num_blocks_bad_header()
+		  << " Dropped payloads: " << info.num_payloads_dropped();
 
     publish( std::move(info),
 	     { { "card", std::to_string(m_card_id) },
@@ -179,15 +283,31 @@ private:
   // Internals
   std::atomic<bool> m_run_marker;
   bool m_configured{ false };
+  size_t m_block_size{ 4096 };
+  bool m_is_32b_trailers{ false };
 
   // Sink
   bool m_sink_is_set{ false };
   std::shared_ptr<sink_t> m_sink_queue;
   std::shared_ptr<err_sink_t> m_error_sink_queue;
 
+  // Error chunk capture
+  static constexpr std::size_t m_error_pool_size = 16;
+  static constexpr uint32_t m_error_captures_per_second = 100; // NOLINT(build/unsigned)
+  std::shared_ptr<ErrorChunkPool> m_error_pool;
+
+  // Parser operations binding
+  wiring_t m_wiring;
+
+  // In-ring lookback index, if any
+  std::shared_ptr<RingLookback> m_lookback;
+
   // blocks to process
   UniqueBlockAddrQueue m_block_addr_queue;
 
+  // Counters as of the previous publication
+  stats::ParserStatsSnapshot m_last_snapshot;
+
   // Processor
   inline static const std::string m_parser_thread_name = "elinkp";
   datahandlinglibs::ReusableThread m_parser_thread;
@@ -199,11 +319,29 @@ private:
         const auto* block = const_cast<felix::packetformat::block*>(
           felix::packetformat::block_from_bytes(reinterpret_cast<const char*>(block_addr)) // NOLINT
         );
-        m_parser->process(block);
+        if (m_parser_impl.accept_block_header(*reinterpret_cast<const uint32_t*>(block_addr))) { // NOLINT
+          m_parser->process(block);
+        } else {
+          reset_parser();
+        }
+        m_parser_impl.flush_local_stats();
       } else { // couldn't read from queue
+        flush_parser(false); // what is staged goes out once due, without waiting for the next block
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
       }
     }
+    flush_parser(true); // and nothing is left behind at stop
+  }
+
+  // A chunk left open by the previous block can't be continued past a skipped one: its next
+  // subchunks would be joined to the wrong data. Reconfiguring starts the same parser over at
+  // the next block, with no allocation however many blocks are skipped.
+  void reset_parser() { m_parser->configure(m_block_size, m_is_32b_trailers); }
+
+  void flush_parser(bool force)
+  {
+    m_parser_impl.flush_func(force);
+    m_parser_impl.flush_local_stats();
   }
 };
 
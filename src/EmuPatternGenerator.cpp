@@ -0,0 +1,211 @@
+/**
+ * @file EmuPatternGenerator.cpp FELIX emulator image generation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "flxlibs/EmuPatternGenerator.hpp"
+#include "flxlibs/Crc20.hpp"
+
+// From STD
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <ostream>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace flxlibs {
+namespace emu {
+
+namespace {
+
+void
+fill_chunk_data(uint64_t* dst, uint32_t n_words, uint32_t pattern_id) // NOLINT(build/unsigned)
+{
+  switch (pattern_id) {
+    case 1:
+      std::fill_n(dst, n_words, 0xAA55AA55);
+      break;
+    case 2:
+      std::fill_n(dst, n_words, 0xFFFFFFFF);
+      break;
+    case 3:
+      std::fill_n(dst, n_words, 0x00000000);
+      break;
+    default: {
+      uint32_t cntr = 0; // NOLINT(build/unsigned)
+      for (uint32_t i = 0; i < n_words; ++i, cntr += 4) { // NOLINT(build/unsigned)
+        dst[i] = ((((cntr + 3) & 0xFF) << 24) | (((cntr + 2) & 0xFF) << 16) | (((cntr + 1) & 0xFF) << 8) |
+                  (((cntr + 0) & 0xFF) << 0));
+      }
+    }
+  }
+}
+
+} // namespace
+
+EmuImage
+generate_emu_image(const EmuPatternConfig& config)
+{
+  EmuImage image;
+  image.config = config;
+  const std::size_t emusize = config.emu_size;
+  const uint32_t req_chunksize = config.chunk_size; // NOLINT(build/unsigned)
+  image.data.assign(emusize, fm_kchar_idle);
+  uint64_t* emudata = image.data.data(); // NOLINT(build/unsigned)
+
+  // Determine the number of chunks that will fit
+  // (chunk size includes 8-byte header): 2 IDLEs, SOP, chunk, EOP
+  const std::size_t max_chunkcnt = (emusize - 2) / (1 + req_chunksize / 4 + 1 + config.idle_chars);
+  std::size_t index = 2; // starts with two IDLE symbols
+  std::size_t chunkcntr = 0;
+
+  // Sizes between req_chunksize/2 and req_chunksize, rounded up to a multiple of 4 bytes
+  std::minstd_rand rng(config.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  while (index < emusize && chunkcntr < max_chunkcnt) {
+    uint32_t chunksz = req_chunksize; // NOLINT(build/unsigned)
+    if (config.random_size && req_chunksize > 8) {
+      uint32_t sz = (req_chunksize + 1) / 2; // NOLINT(build/unsigned)
+      double d = 0.5 * static_cast<double>(1 - (req_chunksize & 1));
+      chunksz = ((sz + static_cast<uint32_t>(static_cast<double>(sz) * uniform(rng) + d) + 3) / 4) * 4; // NOLINT
+    }
+
+    // Check if the next chunk will fit (chunksz includes header); if not,
+    // the rest stays IDLE and the image is incomplete
+    if (index + (1 + chunksz / 4 + 1) >= emusize) {
+      break;
+    }
+
+    // SOP
+    emudata[index++] = fm_kchar_sop;
+    if (config.omit_one_soc && chunkcntr == 2) {
+      --index; // For testing
+    }
+
+    // Chunk header
+    const std::size_t chunk_start = index;
+    const uint32_t chunk_datasz = chunksz - chunk_header_size; // NOLINT(build/unsigned)
+    const uint64_t stream_id = config.use_streamid ? (chunkcntr & 0xFF) : 0xAA; // NOLINT(build/unsigned)
+    emudata[index++] =
+      (stream_id | (chunk_datasz & 0xF00) | ((chunk_datasz & 0x0FF) << 16) | ((chunkcntr & 0xFF) << 24));
+    emudata[index++] = 0x10AABB00; // ewidth=0x10=16 bits
+
+    // Chunk data according to pattern_id
+    fill_chunk_data(&emudata[index], chunk_datasz / 4, config.pattern_id);
+    index += chunk_datasz / 4;
+
+    // EOP (+ 20-bits CRC)
+    uint64_t crc = crc::crc20(&emudata[chunk_start], chunksz / 4, config.crc_new); // NOLINT(build/unsigned)
+    if (config.add_crc_err && chunkcntr == 3) {
+      ++crc; // For testing
+    }
+    emudata[index++] = fm_kchar_eop | (crc << 8);
+    if (config.omit_one_eoc && chunkcntr == 2) {
+      --index; // For testing
+    }
+
+    // A configurable number of comma symbols in between chunks, optionally framed as busy
+    const bool busy = config.add_busy && chunkcntr == 0;
+    std::size_t n_idles = std::min<std::size_t>(config.idle_chars + (busy ? 2 : 0), emusize - index);
+    std::fill_n(&emudata[index], n_idles, fm_kchar_idle);
+    if (busy && n_idles >= 2) {
+      emudata[index] = fm_kchar_sob;
+      emudata[index + n_idles - 1] = fm_kchar_eob;
+    }
+    index += n_idles;
+
+    ++chunkcntr;
+  }
+
+  image.chunks = chunkcntr;
+  image.complete = chunkcntr == max_chunkcnt;
+  return image;
+}
+
+std::vector<EmuImage>
+generate_emu_images(const std::vector<EmuPatternConfig>& configs, unsigned n_threads)
+{
+  std::vector<EmuImage> images(configs.size());
+  if (n_threads == 0) {
+    n_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  n_threads = std::min<unsigned>(n_threads, configs.size());
+
+  // Workers take the next configuration until all are done
+  std::atomic<std::size_t> next{ 0 };
+  auto worker = [&]() {
+    for (std::size_t i = next++; i < configs.size(); i = next++) {
+      images[i] = generate_emu_image(configs[i]);
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (unsigned t = 1; t < n_threads; ++t) {
+    workers.emplace_back(std::async(std::launch::async, worker));
+  }
+  worker();
+  for (auto& w : workers) {
+    w.get();
+  }
+  return images;
+}
+
+std::vector<std::vector<char>>
+emu_image_chunks(const EmuImage& image)
+{
+  constexpr uint64_t kchar_flag = uint64_t{ 1 } << 32; // NOLINT(build/unsigned)
+  std::vector<std::vector<char>> chunks;
+  const std::vector<uint64_t>& emudata = image.data; // NOLINT(build/unsigned)
+  std::size_t chunk_start = 0;
+  bool in_chunk = false;
+  for (std::size_t index = 0; index < emudata.size(); ++index) {
+    const uint64_t word = emudata[index]; // NOLINT(build/unsigned)
+    if (!(word & kchar_flag)) {
+      continue; // chunk data, taken at the EOP
+    }
+    if ((word & 0xFF) == (fm_kchar_sop & 0xFF)) {
+      chunk_start = index + 1;
+      in_chunk = true;
+    } else if ((word & 0xFF) == (fm_kchar_eop & 0xFF) && in_chunk && index > chunk_start) {
+      const std::size_t n_words = index - chunk_start;
+      const uint32_t crc = (word >> 8) & crc::crc20_mask; // NOLINT(build/unsigned)
+      if (crc::crc20(&emudata[chunk_start], n_words, image.config.crc_new) == crc) {
+        std::vector<char> chunk(n_words * sizeof(uint32_t)); // NOLINT(build/unsigned)
+        for (std::size_t i = 0; i < n_words; ++i) {
+          const auto data = static_cast<uint32_t>(emudata[chunk_start + i]); // NOLINT(build/unsigned)
+          std::memcpy(chunk.data() + i * sizeof(data), &data, sizeof(data));
+        }
+        chunks.push_back(std::move(chunk));
+      }
+      in_chunk = false;
+    } else {
+      in_chunk = false; // any other K-character ends the chunk without an EOP
+    }
+  }
+  return chunks;
+}
+
+void
+write_flx_config(std::ostream& out, const EmuImage& image)
+{
+  out << std::hex;
+  for (std::size_t i = 0; i < image.data.size(); ++i) {
+    out << "FE_EMU_CONFIG_WRADDR=0x" << i << '\n'
+        << "FE_EMU_CONFIG_WRDATA=0x" << image.data[i] << '\n'
+        << "FE_EMU_CONFIG_WE=1\n"
+        << "FE_EMU_CONFIG_WE=0\n";
+  }
+  out << std::dec;
+}
+
+} // namespace emu
+} // namespace flxlibs
+} // namespace dunedaq
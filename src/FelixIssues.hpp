@@ -22,6 +22,10 @@ ERS_DECLARE_ISSUE(flxlibs, ConfigurationError, " FELIX Configuration Error: " <<
 
 ERS_DECLARE_ISSUE(flxlibs, QueueTimeoutError, " FELIX queue timed out: " << queuename, ((std::string)queuename))
 
+ERS_DECLARE_ISSUE(flxlibs, UnknownRegister, " Register or bitfield not in the regmap: " << name, ((std::string)name))
+
+ERS_DECLARE_ISSUE(flxlibs, ReadOnlyRegister, " Register or bitfield is not writable: " << name, ((std::string)name))
+
 ERS_DECLARE_ISSUE(flxlibs, ChannelAlignment, " Channel not aligned: " << channel, ((int)channel)) // NOLINT
 
 ERS_DECLARE_ISSUE(flxlibs, UnexpectedChunk, " Unexpected chunk size: " << chunksize << " (observed) != " << expected << " (expected)",
@@ -32,6 +36,24 @@ ERS_DECLARE_ISSUE(flxlibs,
                   " ParserOps couldn't push to queue! Failed chunk: " << chunk,
                   ((std::string)chunk))
 
+ERS_DECLARE_ISSUE(flxlibs,
+                  ParserOperationSinkDrops,
+                  " " << elink << " dropped " << payloads << " payloads (" << bytes
+                      << " bytes) on a full sink since the last report",
+                  ((std::string)elink)((uint64_t)payloads)((uint64_t)bytes)) // NOLINT(build/unsigned)
+
+ERS_DECLARE_ISSUE(flxlibs,
+                  BlocksNotRouted,
+                  " Card " << card << ": " << unknown_elink << " blocks of unknown elinks and " << queue_full
+                           << " blocks on full elink queues dropped since the last report",
+                  ((std::string)card)((uint64_t)unknown_elink)((uint64_t)queue_full)) // NOLINT(build/unsigned)
+
+ERS_DECLARE_ISSUE(flxlibs, BlockRecordingError, " Block recording: " << msg, ((std::string)msg))
+
+ERS_DECLARE_ISSUE(flxlibs, BlockReplayError, " Block replay: " << msg, ((std::string)msg))
+
+ERS_DECLARE_ISSUE(flxlibs, RingExportError, " Ring export " << name << ": " << msg, ((std::string)name)((std::string)msg))
+
 ERS_DECLARE_ISSUE(flxlibs,
                   ElinkConfigurationInconsistency,
                   " Inconsistent number of ELinks requested. Num links: " << num_links,
@@ -8,28 +8,296 @@
 #ifndef FLXLIBS_SRC_FELIXSTATISTICS_HPP_
 #define FLXLIBS_SRC_FELIXSTATISTICS_HPP_
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
 
 namespace dunedaq::flxlibs::stats {
 
-using counter_t = std::atomic<uint64_t>; // NOLINT(build/unsigned)
+/**
+ * @brief Counter written by a single thread and never reset.
+ *
+ * An increment is a relaxed load and store, with no locked read-modify-write,
+ * so the writer never contends with readers. Readers take deltas between
+ * snapshots instead of resetting the counter.
+ */
+class MonotonicCounter
+{
+public:
+  using value_t = uint64_t; // NOLINT(build/unsigned)
+
+  void operator++(int) { add(1); }
+  MonotonicCounter& operator+=(value_t n)
+  {
+    add(n);
+    return *this;
+  }
+  value_t load(std::memory_order order = std::memory_order_relaxed) const { return m_value.load(order); }
+  void store(value_t value, std::memory_order order = std::memory_order_relaxed) { m_value.store(value, order); }
+
+private:
+  void add(value_t n) { m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+  std::atomic<value_t> m_value{ 0 };
+};
+
+// Chunk length histogram: log2 of the length, two octaves per bin.
+// Bin 0 is below 64B, bin 8 is 1MB and above.
+constexpr std::size_t chunk_length_bins = 9;
+
+inline std::size_t
+chunk_length_bin(uint64_t length) // NOLINT(build/unsigned)
+{
+  if (length < 64) {
+    return 0;
+  }
+  std::size_t log2 = 63 - __builtin_clzll(length);
+  std::size_t bin = (log2 - 6) / 2 + 1;
+  return bin < chunk_length_bins ? bin : chunk_length_bins - 1;
+}
 
+struct ParserStatsSnapshot;
+
+/**
+ * @brief Parser counters of one elink. Only the elink's parser thread writes
+ * them, when it publishes its ParserLocalStats between begin_update() and
+ * end_update(). Other threads read them through snapshot().
+ */
 struct ParserStats
 {
-  counter_t packet_ctr{ 0 };
-  counter_t short_ctr{ 0 };
-  counter_t chunk_ctr{ 0 };
-  counter_t subchunk_ctr{ 0 };
-  counter_t block_ctr{ 0 };
-  counter_t error_short_ctr{ 0 };
-  counter_t error_chunk_ctr{ 0 };
-  counter_t error_subchunk_ctr{ 0 };
-  counter_t error_block_ctr{ 0 };
-  counter_t subchunk_crc_error_ctr{ 0 };
-  counter_t subchunk_trunc_error_ctr{ 0 };
-  counter_t subchunk_error_ctr{ 0 };
+  MonotonicCounter packet_ctr;
+  MonotonicCounter short_ctr;
+  MonotonicCounter chunk_ctr;
+  MonotonicCounter subchunk_ctr;
+  MonotonicCounter block_ctr;
+  MonotonicCounter error_short_ctr;
+  MonotonicCounter error_chunk_ctr;
+  MonotonicCounter error_subchunk_ctr;
+  MonotonicCounter error_block_ctr;
+  MonotonicCounter bad_header_ctr; // blocks not parsed: unexpected start of block marker
+  MonotonicCounter subchunk_crc_error_ctr;
+  MonotonicCounter subchunk_trunc_error_ctr;
+  MonotonicCounter subchunk_error_ctr;
+  MonotonicCounter dropped_payload_ctr;
+  MonotonicCounter dropped_bytes_ctr;
+  MonotonicCounter send_retry_ctr;
+  MonotonicCounter timestamp_discontinuity_ctr;
+  MonotonicCounter timestamp_frozen_ctr;
+  MonotonicCounter first_timestamp; // first superchunk timestamp seen by this elink
+  MonotonicCounter last_timestamp;  // most recent superchunk timestamp
+  MonotonicCounter error_capture_ctr;
+  MonotonicCounter error_capture_skipped_ctr;
+  MonotonicCounter coalesced_payload_ctr;
+  MonotonicCounter chunk_bytes_ctr;
+  MonotonicCounter short_bytes_ctr;
+  std::array<MonotonicCounter, chunk_length_bins> chunk_length_hist;
+
+  // Sequence lock: the sequence number is odd while the parser thread updates counters
+  void begin_update()
+  {
+    m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void end_update() { m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // All counters as of a single instant between two updates. After max_snapshot_attempts
+  // torn reads, the counters as read by the last attempt, marked as not consistent.
+  ParserStatsSnapshot snapshot() const;
+  static constexpr unsigned max_snapshot_attempts = 1000;
+
+private:
+  std::atomic<uint64_t> m_seq{ 0 }; // NOLINT(build/unsigned)
 };
 
+struct ParserStatsSnapshot
+{
+  using value_t = MonotonicCounter::value_t;
+
+  std::chrono::steady_clock::time_point taken{ std::chrono::steady_clock::now() };
+  bool consistent{ true }; // all counters are from the same instant
+  value_t packet_ctr{ 0 };
+  value_t short_ctr{ 0 };
+  value_t chunk_ctr{ 0 };
+  value_t subchunk_ctr{ 0 };
+  value_t block_ctr{ 0 };
+  value_t error_short_ctr{ 0 };
+  value_t error_chunk_ctr{ 0 };
+  value_t error_subchunk_ctr{ 0 };
+  value_t error_block_ctr{ 0 };
+  value_t bad_header_ctr{ 0 };
+  value_t subchunk_crc_error_ctr{ 0 };
+  value_t subchunk_trunc_error_ctr{ 0 };
+  value_t subchunk_error_ctr{ 0 };
+  value_t dropped_payload_ctr{ 0 };
+  value_t dropped_bytes_ctr{ 0 };
+  value_t send_retry_ctr{ 0 };
+  value_t timestamp_discontinuity_ctr{ 0 };
+  value_t timestamp_frozen_ctr{ 0 };
+  value_t first_timestamp{ 0 };
+  value_t last_timestamp{ 0 };
+  value_t error_capture_ctr{ 0 };
+  value_t error_capture_skipped_ctr{ 0 };
+  value_t coalesced_payload_ctr{ 0 };
+  value_t chunk_bytes_ctr{ 0 };
+  value_t short_bytes_ctr{ 0 };
+  std::array<value_t, chunk_length_bins> chunk_length_hist{};
+};
+
+inline ParserStatsSnapshot
+ParserStats::snapshot() const
+{
+  ParserStatsSnapshot snap;
+  for (unsigned attempt = 1;; ++attempt) {
+    uint64_t seq = m_seq.load(std::memory_order_acquire); // NOLINT(build/unsigned)
+    if ((seq & 1) && attempt < max_snapshot_attempts) {
+      std::this_thread::yield(); // the parser is publishing a block's counters
+      continue;
+    }
+    snap.taken = std::chrono::steady_clock::now();
+    snap.packet_ctr = packet_ctr.load();
+    snap.short_ctr = short_ctr.load();
+    snap.chunk_ctr = chunk_ctr.load();
+    snap.subchunk_ctr = subchunk_ctr.load();
+    snap.block_ctr = block_ctr.load();
+    snap.error_short_ctr = error_short_ctr.load();
+    snap.error_chunk_ctr = error_chunk_ctr.load();
+    snap.error_subchunk_ctr = error_subchunk_ctr.load();
+    snap.error_block_ctr = error_block_ctr.load();
+    snap.bad_header_ctr = bad_header_ctr.load();
+    snap.subchunk_crc_error_ctr = subchunk_crc_error_ctr.load();
+    snap.subchunk_trunc_error_ctr = subchunk_trunc_error_ctr.load();
+    snap.subchunk_error_ctr = subchunk_error_ctr.load();
+    snap.dropped_payload_ctr = dropped_payload_ctr.load();
+    snap.dropped_bytes_ctr = dropped_bytes_ctr.load();
+    snap.send_retry_ctr = send_retry_ctr.load();
+    snap.timestamp_discontinuity_ctr = timestamp_discontinuity_ctr.load();
+    snap.timestamp_frozen_ctr = timestamp_frozen_ctr.load();
+    snap.first_timestamp = first_timestamp.load();
+    snap.last_timestamp = last_timestamp.load();
+    snap.error_capture_ctr = error_capture_ctr.load();
+    snap.error_capture_skipped_ctr = error_capture_skipped_ctr.load();
+    snap.coalesced_payload_ctr = coalesced_payload_ctr.load();
+    snap.chunk_bytes_ctr = chunk_bytes_ctr.load();
+    snap.short_bytes_ctr = short_bytes_ctr.load();
+    for (std::size_t i = 0; i < chunk_length_bins; ++i) {
+      snap.chunk_length_hist[i] = chunk_length_hist[i].load();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_seq.load(std::memory_order_relaxed) == seq && !(seq & 1)) {
+      return snap;
+    }
+    if (attempt >= max_snapshot_attempts) {
+      snap.consistent = false; // each counter is still a value it had, only not all at the same instant
+      return snap;
+    }
+  }
+}
+
+/**
+ * @brief Parser counters of one elink as the parser operations count them:
+ * plain integers of the parser thread, published into ParserStats with
+ * DefaultParserImpl::flush_local_stats() once per block.
+ */
+struct ParserLocalStats
+{
+  using value_t = MonotonicCounter::value_t;
+
+  value_t packet_ctr{ 0 };
+  value_t short_ctr{ 0 };
+  value_t chunk_ctr{ 0 };
+  value_t subchunk_ctr{ 0 };
+  value_t block_ctr{ 0 };
+  value_t error_short_ctr{ 0 };
+  value_t error_chunk_ctr{ 0 };
+  value_t error_subchunk_ctr{ 0 };
+  value_t error_block_ctr{ 0 };
+  value_t bad_header_ctr{ 0 };
+  value_t subchunk_crc_error_ctr{ 0 };
+  value_t subchunk_trunc_error_ctr{ 0 };
+  value_t subchunk_error_ctr{ 0 };
+  value_t dropped_payload_ctr{ 0 };
+  value_t dropped_bytes_ctr{ 0 };
+  value_t send_retry_ctr{ 0 };
+  value_t timestamp_discontinuity_ctr{ 0 };
+  value_t timestamp_frozen_ctr{ 0 };
+  value_t first_timestamp{ 0 }; // first superchunk timestamp since the last flush, 0 if none
+  value_t last_timestamp{ 0 };  // most recent superchunk timestamp, 0 if none since the last flush
+  value_t error_capture_ctr{ 0 };
+  value_t error_capture_skipped_ctr{ 0 };
+  value_t coalesced_payload_ctr{ 0 };
+  value_t chunk_bytes_ctr{ 0 };
+  value_t short_bytes_ctr{ 0 };
+  std::array<value_t, chunk_length_bins> chunk_length_hist{};
+};
+
+struct DMAStatsSnapshot;
+
+/**
+ * @brief DMA counters of one CardWrapper. Only its DMA processor writes them;
+ * readers take deltas between snapshots.
+ */
+struct DMAStats
+{
+  MonotonicCounter bytes_ctr;
+  MonotonicCounter block_ctr;
+  MonotonicCounter poll_ctr;      // sleeps of poll_time while waiting for data
+  MonotonicCounter irq_wait_ctr;  // irq_wait calls while waiting for data
+  MonotonicCounter batch_ctr;     // passes over the ring that handed out at least one block
+  MonotonicCounter set_ptr_ctr;   // dma_set_ptr calls
+  MonotonicCounter wait_ns;         // waiting for the block threshold (poll or IRQ)
+  MonotonicCounter read_address_ns; // reading the card's current write address
+  MonotonicCounter dispatch_ns;     // handing block addresses to the block handler
+  MonotonicCounter set_ptr_ns;      // moving the card's read pointer
+
+  // Levels rather than counts
+  MonotonicCounter occupancy_bytes;     // unread bytes in the ring at the last pass
+  MonotonicCounter max_occupancy_bytes; // highest occupancy since the current interval started
+  MonotonicCounter interval;            // bumped by the reader to start a new interval
+
+  DMAStatsSnapshot snapshot() const;
+};
+
+struct DMAStatsSnapshot
+{
+  using value_t = MonotonicCounter::value_t;
+
+  std::chrono::steady_clock::time_point taken{ std::chrono::steady_clock::now() };
+  value_t bytes_ctr{ 0 };
+  value_t block_ctr{ 0 };
+  value_t poll_ctr{ 0 };
+  value_t irq_wait_ctr{ 0 };
+  value_t batch_ctr{ 0 };
+  value_t set_ptr_ctr{ 0 };
+  value_t wait_ns{ 0 };
+  value_t read_address_ns{ 0 };
+  value_t dispatch_ns{ 0 };
+  value_t set_ptr_ns{ 0 };
+  value_t occupancy_bytes{ 0 };
+  value_t max_occupancy_bytes{ 0 };
+};
+
+inline DMAStatsSnapshot
+DMAStats::snapshot() const
+{
+  DMAStatsSnapshot snap;
+  snap.bytes_ctr = bytes_ctr.load();
+  snap.block_ctr = block_ctr.load();
+  snap.poll_ctr = poll_ctr.load();
+  snap.irq_wait_ctr = irq_wait_ctr.load();
+  snap.batch_ctr = batch_ctr.load();
+  snap.set_ptr_ctr = set_ptr_ctr.load();
+  snap.wait_ns = wait_ns.load();
+  snap.read_address_ns = read_address_ns.load();
+  snap.dispatch_ns = dispatch_ns.load();
+  snap.set_ptr_ns = set_ptr_ns.load();
+  snap.occupancy_bytes = occupancy_bytes.load();
+  snap.max_occupancy_bytes = max_occupancy_bytes.load();
+  return snap;
+}
+
 } // namespace dunedaq::flxlibs::stats
 
 #endif // FLXLIBS_SRC_FELIXSTATISTICS_HPP_
@@ -0,0 +1,107 @@
+/**
+ * @file FlxCardInterface.cpp CardInterface implementation on top of FlxCard
+ * and the CMEM driver.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "CardInterface.hpp"
+
+#include "cmem_rcc/cmem_rcc.h"
+#include "flxcard/FlxCard.h"
+
+// From STD
+#include <memory>
+#include <string>
+
+namespace dunedaq {
+namespace flxlibs {
+
+namespace {
+
+class FlxCardInterface : public CardInterface
+{
+public:
+  FlxCardInterface()
+    : m_flx_card(std::make_unique<FlxCard>())
+  {}
+
+  void card_open(int device, unsigned lock_mask) override { m_flx_card->card_open(device, lock_mask); }
+  void card_close() override { m_flx_card->card_close(); }
+  unsigned get_lock_mask(int device) override { return m_flx_card->get_lock_mask(device); }
+  void soft_reset() override { m_flx_card->soft_reset(); }
+
+  uint64_t register_base() override { return m_flx_card->openBackDoor(2); } // NOLINT(build/unsigned)
+
+  int gbt_setup(int alignment, int mode) override { return m_flx_card->gbt_setup(alignment, mode); }
+  void gth_rx_reset(int quad) override { m_flx_card->gth_rx_reset(quad); }
+
+  void irq_enable(unsigned irq) override { m_flx_card->irq_enable(irq); }
+  void irq_disable(unsigned irq) override { m_flx_card->irq_disable(irq); }
+  void irq_wait(unsigned irq) override { m_flx_card->irq_wait(irq); }
+  void irq_reset_counters() override { m_flx_card->irq_reset_counters(); }
+
+  void dma_reset() override { m_flx_card->dma_reset(); }
+  void dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t size, unsigned flags) override // NOLINT
+  {
+    m_flx_card->dma_to_host(dma_id, phys_addr, size, flags);
+  }
+  void dma_stop(unsigned dma_id) override { m_flx_card->dma_stop(dma_id); }
+  void dma_set_ptr(unsigned dma_id, uint64_t phys_addr) override { m_flx_card->dma_set_ptr(dma_id, phys_addr); } // NOLINT
+  uint64_t dma_current_address(unsigned dma_id) override // NOLINT(build/unsigned)
+  {
+    return m_flx_card->m_bar0->DMA_DESC_STATUS[dma_id].current_address;
+  }
+
+  bool allocate_dma_buffer(uint8_t numa, // NOLINT(build/unsigned)
+                           std::size_t size,
+                           const std::string& name,
+                           int& handle,
+                           uint64_t& phys_addr, // NOLINT(build/unsigned)
+                           uint64_t& virt_addr) override // NOLINT(build/unsigned)
+  {
+    u_long paddr = 0; // NOLINT(runtime/int)
+    u_long vaddr = 0; // NOLINT(runtime/int)
+    unsigned ret = CMEM_Open(); // cmem_rcc.h
+    if (!ret) {
+      ret = CMEM_NumaSegmentAllocate(size, numa, const_cast<char*>(name.c_str()), &handle); // NUMA aware
+      // ret = CMEM_GFPBPASegmentAllocate(size, const_cast<char*>(name.c_str()), &handle); // non NUMA aware
+    }
+    if (!ret) {
+      ret = CMEM_SegmentPhysicalAddress(handle, &paddr);
+    }
+    if (!ret) {
+      ret = CMEM_SegmentVirtualAddress(handle, &vaddr);
+    }
+    phys_addr = paddr;
+    virt_addr = vaddr;
+    return ret == 0;
+  }
+
+  std::string dma_buffer_file(int handle, uint64_t& offset) override // NOLINT(build/unsigned)
+  {
+    // The driver maps segments by their physical address, as CMEM_SegmentVirtualAddress does
+    u_long paddr = 0; // NOLINT(runtime/int)
+    if (CMEM_SegmentPhysicalAddress(handle, &paddr) != 0) {
+      return "";
+    }
+    offset = paddr;
+    return "/dev/cmem_rcc";
+  }
+
+private:
+  std::unique_ptr<FlxCard> m_flx_card;
+};
+
+} // namespace
+
+std::unique_ptr<CardInterface>
+make_flx_card()
+{
+  return std::make_unique<FlxCardInterface>();
+}
+
+} // namespace flxlibs
+} // namespace dunedaq
@@ -0,0 +1,204 @@
+/**
+ * @file MockCardInterface.cpp In-memory FELIX card implementation
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "MockCardInterface.hpp"
+#include "FelixIssues.hpp"
+
+#include "regmap/regmap.h"
+
+// From STD
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// From POSIX
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace dunedaq {
+namespace flxlibs {
+
+MockCardInterface::MockCardInterface()
+{
+  // Large enough for every register and bitfield of the regmap in use
+  uint64_t max_address = 0; // NOLINT(build/unsigned)
+  for (const regmap_register_t* reg = regmap_registers; reg->name != nullptr; ++reg) {
+    max_address = std::max<uint64_t>(max_address, reg->address); // NOLINT(build/unsigned)
+  }
+  for (const regmap_bitfield_t* bf = regmap_bitfields; bf->name != nullptr; ++bf) {
+    max_address = std::max<uint64_t>(max_address, bf->address); // NOLINT(build/unsigned)
+  }
+  m_register_file.assign(max_address / sizeof(uint64_t) + 1, 0); // NOLINT(build/unsigned)
+}
+
+MockCardInterface::~MockCardInterface()
+{
+  for (auto& [handle, buffer] : m_buffers) {
+    munmap(buffer.data, buffer.size);
+    if (buffer.fd >= 0) {
+      close(buffer.fd);
+    }
+  }
+}
+
+void
+MockCardInterface::card_open(int /*device*/, unsigned lock_mask)
+{
+  if (m_lock_mask & lock_mask) {
+    throw flxlibs::CardError(ERS_HERE, "Mock card is already locked");
+  }
+  m_lock_mask |= lock_mask;
+  m_open = true;
+}
+
+void
+MockCardInterface::card_close()
+{
+  m_lock_mask = 0;
+  m_open = false;
+}
+
+unsigned
+MockCardInterface::get_lock_mask(int /*device*/)
+{
+  return m_lock_mask;
+}
+
+uint64_t // NOLINT(build/unsigned)
+MockCardInterface::register_base()
+{
+  return reinterpret_cast<uint64_t>(m_register_file.data()); // NOLINT
+}
+
+void
+MockCardInterface::irq_wait(unsigned /*irq*/)
+{
+  std::unique_lock<std::mutex> lock(m_irq_mutex);
+  m_irq_cv.wait_for(lock, std::chrono::milliseconds(1));
+}
+
+void
+MockCardInterface::dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t /*size*/, unsigned /*flags*/) // NOLINT
+{
+  m_current_address[dma_id % m_max_dma] = phys_addr;
+  m_read_pointer[dma_id % m_max_dma] = phys_addr;
+}
+
+void
+MockCardInterface::dma_stop(unsigned /*dma_id*/)
+{}
+
+void
+MockCardInterface::dma_set_ptr(unsigned dma_id, uint64_t phys_addr) // NOLINT(build/unsigned)
+{
+  m_read_pointer[dma_id % m_max_dma] = phys_addr;
+}
+
+uint64_t // NOLINT(build/unsigned)
+MockCardInterface::dma_current_address(unsigned dma_id)
+{
+  return m_current_address[dma_id % m_max_dma];
+}
+
+bool
+MockCardInterface::allocate_dma_buffer(uint8_t /*numa*/, // NOLINT(build/unsigned)
+                                       std::size_t size,
+                                       const std::string& name,
+                                       int& handle,
+                                       uint64_t& phys_addr, // NOLINT(build/unsigned)
+                                       uint64_t& virt_addr) // NOLINT(build/unsigned)
+{
+  // Page aligned like CMEM buffers, which O_DIRECT block recording relies on; zero filled
+  Buffer buffer;
+  buffer.size = size;
+  buffer.fd = memfd_create(("flxlibs-dma-" + name).c_str(), MFD_CLOEXEC);
+  if (buffer.fd >= 0 && ftruncate(buffer.fd, static_cast<off_t>(size)) == 0) {
+    buffer.data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd, 0);
+  } else {
+    if (buffer.fd >= 0) {
+      close(buffer.fd);
+      buffer.fd = -1;
+    }
+    buffer.data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (buffer.data == MAP_FAILED) {
+    if (buffer.fd >= 0) {
+      close(buffer.fd);
+    }
+    return false;
+  }
+  handle = static_cast<int>(m_buffers.size());
+  phys_addr = reinterpret_cast<uint64_t>(buffer.data); // NOLINT
+  virt_addr = phys_addr;
+  m_buffers.emplace(handle, buffer);
+  return true;
+}
+
+std::string
+MockCardInterface::dma_buffer_file(int handle, uint64_t& offset) // NOLINT(build/unsigned)
+{
+  auto it = m_buffers.find(handle);
+  if (it == m_buffers.end() || it->second.fd < 0) {
+    return "";
+  }
+  offset = 0;
+  return "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(it->second.fd);
+}
+
+std::size_t
+MockCardInterface::register_offset(const std::string& reg_name) const
+{
+  for (const regmap_register_t* reg = regmap_registers; reg->name != nullptr; ++reg) {
+    if (reg_name == reg->name) {
+      return reg->address / sizeof(uint64_t); // NOLINT(build/unsigned)
+    }
+  }
+  throw flxlibs::UnknownRegister(ERS_HERE, reg_name);
+}
+
+void
+MockCardInterface::poke(const std::string& reg_name, uint64_t value) // NOLINT(build/unsigned)
+{
+  m_register_file[register_offset(reg_name)] = value;
+}
+
+uint64_t // NOLINT(build/unsigned)
+MockCardInterface::peek(const std::string& reg_name) const
+{
+  return m_register_file[register_offset(reg_name)];
+}
+
+uint64_t // NOLINT(build/unsigned)
+MockCardInterface::peek_bitfield(const std::string& bf_name) const
+{
+  for (const regmap_bitfield_t* bf = regmap_bitfields; bf->name != nullptr; ++bf) {
+    if (bf_name == bf->name) {
+      return (m_register_file[bf->address / sizeof(uint64_t)] & bf->mask) >> bf->shift; // NOLINT(build/unsigned)
+    }
+  }
+  throw flxlibs::UnknownRegister(ERS_HERE, bf_name);
+}
+
+void
+MockCardInterface::set_dma_current_address(unsigned dma_id, uint64_t phys_addr) // NOLINT(build/unsigned)
+{
+  m_current_address[dma_id % m_max_dma] = phys_addr;
+  std::lock_guard<std::mutex> lock(m_irq_mutex);
+  m_irq_cv.notify_all();
+}
+
+uint64_t // NOLINT(build/unsigned)
+MockCardInterface::get_dma_read_pointer(unsigned dma_id) const
+{
+  return m_read_pointer[dma_id % m_max_dma];
+}
+
+} // namespace flxlibs
+} // namespace dunedaq
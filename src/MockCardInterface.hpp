@@ -0,0 +1,112 @@
+/**
+ * @file MockCardInterface.hpp In-memory FELIX card for running the card
+ * wrappers without hardware.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_MOCKCARDINTERFACE_HPP_
+#define FLXLIBS_SRC_MOCKCARDINTERFACE_HPP_
+
+#include "CardInterface.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Register file sized from the regmap tables, plus DMA buffers in
+ * memory files (physical address == virtual address), which other
+ * processes can map through /proc like a CMEM segment.
+ *
+ * Registers are read and written through register_base() exactly as on the
+ * card, so the register handle cache of CardControllerWrapper runs
+ * unchanged. Tests drive the card side through poke() and
+ * set_dma_current_address(); irq_wait() returns once the current address
+ * moves, or after a millisecond.
+ */
+class MockCardInterface : public CardInterface
+{
+public:
+  MockCardInterface();
+  ~MockCardInterface();
+
+  void card_open(int device, unsigned lock_mask) override;
+  void card_close() override;
+  unsigned get_lock_mask(int device) override;
+  void soft_reset() override { m_soft_resets++; }
+
+  uint64_t register_base() override; // NOLINT(build/unsigned)
+
+  int gbt_setup(int /*alignment*/, int /*mode*/) override { return 0; }
+  void gth_rx_reset(int /*quad*/) override { m_gth_resets++; }
+
+  void irq_enable(unsigned /*irq*/) override {}
+  void irq_disable(unsigned /*irq*/) override {}
+  void irq_wait(unsigned irq) override;
+  void irq_reset_counters() override {}
+
+  void dma_reset() override {}
+  void dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t size, unsigned flags) override; // NOLINT
+  void dma_stop(unsigned dma_id) override;
+  void dma_set_ptr(unsigned dma_id, uint64_t phys_addr) override; // NOLINT(build/unsigned)
+  uint64_t dma_current_address(unsigned dma_id) override;         // NOLINT(build/unsigned)
+
+  bool allocate_dma_buffer(uint8_t numa, // NOLINT(build/unsigned)
+                           std::size_t size,
+                           const std::string& name,
+                           int& handle,
+                           uint64_t& phys_addr, // NOLINT(build/unsigned)
+                           uint64_t& virt_addr) override; // NOLINT(build/unsigned)
+  std::string dma_buffer_file(int handle, uint64_t& offset) override; // NOLINT(build/unsigned)
+
+  // Test side: register file access by regmap register name
+  void poke(const std::string& reg_name, uint64_t value); // NOLINT(build/unsigned)
+  uint64_t peek(const std::string& reg_name) const;       // NOLINT(build/unsigned)
+  uint64_t peek_bitfield(const std::string& bf_name) const; // NOLINT(build/unsigned)
+
+  // Test side: the card's DMA write position, and the host's read pointer
+  void set_dma_current_address(unsigned dma_id, uint64_t phys_addr); // NOLINT(build/unsigned)
+  uint64_t get_dma_read_pointer(unsigned dma_id) const;             // NOLINT(build/unsigned)
+
+  bool is_open() const { return m_open; }
+  unsigned soft_resets() const { return m_soft_resets; }
+  unsigned gth_resets() const { return m_gth_resets; }
+
+private:
+  static constexpr unsigned m_max_dma = 8;
+
+  std::size_t register_offset(const std::string& reg_name) const;
+
+  std::vector<uint64_t> m_register_file; // NOLINT(build/unsigned)
+  bool m_open{ false };
+  unsigned m_lock_mask{ 0 };
+  std::atomic<unsigned> m_soft_resets{ 0 };
+  std::atomic<unsigned> m_gth_resets{ 0 };
+
+  // DMA
+  struct Buffer
+  {
+    int fd{ -1 }; // memory file, if there is one
+    void* data{ nullptr };
+    std::size_t size{ 0 };
+  };
+  std::map<int, Buffer> m_buffers;
+  std::atomic<uint64_t> m_current_address[m_max_dma] = {}; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_read_pointer[m_max_dma] = {};     // NOLINT(build/unsigned)
+  mutable std::mutex m_irq_mutex;
+  std::condition_variable m_irq_cv;
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_MOCKCARDINTERFACE_HPP_
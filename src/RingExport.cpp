@@ -0,0 +1,280 @@
+/**
+ * @file RingExport.cpp Shared memory export of the DMA ring
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "RingExport.hpp"
+#include "FelixIssues.hpp"
+
+// From STD
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// From POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dunedaq::flxlibs {
+
+namespace {
+
+constexpr std::size_t
+descriptors_offset()
+{
+  return (sizeof(RingExportHeader) + 63) / 64 * 64;
+}
+
+} // namespace
+
+RingExport::RingExport(std::string name)
+  : m_name(std::move(name))
+{}
+
+RingExport::~RingExport()
+{
+  unmap();
+}
+
+void
+RingExport::map(std::size_t ring_blocks)
+{
+  m_fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644); // NOLINT
+  if (m_fd < 0) {
+    throw RingExportError(ERS_HERE, m_name, std::string("shm_open failed: ") + std::strerror(errno));
+  }
+  m_mapping_size = descriptors_offset() + ring_blocks * sizeof(RingExportDescriptor);
+  // Truncate first, so a reader of a leftover object never sees stale contents
+  if (ftruncate(m_fd, 0) != 0 || ftruncate(m_fd, static_cast<off_t>(m_mapping_size)) != 0) {
+    int error = errno;
+    unmap();
+    throw RingExportError(ERS_HERE, m_name, std::string("ftruncate failed: ") + std::strerror(error));
+  }
+  m_mapping = mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_mapping == MAP_FAILED) {
+    int error = errno;
+    m_mapping = nullptr;
+    unmap();
+    throw RingExportError(ERS_HERE, m_name, std::string("mmap failed: ") + std::strerror(error));
+  }
+  m_header = new (m_mapping) RingExportHeader{};
+  m_descriptors = reinterpret_cast<RingExportDescriptor*>(static_cast<char*>(m_mapping) + descriptors_offset()); // NOLINT
+  for (std::size_t i = 0; i < ring_blocks; ++i) {
+    new (m_descriptors + i) RingExportDescriptor{};
+  }
+  m_ring_blocks = ring_blocks;
+}
+
+void
+RingExport::unmap()
+{
+  if (m_mapping != nullptr) {
+    munmap(m_mapping, m_mapping_size);
+    m_mapping = nullptr;
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    shm_unlink(m_name.c_str()); // readers keep their mapping
+    m_fd = -1;
+  }
+  m_header = nullptr;
+  m_descriptors = nullptr;
+}
+
+void
+RingExport::start(const char* ring,
+                  std::size_t ring_size,
+                  std::size_t block_size,
+                  const std::string& ring_file,
+                  uint64_t ring_offset) // NOLINT(build/unsigned)
+{
+  const std::size_t ring_blocks = ring_size / block_size;
+  if (m_header == nullptr || ring_blocks != m_ring_blocks) {
+    unmap();
+    map(ring_blocks);
+  }
+  m_ring = ring;
+  m_block_size = block_size;
+  m_published = 0;
+
+  // Readers check the magic before anything else, so it goes last
+  m_header->running.store(0, std::memory_order_relaxed);
+  m_header->version = RingExportHeader::version_value;
+  m_header->block_size = static_cast<uint32_t>(block_size); // NOLINT(build/unsigned)
+  m_header->ring_size = ring_blocks * block_size;
+  m_header->ring_blocks = ring_blocks;
+  m_header->ring_offset = ring_offset;
+  m_header->pid = getpid();
+  std::strncpy(m_header->ring_file, ring_file.c_str(), sizeof(m_header->ring_file) - 1);
+  m_header->published.store(0, std::memory_order_relaxed);
+  m_header->oldest_valid.store(0, std::memory_order_relaxed);
+  m_header->generation.fetch_add(1, std::memory_order_release);
+  m_header->running.store(1, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_header->magic = RingExportHeader::magic_value;
+}
+
+void
+RingExport::stop()
+{
+  if (m_header != nullptr) {
+    m_header->running.store(0, std::memory_order_release);
+  }
+}
+
+void
+RingExport::publish(unsigned from_index, unsigned to_index)
+{
+  for (unsigned slot = from_index; slot != to_index; slot = (slot + 1) % m_ring_blocks) {
+    RingExportDescriptor& descriptor = m_descriptors[slot];
+    std::memcpy(&descriptor.header, m_ring + slot * m_block_size, sizeof(descriptor.header));
+    descriptor.slot = slot;
+    descriptor.number.store(m_published++, std::memory_order_release);
+  }
+  m_header->published.store(m_published, std::memory_order_release);
+}
+
+void
+RingExport::release(uint64_t hold_bytes) // NOLINT(build/unsigned)
+{
+  // Before the card is told: a partly held block counts as given back
+  const uint64_t hold_blocks = hold_bytes / m_block_size; // NOLINT(build/unsigned)
+  if (m_published > hold_blocks) {
+    m_header->oldest_valid.store(m_published - hold_blocks, std::memory_order_release);
+  }
+}
+
+RingExportReader::RingExportReader(const std::string& name)
+  : m_name(name)
+{
+  int fd = shm_open(name.c_str(), O_RDONLY, 0); // NOLINT
+  if (fd < 0) {
+    throw RingExportError(ERS_HERE, name, std::string("shm_open failed: ") + std::strerror(errno));
+  }
+  struct stat st;
+  fstat(fd, &st);
+  m_mapping_size = static_cast<std::size_t>(st.st_size);
+  void* mapping = m_mapping_size >= descriptors_offset()
+                    ? mmap(nullptr, m_mapping_size, PROT_READ, MAP_SHARED, fd, 0)
+                    : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw RingExportError(ERS_HERE, name, "not an export, or the primary has not started yet");
+  }
+  m_mapping = mapping;
+  m_header = static_cast<const RingExportHeader*>(m_mapping);
+  m_descriptors = reinterpret_cast<const RingExportDescriptor*>(static_cast<const char*>(m_mapping) + // NOLINT
+                                                                descriptors_offset());
+  auto fail = [&](const std::string& msg) {
+    munmap(const_cast<void*>(m_mapping), m_mapping_size); // NOLINT
+    throw RingExportError(ERS_HERE, name, msg);
+  };
+  if (m_header->magic != RingExportHeader::magic_value) {
+    fail("not an export, or the primary has not started yet");
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (m_header->version != RingExportHeader::version_value) {
+    fail("export version " + std::to_string(m_header->version) + ", expected " +
+         std::to_string(RingExportHeader::version_value));
+  }
+  if (m_mapping_size < descriptors_offset() + m_header->ring_blocks * sizeof(RingExportDescriptor)) {
+    fail("shared memory object too small for its ring");
+  }
+  const std::string ring_file(m_header->ring_file, strnlen(m_header->ring_file, sizeof(m_header->ring_file)));
+  if (ring_file.empty()) {
+    fail("the ring of this primary can't be mapped from another process");
+  }
+
+  // The ring, read-only: the card's writes show through
+  fd = open(ring_file.c_str(), O_RDONLY); // NOLINT
+  if (fd < 0) {
+    fail(ring_file + ": " + std::strerror(errno));
+  }
+  m_ring_mapping_size = m_header->ring_size;
+  mapping = mmap(nullptr, m_ring_mapping_size, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(m_header->ring_offset));
+  int error = errno;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    fail(ring_file + ": mmap failed: " + std::strerror(error));
+  }
+  m_ring = static_cast<const char*>(mapping);
+}
+
+RingExportReader::~RingExportReader()
+{
+  munmap(const_cast<char*>(m_ring), m_ring_mapping_size); // NOLINT
+  munmap(const_cast<void*>(m_mapping), m_mapping_size);   // NOLINT
+}
+
+bool
+RingExportReader::next(Block& block)
+{
+  const uint64_t generation = m_header->generation.load(std::memory_order_acquire); // NOLINT(build/unsigned)
+  if (generation != m_generation) {
+    m_next = m_generation == 0 ? m_header->published.load(std::memory_order_acquire) : 0;
+    m_generation = generation;
+    m_stats.generations++;
+  }
+  const uint64_t published = m_header->published.load(std::memory_order_acquire); // NOLINT(build/unsigned)
+  while (m_next < published) {
+    const uint64_t oldest = m_header->oldest_valid.load(std::memory_order_acquire); // NOLINT(build/unsigned)
+    if (m_next < oldest) {
+      m_stats.lost_blocks += oldest - m_next;
+      m_next = oldest;
+      continue;
+    }
+    const RingExportDescriptor& descriptor = m_descriptors[m_next % m_header->ring_blocks];
+    if (descriptor.number.load(std::memory_order_acquire) != m_next) {
+      m_stats.lost_blocks++; // already reused by a later block
+      m_next++;
+      continue;
+    }
+    block.number = m_next;
+    block.generation = m_generation;
+    block.header = descriptor.header;
+    block.data = m_ring + (m_next % m_header->ring_blocks) * m_header->block_size;
+    m_next++;
+    m_stats.blocks++;
+    return true;
+  }
+  return false;
+}
+
+bool
+RingExportReader::still_valid(const Block& block)
+{
+  // Everything read from the block so far comes before the cursors are checked
+  std::atomic_thread_fence(std::memory_order_acquire);
+  bool valid = m_header->generation.load(std::memory_order_relaxed) == block.generation &&
+               m_header->oldest_valid.load(std::memory_order_relaxed) <= block.number;
+  if (!valid) {
+    m_stats.torn_blocks++;
+  }
+  return valid;
+}
+
+uint64_t // NOLINT(build/unsigned)
+RingExportReader::get_backlog() const
+{
+  if (m_header->generation.load(std::memory_order_acquire) != m_generation) {
+    return 0;
+  }
+  const uint64_t published = m_header->published.load(std::memory_order_acquire); // NOLINT(build/unsigned)
+  return published > m_next ? published - m_next : 0;
+}
+
+bool
+RingExportReader::primary_running() const
+{
+  return m_header->running.load(std::memory_order_acquire) != 0 &&
+         (kill(static_cast<pid_t>(m_header->pid), 0) == 0 || errno == EPERM);
+}
+
+} // namespace dunedaq::flxlibs
@@ -0,0 +1,184 @@
+/**
+ * @file RingExport.hpp Publishes the DMA ring of a CardWrapper to other
+ * processes: block descriptors and ring cursors in a POSIX shared memory
+ * object, next to where the ring itself can be mapped from.
+ *
+ * The shared memory object holds a RingExportHeader followed by one
+ * RingExportDescriptor per ring block. A secondary maps the object and the
+ * ring (the CMEM segment through /dev/cmem_rcc, or the memory file of a
+ * software card) read-only, and follows the stream zero-copy with
+ * RingExportReader. Nothing a secondary does is seen by the primary: it
+ * never waits for them, and a secondary that falls behind the card loses
+ * blocks.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_RINGEXPORT_HPP_
+#define FLXLIBS_SRC_RINGEXPORT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Start of the shared memory object. Blocks are numbered in DMA order
+ * since the start of the run; block n is in ring slot n % ring_blocks.
+ *
+ * published: blocks handed out by the primary so far; their descriptors are
+ * written. oldest_valid: blocks before it may be overwritten by the card at
+ * any time. Both only grow within a generation, which changes at every start
+ * of the primary (the ring starts over).
+ */
+struct RingExportHeader
+{
+  static constexpr uint64_t magic_value = 0x54524f5058454c46; // NOLINT(build/unsigned) "FLEXPORT"
+  static constexpr uint32_t version_value = 1;                // NOLINT(build/unsigned)
+
+  uint64_t magic;        // NOLINT(build/unsigned)
+  uint32_t version;      // NOLINT(build/unsigned)
+  uint32_t block_size;   // NOLINT(build/unsigned)
+  uint64_t ring_size;    // NOLINT(build/unsigned) bytes
+  uint64_t ring_blocks;  // NOLINT(build/unsigned) descriptors following the header
+  uint64_t ring_offset;  // NOLINT(build/unsigned) of the ring in ring_file
+  int64_t pid;           // of the primary
+  char ring_file[256];   // to map the ring from, read-only; empty if it can't be
+
+  alignas(64) std::atomic<uint64_t> generation; // NOLINT(build/unsigned)
+  std::atomic<uint32_t> running;                // NOLINT(build/unsigned)
+  alignas(64) std::atomic<uint64_t> published;    // NOLINT(build/unsigned)
+  alignas(64) std::atomic<uint64_t> oldest_valid; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief A published block: its number, written last, and its header word
+ * (elink, sequence number, start of block), so consumers can filter elinks
+ * from the descriptors alone.
+ */
+struct RingExportDescriptor
+{
+  std::atomic<uint64_t> number; // NOLINT(build/unsigned)
+  uint32_t header;              // NOLINT(build/unsigned)
+  uint32_t slot;                // NOLINT(build/unsigned)
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring cursors are shared between processes"); // NOLINT
+
+/**
+ * @brief Primary side, driven by the DMA processor of CardWrapper (see
+ * CardWrapper::set_ring_export): one descriptor per block handed out, and
+ * the cursors, before the read pointer is given back to the card.
+ */
+class RingExport
+{
+public:
+  // Name of the shared memory object, e.g. /flxlibs-ring-<card>-<slr>-<dma>
+  explicit RingExport(std::string name);
+  ~RingExport();
+  RingExport(const RingExport&) = delete;            ///< RingExport is not copy-constructible
+  RingExport& operator=(const RingExport&) = delete; ///< RingExport is not copy-assignable
+  RingExport(RingExport&&) = delete;                 ///< RingExport is not move-constructible
+  RingExport& operator=(RingExport&&) = delete;      ///< RingExport is not move-assignable
+
+  // A new generation on the ring, which the card starts writing from its beginning
+  void start(const char* ring,
+             std::size_t ring_size,
+             std::size_t block_size,
+             const std::string& ring_file,
+             uint64_t ring_offset); // NOLINT(build/unsigned)
+  void stop();
+
+  // The blocks of the ring slots [from_index, to_index), about to be handed out
+  void publish(unsigned from_index, unsigned to_index);
+  // The card may overwrite all but the last hold_bytes before the blocks handed out
+  void release(uint64_t hold_bytes); // NOLINT(build/unsigned)
+
+  const std::string& get_name() const { return m_name; }
+
+private:
+  void map(std::size_t ring_blocks);
+  void unmap();
+
+  std::string m_name;
+  int m_fd{ -1 };
+  void* m_mapping{ nullptr };
+  std::size_t m_mapping_size{ 0 };
+  RingExportHeader* m_header{ nullptr };
+  RingExportDescriptor* m_descriptors{ nullptr };
+
+  const char* m_ring{ nullptr };
+  std::size_t m_block_size{ 4096 };
+  std::size_t m_ring_blocks{ 0 };
+  uint64_t m_published{ 0 }; // NOLINT(build/unsigned) only written here
+};
+
+/**
+ * @brief Secondary side: follows the blocks of an export, read-only.
+ *
+ * next() hands out blocks in place, in the ring. Once done with a block, a
+ * consumer checks with still_valid() that the card did not overwrite it in
+ * the meantime; only then is what it read from the block good. Blocks the
+ * card overwrote before next() got to them are skipped and counted as lost.
+ * A reader follows one primary process, whose ring is mapped once.
+ */
+class RingExportReader
+{
+public:
+  struct Block
+  {
+    uint64_t number{ 0 };     // NOLINT(build/unsigned)
+    uint64_t generation{ 0 }; // NOLINT(build/unsigned)
+    uint32_t header{ 0 };     // NOLINT(build/unsigned)
+    const char* data{ nullptr };
+  };
+
+  struct Stats
+  {
+    uint64_t blocks{ 0 };      // NOLINT(build/unsigned) handed out by next()
+    uint64_t lost_blocks{ 0 }; // NOLINT(build/unsigned) overwritten before next() got to them
+    uint64_t torn_blocks{ 0 }; // NOLINT(build/unsigned) overwritten while in use
+    uint64_t generations{ 0 }; // NOLINT(build/unsigned) starts of the primary followed
+  };
+
+  // Throws RingExportError if the export or its ring can't be mapped
+  explicit RingExportReader(const std::string& name);
+  ~RingExportReader();
+  RingExportReader(const RingExportReader&) = delete;            ///< RingExportReader is not copy-constructible
+  RingExportReader& operator=(const RingExportReader&) = delete; ///< RingExportReader is not copy-assignable
+  RingExportReader(RingExportReader&&) = delete;                 ///< RingExportReader is not move-constructible
+  RingExportReader& operator=(RingExportReader&&) = delete;      ///< RingExportReader is not move-assignable
+
+  // The next block, if the primary published one. Following starts at the newest block, and
+  // at the oldest one still in the ring when the primary starts again.
+  bool next(Block& block);
+  // Whether the block was intact up to now; counts it as torn if not
+  bool still_valid(const Block& block);
+
+  std::size_t get_block_size() const { return m_header->block_size; }
+  std::size_t get_ring_size() const { return m_header->ring_size; }
+  // Blocks published but not handed out yet
+  uint64_t get_backlog() const; // NOLINT(build/unsigned)
+  bool primary_running() const;
+  Stats get_stats() const { return m_stats; }
+
+private:
+  std::string m_name;
+  const void* m_mapping{ nullptr };
+  std::size_t m_mapping_size{ 0 };
+  const RingExportHeader* m_header{ nullptr };
+  const RingExportDescriptor* m_descriptors{ nullptr };
+  const char* m_ring{ nullptr };
+  std::size_t m_ring_mapping_size{ 0 };
+
+  uint64_t m_generation{ 0 }; // NOLINT(build/unsigned)
+  uint64_t m_next{ 0 };       // NOLINT(build/unsigned)
+  Stats m_stats;
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_RINGEXPORT_HPP_
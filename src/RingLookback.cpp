@@ -0,0 +1,238 @@
+/**
+ * @file RingLookback.cpp Window requests served from the DMA ring
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "RingLookback.hpp"
+
+#include "flxlibs/GatherKernels.hpp"
+
+// From STD
+#include <algorithm>
+#include <cstring>
+
+namespace dunedaq::flxlibs {
+
+namespace {
+
+// Copies len bytes at offset of a chunk out of its subchunks
+template<class DataPtrs, class Sizes>
+bool
+read_at(DataPtrs data, Sizes sizes, unsigned n_subchunks, std::size_t offset, char* dst, std::size_t len)
+{
+  for (unsigned i = 0; i < n_subchunks && len > 0; ++i) {
+    std::size_t size = sizes[i];
+    if (offset >= size) {
+      offset -= size;
+      continue;
+    }
+    std::size_t n = std::min(len, size - offset);
+    std::memcpy(dst, data[i] + offset, n);
+    dst += n;
+    len -= n;
+    offset = 0;
+  }
+  return len == 0;
+}
+
+} // namespace
+
+RingLookback::ElinkIndex::ElinkIndex(RingLookback& lookback)
+  : m_lookback(lookback)
+  , m_entries(std::max<std::size_t>(1, lookback.get_settings().index_entries))
+{}
+
+void
+RingLookback::ElinkIndex::add_chunk(const felix::packetformat::chunk& chunk)
+{
+  const unsigned n_subchunks = chunk.subchunk_number();
+  const char* ring = m_lookback.m_ring;
+  if (n_subchunks == 0 || n_subchunks > max_subchunks || ring == nullptr) {
+    m_lookback.m_unindexed_chunks.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto data = chunk.subchunks();
+  auto sizes = chunk.subchunk_lengths();
+  Entry entry;
+  entry.n_subchunks = n_subchunks;
+  for (unsigned i = 0; i < n_subchunks; ++i) {
+    const char* subchunk = data[i];
+    if (subchunk < ring || subchunk + sizes[i] > ring + m_lookback.m_ring_size) {
+      m_lookback.m_unindexed_chunks.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    entry.offsets[i] = subchunk - ring;
+    entry.lengths[i] = sizes[i];
+  }
+  if (!read_at(data,
+               sizes,
+               n_subchunks,
+               m_lookback.m_settings.timestamp_offset,
+               reinterpret_cast<char*>(&entry.timestamp), // NOLINT
+               sizeof(entry.timestamp))) {
+    m_lookback.m_unindexed_chunks.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  entry.first_block = m_lookback.block_number(entry.offsets[0]);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries[m_head % m_entries.size()] = entry;
+  ++m_head;
+  m_lookback.m_indexed_chunks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+RingLookback::ElinkIndex::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_head = 0;
+}
+
+RingLookback::RingLookback(const Settings& settings)
+  : m_settings(settings)
+{}
+
+RingLookback::ElinkIndex&
+RingLookback::add_elink(uint32_t elink) // NOLINT(build/unsigned)
+{
+  auto& index = m_elinks[elink];
+  if (index == nullptr) {
+    index = std::make_unique<ElinkIndex>(*this);
+  }
+  return *index;
+}
+
+void
+RingLookback::attach(const char* ring, std::size_t ring_size, std::size_t block_size)
+{
+  std::lock_guard<std::mutex> lock(m_pin_mutex);
+  m_ring = ring;
+  m_ring_size = ring_size;
+  m_block_size = block_size;
+  m_ring_blocks = ring_size / block_size;
+  m_dispatched = 0;
+  m_oldest_valid = 0;
+  m_pins.clear();
+  for (auto& [elink, index] : m_elinks) {
+    index->clear();
+  }
+}
+
+uint64_t // NOLINT(build/unsigned)
+RingLookback::block_number(uint64_t ring_offset) const // NOLINT(build/unsigned)
+{
+  // The block was handed out, so it is one of the last m_ring_blocks dispatched
+  const uint64_t last = m_dispatched.load(std::memory_order_acquire) - 1; // NOLINT(build/unsigned)
+  const uint64_t slot = ring_offset / m_block_size;                       // NOLINT(build/unsigned)
+  return last - (last % m_ring_blocks + m_ring_blocks - slot) % m_ring_blocks;
+}
+
+uint64_t // NOLINT(build/unsigned)
+RingLookback::release(uint64_t min_hold_bytes) // NOLINT(build/unsigned)
+{
+  std::lock_guard<std::mutex> lock(m_pin_mutex);
+  const uint64_t dispatched = m_dispatched.load(std::memory_order_relaxed); // NOLINT(build/unsigned)
+  uint64_t hold = std::max<uint64_t>((min_hold_bytes + m_block_size - 1) / m_block_size, // NOLINT(build/unsigned)
+                                     m_settings.lookback_bytes / m_block_size);
+  if (!m_pins.empty() && *m_pins.begin() < dispatched) {
+    hold = std::max<uint64_t>(hold, dispatched - *m_pins.begin()); // NOLINT(build/unsigned)
+  }
+  hold = std::min<uint64_t>(hold, m_ring_blocks - 1); // NOLINT(build/unsigned)
+  if (dispatched > hold) {
+    m_oldest_valid = std::max<uint64_t>(m_oldest_valid, dispatched - hold); // NOLINT(build/unsigned)
+  }
+  return hold * m_block_size;
+}
+
+RingLookback::WindowResult
+RingLookback::read_window(uint32_t elink, uint64_t begin, uint64_t end, std::vector<char>& out) // NOLINT
+{
+  m_requests.fetch_add(1, std::memory_order_relaxed);
+  WindowResult result;
+  auto it = m_elinks.find(elink);
+  if (it == m_elinks.end()) {
+    return result;
+  }
+  ElinkIndex& index = *it->second;
+
+  // The entries of the window, in timestamp (= parsing) order
+  std::vector<ElinkIndex::Entry> entries;
+  {
+    std::lock_guard<std::mutex> lock(index.m_mutex);
+    const uint64_t capacity = index.m_entries.size();                      // NOLINT(build/unsigned)
+    const uint64_t tail = index.m_head > capacity ? index.m_head - capacity : 0; // NOLINT(build/unsigned)
+    auto at = [&](uint64_t pos) -> const ElinkIndex::Entry& { return index.m_entries[pos % capacity]; }; // NOLINT
+    uint64_t lo = tail;          // NOLINT(build/unsigned)
+    uint64_t hi = index.m_head; // NOLINT(build/unsigned)
+    while (lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2; // NOLINT(build/unsigned)
+      if (at(mid).timestamp <= begin) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    for (uint64_t pos = lo > tail ? lo - 1 : lo; pos < index.m_head && at(pos).timestamp < end; ++pos) { // NOLINT
+      entries.push_back(at(pos));
+    }
+  }
+  if (entries.empty()) {
+    return result;
+  }
+
+  // Pin the oldest block still there; everything after it stays until the copy is done
+  auto first = entries.begin();
+  uint64_t pin = 0; // NOLINT(build/unsigned)
+  {
+    std::lock_guard<std::mutex> lock(m_pin_mutex);
+    while (first != entries.end() && first->first_block < m_oldest_valid) {
+      ++first;
+    }
+    if (first != entries.end()) {
+      pin = first->first_block;
+      m_pins.insert(pin);
+    }
+  }
+  result.stale_chunks = first - entries.begin();
+
+  for (auto entry = first; entry != entries.end(); ++entry) {
+    std::array<const char*, ElinkIndex::max_subchunks> data;
+    std::size_t length = 0;
+    for (unsigned i = 0; i < entry->n_subchunks; ++i) {
+      data[i] = m_ring + entry->offsets[i];
+      length += entry->lengths[i];
+    }
+    const std::size_t offset = out.size();
+    out.resize(offset + length);
+    parsers::gather_subchunks(data.data(), entry->lengths.data(), entry->n_subchunks, out.data() + offset, length);
+    result.chunks++;
+    result.bytes += length;
+  }
+
+  if (first != entries.end()) {
+    std::lock_guard<std::mutex> lock(m_pin_mutex);
+    m_pins.erase(m_pins.find(pin));
+  }
+  m_served_chunks.fetch_add(result.chunks, std::memory_order_relaxed);
+  m_served_bytes.fetch_add(result.bytes, std::memory_order_relaxed);
+  m_stale_chunks.fetch_add(result.stale_chunks, std::memory_order_relaxed);
+  return result;
+}
+
+RingLookback::Stats
+RingLookback::get_stats() const
+{
+  Stats stats;
+  stats.indexed_chunks = m_indexed_chunks.load();
+  stats.unindexed_chunks = m_unindexed_chunks.load();
+  stats.requests = m_requests.load();
+  stats.served_chunks = m_served_chunks.load();
+  stats.served_bytes = m_served_bytes.load();
+  stats.stale_chunks = m_stale_chunks.load();
+  return stats;
+}
+
+} // namespace dunedaq::flxlibs
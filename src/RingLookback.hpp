@@ -0,0 +1,156 @@
+/**
+ * @file RingLookback.hpp Serves time window requests straight from the DMA
+ * ring: the most recent part of the ring is kept from the card and indexed by
+ * chunk timestamp, per elink.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_RINGLOOKBACK_HPP_
+#define FLXLIBS_SRC_RINGLOOKBACK_HPP_
+
+#include "packetformat/block_format.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Uses the DMA ring as the latency buffer of its elinks.
+ *
+ * CardWrapper keeps lookback_bytes behind its read index from the card
+ * (see CardWrapper::set_lookback), plus whatever a request is copying at
+ * the moment. The parser thread of every elink indexes its chunks as it
+ * parses them (ElinkModel::set_lookback): chunk timestamp, and where the
+ * chunk's subchunks are in the ring. A window request copies only the
+ * chunks of the window out of the ring; chunks the card has overwritten
+ * since they were indexed are skipped and counted as stale.
+ *
+ * Blocks are numbered by dispatch order since attach(), so the index tells
+ * an overwritten block from its successor in the same ring slot.
+ */
+class RingLookback
+{
+public:
+  struct Settings
+  {
+    std::size_t lookback_bytes{ 1UL << 30 }; // of the ring kept from the card, behind the read index
+    std::size_t index_entries{ 1UL << 16 };  // chunks indexed per elink; the oldest are dropped
+    std::size_t timestamp_offset{ 8 };       // of the 64-bit timestamp in a chunk (DAQEthHeader frames)
+  };
+
+  struct Stats
+  {
+    uint64_t indexed_chunks{ 0 };   // NOLINT(build/unsigned)
+    uint64_t unindexed_chunks{ 0 }; // NOLINT(build/unsigned) too many subchunks, or not in the ring
+    uint64_t requests{ 0 };         // NOLINT(build/unsigned)
+    uint64_t served_chunks{ 0 };    // NOLINT(build/unsigned)
+    uint64_t served_bytes{ 0 };     // NOLINT(build/unsigned)
+    uint64_t stale_chunks{ 0 };     // NOLINT(build/unsigned) indexed, but overwritten before requested
+  };
+
+  struct WindowResult
+  {
+    std::size_t chunks{ 0 };
+    std::size_t bytes{ 0 };
+    std::size_t stale_chunks{ 0 };
+  };
+
+  /**
+   * @brief Timestamp index of one elink. Written by its parser thread only.
+   */
+  class ElinkIndex
+  {
+  public:
+    static constexpr unsigned max_subchunks = 4; // a superchunk spans at most three 4 KiB blocks
+
+    explicit ElinkIndex(RingLookback& lookback);
+
+    // Parser operation: indexes a chunk parsed from the ring
+    void add_chunk(const felix::packetformat::chunk& chunk);
+
+  private:
+    friend class RingLookback;
+
+    struct Entry
+    {
+      uint64_t timestamp{ 0 };                   // NOLINT(build/unsigned)
+      uint64_t first_block{ 0 };                 // NOLINT(build/unsigned) number of the block of the first subchunk
+      std::array<uint64_t, max_subchunks> offsets{}; // NOLINT(build/unsigned) in the ring
+      std::array<uint32_t, max_subchunks> lengths{}; // NOLINT(build/unsigned)
+      unsigned n_subchunks{ 0 };
+    };
+
+    void clear();
+
+    RingLookback& m_lookback;
+    std::mutex m_mutex; // parser thread against requests
+    std::vector<Entry> m_entries;
+    uint64_t m_head{ 0 }; // NOLINT(build/unsigned) entries ever added; the last index_entries are kept
+  };
+
+  explicit RingLookback(const Settings& settings);
+  RingLookback(const RingLookback&) = delete;            ///< RingLookback is not copy-constructible
+  RingLookback& operator=(const RingLookback&) = delete; ///< RingLookback is not copy-assignable
+  RingLookback(RingLookback&&) = delete;                 ///< RingLookback is not move-constructible
+  RingLookback& operator=(RingLookback&&) = delete;      ///< RingLookback is not move-assignable
+
+  // Index of an elink; all elinks are added before the ring is attached
+  ElinkIndex& add_elink(uint32_t elink); // NOLINT(build/unsigned)
+
+  // DMA processor side, see CardWrapper
+  void attach(const char* ring, std::size_t ring_size, std::size_t block_size);
+  void dispatching(uint64_t n_blocks) { m_dispatched.fetch_add(n_blocks, std::memory_order_release); } // NOLINT
+  // Bytes behind the read index to keep from the card, at least min_hold_bytes
+  uint64_t release(uint64_t min_hold_bytes); // NOLINT(build/unsigned)
+
+  /**
+   * @brief Copies the chunks of an elink that can hold data of [begin, end):
+   * the last one starting at or before begin, and every later one starting
+   * before end, in order, appended to out.
+   */
+  WindowResult read_window(uint32_t elink, uint64_t begin, uint64_t end, std::vector<char>& out); // NOLINT
+
+  const Settings& get_settings() const { return m_settings; }
+  Stats get_stats() const;
+
+private:
+  uint64_t block_number(uint64_t ring_offset) const; // NOLINT(build/unsigned)
+
+  Settings m_settings;
+  std::map<uint32_t, std::unique_ptr<ElinkIndex>> m_elinks; // NOLINT(build/unsigned)
+
+  // Ring
+  const char* m_ring{ nullptr };
+  std::size_t m_ring_size{ 0 };
+  std::size_t m_block_size{ 4096 };
+  std::size_t m_ring_blocks{ 0 };
+  std::atomic<uint64_t> m_dispatched{ 0 }; // NOLINT(build/unsigned) blocks handed out since attach()
+
+  // Blocks older than m_oldest_valid may have been overwritten. Requests pin the oldest block they
+  // copy from, so that the DMA processor keeps it from the card until they are done.
+  std::mutex m_pin_mutex;
+  std::multiset<uint64_t> m_pins;  // NOLINT(build/unsigned)
+  uint64_t m_oldest_valid{ 0 };    // NOLINT(build/unsigned)
+
+  // Statistics
+  std::atomic<uint64_t> m_indexed_chunks{ 0 };   // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_unindexed_chunks{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_requests{ 0 };         // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_served_chunks{ 0 };    // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_served_bytes{ 0 };     // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_stale_chunks{ 0 };     // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_RINGLOOKBACK_HPP_
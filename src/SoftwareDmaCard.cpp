@@ -0,0 +1,162 @@
+/**
+ * @file SoftwareDmaCard.cpp Mock FELIX card with a software to-host DMA engine
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+// From Module
+#include "SoftwareDmaCard.hpp"
+#include "flxlibs/BlockEncoder.hpp"
+
+#include "logging/Logging.hpp"
+
+// From STD
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+namespace {
+// Chunk payload generated before the current address is moved; small enough
+// not to dominate the latency measured downstream
+constexpr std::size_t batch_bytes = 64 * 1024;
+} // namespace
+
+SoftwareDmaCard::~SoftwareDmaCard()
+{
+  stop_source();
+}
+
+void
+SoftwareDmaCard::dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t size, unsigned flags) // NOLINT
+{
+  m_ring_base[dma_id % m_max_dma] = phys_addr;
+  m_ring_size[dma_id % m_max_dma] = size;
+  MockCardInterface::dma_to_host(dma_id, phys_addr, size, flags);
+}
+
+void
+SoftwareDmaCard::start_source(unsigned dma_id, const SourceSettings& settings)
+{
+  stop_source();
+  m_chunks = 0;
+  m_bytes = 0;
+  m_blocks_written = 0;
+  m_blocks_dropped = 0;
+  m_write_address = dma_current_address(dma_id);
+  m_running = true;
+  m_engine = std::thread(&SoftwareDmaCard::generate, this, dma_id, settings);
+}
+
+void
+SoftwareDmaCard::stop_source()
+{
+  m_running = false;
+  if (m_engine.joinable()) {
+    m_engine.join();
+  }
+}
+
+SoftwareDmaCard::SourceStats
+SoftwareDmaCard::get_source_stats() const
+{
+  SourceStats stats;
+  stats.chunks = m_chunks.load();
+  stats.bytes = m_bytes.load();
+  stats.blocks_written = m_blocks_written.load();
+  stats.blocks_dropped = m_blocks_dropped.load();
+  return stats;
+}
+
+bool
+SoftwareDmaCard::write_block(unsigned dma_id, const char* block, std::size_t block_size)
+{
+  const uint64_t base = m_ring_base[dma_id % m_max_dma]; // NOLINT(build/unsigned)
+  const std::size_t size = m_ring_size[dma_id % m_max_dma];
+
+  // The card stops one block short of the read pointer; equal pointers mean an empty ring
+  uint64_t next = m_write_address + block_size; // NOLINT(build/unsigned)
+  if (next >= base + size) {
+    next = base;
+  }
+  if (next == get_dma_read_pointer(dma_id)) {
+    m_blocks_dropped++;
+    return false;
+  }
+  std::memcpy(reinterpret_cast<char*>(m_write_address), block, block_size); // NOLINT
+  m_write_address = next;
+  m_blocks_written++;
+  return true;
+}
+
+void
+SoftwareDmaCard::generate(unsigned dma_id, SourceSettings settings)
+{
+  std::vector<std::vector<char>> emu_chunks;
+  if (settings.emu_image != nullptr) {
+    emu_chunks = emu::emu_image_chunks(*settings.emu_image);
+  }
+  const bool from_image = settings.emu_image != nullptr;
+  if (settings.elinks.empty() || (from_image ? emu_chunks.empty() : settings.chunk_size < sizeof(int64_t)) ||
+      m_ring_size[dma_id % m_max_dma] == 0) {
+    TLOG() << "SoftwareDmaCard: nothing to generate, source not started";
+    return;
+  }
+
+  BlockEncoder encoder(settings.block_size, settings.trailer_32b, [&](const char* block) {
+    write_block(dma_id, block, settings.block_size);
+  });
+
+  std::vector<char> chunk(settings.chunk_size);
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    chunk[i] = static_cast<char>(i);
+  }
+
+  std::size_t next_elink = 0;
+  std::size_t next_emu_chunk = 0;
+  uint64_t chunks = 0; // NOLINT(build/unsigned)
+  uint64_t bytes = 0;  // NOLINT(build/unsigned)
+  const auto t0 = std::chrono::steady_clock::now();
+  while (m_running.load()) {
+    // Bytes due at the configured rate
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const auto due = static_cast<uint64_t>(elapsed * settings.rate_bytes_per_s); // NOLINT(build/unsigned)
+    if (bytes >= due) {
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+      continue;
+    }
+
+    const uint64_t batch_end = std::min(due, bytes + batch_bytes); // NOLINT(build/unsigned)
+    while (bytes < batch_end) {
+      const std::vector<char>* next_chunk = &chunk;
+      if (from_image) {
+        next_chunk = &emu_chunks[next_emu_chunk];
+        next_emu_chunk = (next_emu_chunk + 1) % emu_chunks.size();
+      } else {
+        const int64_t stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+        std::memcpy(chunk.data(), &stamp, sizeof(stamp));
+      }
+      encoder.add_chunk(settings.elinks[next_elink], next_chunk->data(), next_chunk->size());
+      next_elink = (next_elink + 1) % settings.elinks.size();
+      bytes += next_chunk->size();
+      ++chunks;
+    }
+    m_chunks.store(chunks, std::memory_order_relaxed);
+    m_bytes.store(bytes, std::memory_order_relaxed);
+
+    // Blocks are in the ring before the host can see the new address
+    set_dma_current_address(dma_id, m_write_address);
+  }
+
+  // Close the open blocks, as the card does on its timeout
+  encoder.flush_all();
+  set_dma_current_address(dma_id, m_write_address);
+}
+
+} // namespace dunedaq::flxlibs
@@ -0,0 +1,90 @@
+/**
+ * @file SoftwareDmaCard.hpp Mock FELIX card with a software to-host DMA
+ * engine, for running CardWrapper and the elink pipeline without hardware.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_SRC_SOFTWAREDMACARD_HPP_
+#define FLXLIBS_SRC_SOFTWAREDMACARD_HPP_
+
+#include "MockCardInterface.hpp"
+
+#include "flxlibs/EmuPatternGenerator.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::flxlibs {
+
+/**
+ * @brief Generates chunks for a set of elinks at a fixed aggregate rate,
+ * encodes them into blocks and writes the blocks into the DMA ring set up by
+ * dma_to_host(), moving the current address after every batch.
+ *
+ * Like the card, the engine never overtakes the host's read pointer: a block
+ * that finds the ring full is dropped and counted, as the front-end data is
+ * lost when the card's buffers overflow. The first 8 bytes of every chunk
+ * carry the steady_clock time (ns) at which the chunk was generated, for
+ * latency measurements downstream.
+ *
+ * With an EMU RAM image, the source plays the card's emulator instead: the
+ * chunks of the image (emu::emu_image_chunks) go out in turn, unmodified.
+ */
+class SoftwareDmaCard : public MockCardInterface
+{
+public:
+  struct SourceSettings
+  {
+    std::size_t block_size{ 4096 };
+    bool trailer_32b{ true };
+    std::vector<uint32_t> elinks; // NOLINT(build/unsigned) chunks go round-robin over these
+    std::size_t chunk_size{ 4096 };
+    double rate_bytes_per_s{ 1e9 }; // aggregate chunk payload rate
+    std::shared_ptr<const emu::EmuImage> emu_image; // if set, its chunks instead of chunk_size ones
+  };
+
+  struct SourceStats
+  {
+    uint64_t chunks{ 0 };         // NOLINT(build/unsigned)
+    uint64_t bytes{ 0 };          // NOLINT(build/unsigned) chunk payload
+    uint64_t blocks_written{ 0 }; // NOLINT(build/unsigned)
+    uint64_t blocks_dropped{ 0 }; // NOLINT(build/unsigned) ring full
+  };
+
+  SoftwareDmaCard() = default;
+  ~SoftwareDmaCard();
+
+  void dma_to_host(unsigned dma_id, uint64_t phys_addr, std::size_t size, unsigned flags) override; // NOLINT
+
+  // Starts and stops generating data into the ring of the given DMA
+  void start_source(unsigned dma_id, const SourceSettings& settings);
+  void stop_source();
+
+  SourceStats get_source_stats() const;
+
+private:
+  void generate(unsigned dma_id, SourceSettings settings);
+  bool write_block(unsigned dma_id, const char* block, std::size_t block_size);
+
+  static constexpr unsigned m_max_dma = 8;
+  uint64_t m_ring_base[m_max_dma] = {}; // NOLINT(build/unsigned)
+  std::size_t m_ring_size[m_max_dma] = {};
+  uint64_t m_write_address{ 0 }; // NOLINT(build/unsigned) only touched by the engine thread
+
+  std::atomic<bool> m_running{ false };
+  std::thread m_engine;
+  std::atomic<uint64_t> m_chunks{ 0 };         // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_bytes{ 0 };          // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_blocks_written{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_blocks_dropped{ 0 }; // NOLINT(build/unsigned)
+};
+
+} // namespace dunedaq::flxlibs
+
+#endif // FLXLIBS_SRC_SOFTWAREDMACARD_HPP_
@@ -0,0 +1,150 @@
+/**
+ * @file TestSupport.hpp Helpers shared by the test applications: pass/fail
+ * checks, a sink that drops every payload, and streams of encoded blocks.
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef FLXLIBS_TEST_APPS_TESTSUPPORT_HPP_
+#define FLXLIBS_TEST_APPS_TESTSUPPORT_HPP_
+
+#include "flxlibs/BlockEncoder.hpp"
+#include "flxlibs/BlockFormat.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::flxlibs::testsupport {
+
+// Checks: failures are counted and logged, check_summary() gives the exit code
+inline int failures = 0;
+
+inline void
+expect(bool condition, const std::string& what)
+{
+  if (!condition) {
+    TLOG() << "FAILED: " << what;
+    ++failures;
+  }
+}
+
+inline int
+check_summary()
+{
+  TLOG() << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed");
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Name of a per-link register bitfield, e.g. ("SUPER_CHUNK_FACTOR_LINK_%02u", 3)
+inline std::string
+link_bitfield(const char* format, unsigned link)
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), format, link);
+  return name;
+}
+
+/**
+ * @brief Takes every payload and drops it on the spot; heap payloads are freed.
+ */
+template<typename Datatype>
+class NullSink : public iomanager::SenderConcept<Datatype>
+{
+public:
+  NullSink()
+    : iomanager::SenderConcept<Datatype>(iomanager::ConnectionId{ "null_sink", "Null" })
+  {}
+
+  void send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override { consume(std::move(data)); }
+  bool try_send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override
+  {
+    consume(std::move(data));
+    return true;
+  }
+  void send_with_topic(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/, std::string /*topic*/) override
+  {
+    consume(std::move(data));
+  }
+  void stop() override {}
+  bool is_ready_for_sending(iomanager::Sender::timeout_t /*timeout*/) override { return true; }
+
+private:
+  void consume(Datatype&& data)
+  {
+    if constexpr (std::is_pointer_v<Datatype>) {
+      delete[] data; // NOLINT
+    } else {
+      Datatype dropped(std::move(data));
+    }
+  }
+};
+
+struct StreamSpec
+{
+  uint32_t elink{ 0 }; // NOLINT(build/unsigned)
+  std::size_t block_size{ 4096 };
+  bool trailer_32b{ true };
+  std::size_t chunk_size{ 464 };
+  std::size_t max_subchunk{ 0 };     // 0: as large as the block allows
+  uint64_t timestamp_step{ 0 };      // NOLINT(build/unsigned) 0: chunks carry a byte ramp, else 64-bit timestamps
+  bool whole_seqnr_periods{ false }; // pad to whole sequence number periods, to replay back to back
+};
+
+struct EncodedStream
+{
+  std::vector<char> blocks;
+  std::size_t n_blocks{ 0 };
+  std::size_t n_chunks{ 0 };
+  std::size_t n_subchunks{ 0 };
+};
+
+// One elink's stream of whole blocks of at least target_bytes
+inline EncodedStream
+encode_stream(const StreamSpec& spec, std::size_t target_bytes)
+{
+  EncodedStream stream;
+  stream.blocks.reserve(target_bytes + 64 * spec.block_size);
+  BlockEncoder encoder(spec.block_size, spec.trailer_32b, [&](const char* block) {
+    stream.blocks.insert(stream.blocks.end(), block, block + spec.block_size);
+  });
+  if (spec.max_subchunk != 0) {
+    encoder.set_max_subchunk_length(spec.max_subchunk);
+  }
+  std::vector<char> chunk(spec.chunk_size);
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    chunk[i] = static_cast<char>(i);
+  }
+  uint64_t timestamp = 0; // NOLINT(build/unsigned)
+  while (stream.blocks.size() < target_bytes) {
+    if (spec.timestamp_step != 0) {
+      for (std::size_t i = 0; i + sizeof(timestamp) <= chunk.size(); i += sizeof(timestamp)) {
+        std::memcpy(chunk.data() + i, &timestamp, sizeof(timestamp));
+      }
+      timestamp += spec.timestamp_step;
+    }
+    encoder.add_chunk(spec.elink, chunk.data(), chunk.size());
+    ++stream.n_chunks;
+  }
+  stream.n_subchunks = encoder.get_num_subchunks();
+  encoder.flush_all();
+  while (spec.whole_seqnr_periods && encoder.get_num_blocks() % (blockformat::max_seqnr + 1) != 0) {
+    encoder.add_chunk(spec.elink, chunk.data(), 0); // empty shortchunk in a block of its own
+    encoder.flush_all();
+  }
+  stream.n_blocks = encoder.get_num_blocks();
+  return stream;
+}
+
+} // namespace dunedaq::flxlibs::testsupport
+
+#endif // FLXLIBS_TEST_APPS_TESTSUPPORT_HPP_
@@ -0,0 +1,150 @@
+/**
+ * @file test_block_encoder_app.cxx Encodes random chunk streams of several
+ * elinks with the software BlockEncoder, parses the blocks back with the
+ * FELIX BlockParser and compares the chunks. Also reports encoder throughput.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "DefaultParserImpl.hpp"
+
+#include "flxlibs/BlockEncoder.hpp"
+#include "flxlibs/GatherKernels.hpp"
+
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+#include "packetformat/block_parser.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+constexpr int n_chunks = 100000;
+constexpr uint32_t n_elinks = 8; // NOLINT(build/unsigned)
+
+// One parser per elink, as in the reader: a parser keeps split chunks across blocks
+struct ElinkParser
+{
+  DefaultParserImpl impl;
+  std::unique_ptr<felix::packetformat::BlockParser<DefaultParserImpl>> parser;
+  std::vector<std::string> chunks;
+  std::size_t error_chunks{ 0 };
+};
+
+bool
+round_trip(std::size_t block_size, bool trailer_32b)
+{
+  std::map<uint32_t, ElinkParser> elink_parsers; // NOLINT(build/unsigned)
+  std::map<uint32_t, std::vector<std::string>> expected; // NOLINT(build/unsigned)
+  std::size_t expected_error_chunks = 0;
+
+  for (uint32_t i = 0; i < n_elinks; ++i) { // NOLINT(build/unsigned)
+    uint32_t elink = i * 64; // NOLINT(build/unsigned)
+    auto& p = elink_parsers[elink];
+    p.parser = std::make_unique<felix::packetformat::BlockParser<DefaultParserImpl>>(p.impl);
+    p.parser->configure(block_size, trailer_32b);
+    p.impl.process_chunk_func = [&p](const felix::packetformat::chunk& chunk) {
+      std::string data(chunk.length(), '\0');
+      parsers::gather_subchunks(chunk.subchunks(), chunk.subchunk_lengths(), chunk.subchunk_number(), data.data(),
+                                chunk.length());
+      p.chunks.push_back(std::move(data));
+    };
+    p.impl.process_shortchunk_func = [&p](const felix::packetformat::shortchunk& shortchunk) {
+      p.chunks.emplace_back(shortchunk.data, shortchunk.length);
+    };
+    p.impl.process_chunk_with_error_func = [&p](const felix::packetformat::chunk&) { p.error_chunks++; };
+    p.impl.process_shortchunk_with_error_func = [&p](const felix::packetformat::shortchunk&) { p.error_chunks++; };
+  }
+
+  BlockEncoder encoder(block_size, trailer_32b, [&](const char* block) {
+    auto* b = felix::packetformat::block_from_bytes(block);
+    elink_parsers.at(b->elink).parser->process(b);
+  });
+
+  std::mt19937 rng(42);
+  for (int i = 0; i < n_chunks; ++i) {
+    uint32_t elink = (rng() % n_elinks) * 64; // NOLINT(build/unsigned)
+    // Mostly short chunks, some spanning many blocks
+    std::size_t length = (rng() % 8 == 0) ? rng() % (8 * block_size) : 1 + rng() % 512;
+    std::string data(length, '\0');
+    for (auto& c : data) {
+      c = static_cast<char>(rng());
+    }
+    BlockEncoder::ChunkFlags flags;
+    flags.crc_error = (rng() % 200 == 0);
+    encoder.add_chunk(elink, data.data(), data.size(), flags);
+    if (flags.crc_error) {
+      ++expected_error_chunks;
+    } else {
+      expected[elink].push_back(std::move(data));
+    }
+  }
+  encoder.flush_all();
+
+  bool ok = true;
+  std::size_t error_chunks = 0;
+  for (auto& [elink, p] : elink_parsers) {
+    error_chunks += p.error_chunks;
+    if (p.chunks != expected[elink]) {
+      TLOG() << "FAILED: elink " << elink << " parsed " << p.chunks.size() << " good chunks, expected "
+             << expected[elink].size();
+      ok = false;
+    }
+  }
+  if (error_chunks != expected_error_chunks) {
+    TLOG() << "FAILED: " << error_chunks << " chunks with error, expected " << expected_error_chunks;
+    ok = false;
+  }
+  TLOG() << "Block size " << block_size << (trailer_32b ? ", 32-bit" : ", 16-bit") << " trailers: "
+         << encoder.get_num_blocks() << " blocks, " << encoder.get_num_subchunks() << " subchunks"
+         << (ok ? ", round trip OK" : "");
+  return ok;
+}
+
+void
+throughput(std::size_t block_size, bool trailer_32b, std::size_t chunk_size)
+{
+  // Blocks are copied into a ring, as the DMA emulator does
+  std::vector<char> ring(64 * 1024 * 1024);
+  std::size_t write = 0;
+  BlockEncoder encoder(block_size, trailer_32b, [&](const char* block) {
+    std::memcpy(ring.data() + write, block, block_size);
+    write = (write + block_size) % ring.size();
+  });
+  std::string chunk(chunk_size, 'x');
+  const std::size_t n = (1UL << 31) / chunk_size;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < n; ++i) {
+    encoder.add_chunk((i % n_elinks) * 64, chunk.data(), chunk.size());
+  }
+  encoder.flush_all();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  TLOG() << "Block size " << block_size << ", " << chunk_size << " B chunks: " << n * chunk_size / seconds / 1e9
+         << " GB/s";
+}
+
+} // namespace
+
+int
+main(int /*argc*/, char** /*argv[]*/)
+{
+  bool ok = round_trip(1024, false);
+  ok &= round_trip(4096, true);
+
+  for (std::size_t chunk_size : { 64, 464, 5568, 65536 }) {
+    throughput(4096, true, chunk_size);
+  }
+
+  TLOG() << (ok ? "All checks passed" : "Checks failed");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
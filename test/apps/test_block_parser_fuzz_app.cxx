@@ -0,0 +1,340 @@
+/**
+ * @file test_block_parser_fuzz_app.cxx Fuzz target for the block parsing path:
+ * BlockParser<DefaultParserImpl> with the parser operations of the readout
+ * wired in, fed the way ElinkModel feeds it.
+ *
+ * Input: one configuration byte, then the blocks. The configuration selects
+ * the trailer size (and with it the block size), the parser operations, error
+ * chunk capture and whether the start of block marker of every block is
+ * forced to the configured one, so that most inputs get past the header
+ * check. A partial last block is zero padded.
+ *
+ * Built with -DWITH_FUZZING=ON (clang) this is a libFuzzer target; start it
+ * with a seed corpus from --write-seeds. Otherwise it is a standalone driver:
+ * it runs files or directories given as arguments (corpus replay, crash
+ * reproduction), or --runs N inputs of its own, mutated from encoded blocks.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "DefaultParserImpl.hpp"
+#include "TestSupport.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+#include "flxlibs/BlockEncoder.hpp"
+#include "flxlibs/BlockFormat.hpp"
+#include "flxlibs/ErrorChunkPool.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/VariableSizePayloadTypeAdapter.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+#include "packetformat/block_parser.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+constexpr std::size_t max_blocks = 16; // per input, enough for chunks spanning several blocks
+
+// Configuration byte
+constexpr uint8_t cfg_trailer_32b = 0x01;    // NOLINT(build/unsigned)
+constexpr uint8_t cfg_large_block = 0x02;    // NOLINT(build/unsigned) 4 KiB blocks (32-bit trailers only)
+constexpr uint8_t cfg_op_shift = 2;          // NOLINT(build/unsigned) 3 bits: parser operations
+constexpr uint8_t cfg_force_sob = 0x20;      // NOLINT(build/unsigned)
+constexpr uint8_t cfg_capture_errors = 0x40; // NOLINT(build/unsigned)
+
+enum class Op
+{
+  varsized = 0,
+  coalesced,
+  fixsized,
+  timestamped,
+  strided,
+  heap,
+  count
+};
+
+// Sinks and the error chunk pool outlive every input: the parser operations hold references to them
+struct Sinks
+{
+  using VarSize = fdreadoutlibs::types::VariableSizePayloadTypeAdapter;
+  using DAPHNE = fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter;
+  using DAPHNEStream = fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter;
+
+  std::shared_ptr<iomanager::SenderConcept<VarSize>> varsize = std::make_shared<NullSink<VarSize>>();
+  std::shared_ptr<iomanager::SenderConcept<DAPHNE>> daphne = std::make_shared<NullSink<DAPHNE>>();
+  std::shared_ptr<iomanager::SenderConcept<DAPHNEStream>> daphne_stream = std::make_shared<NullSink<DAPHNEStream>>();
+  std::shared_ptr<iomanager::SenderConcept<DAPHNE*>> daphne_heap = std::make_shared<NullSink<DAPHNE*>>();
+  std::shared_ptr<iomanager::SenderConcept<ErrorChunkHandle>> errors = std::make_shared<NullSink<ErrorChunkHandle>>();
+  std::shared_ptr<ErrorChunkPool> error_pool = std::make_shared<ErrorChunkPool>(16, 1000000);
+};
+
+Sinks&
+sinks()
+{
+  static Sinks s;
+  return s;
+}
+
+void
+wire(DefaultParserImpl& impl, Op op, bool capture_errors, parsers::ParserOptions& opts)
+{
+  auto& s = sinks();
+  auto& stats = impl.get_local_stats();
+  switch (op) {
+    case Op::varsized:
+      impl.process_chunk_func = parsers::varsizedChunkIntoWrapper(s.varsize, stats, opts);
+      impl.process_shortchunk_func = parsers::varsizedShortchunkIntoWrapper(s.varsize, stats, opts);
+      break;
+    case Op::coalesced: {
+      opts.coalesce_shortchunks = true;
+      auto coalescer = std::make_shared<parsers::ShortchunkCoalescer>(s.varsize, stats, opts);
+      impl.process_chunk_func = parsers::coalescedChunkIntoWrapper(coalescer, s.varsize, stats, opts);
+      impl.process_shortchunk_func = parsers::coalescedShortchunkInto(coalescer);
+      impl.process_block_func = parsers::coalescedBlockBoundary(coalescer);
+      impl.flush_func = parsers::coalescedFlush(coalescer);
+      break;
+    }
+    case Op::fixsized:
+      impl.process_chunk_func = parsers::fixsizedChunkInto<Sinks::DAPHNE>(s.daphne, stats, opts);
+      break;
+    case Op::timestamped:
+      opts.check_timestamps = true;
+      impl.process_chunk_func = parsers::timestampedChunkInto<Sinks::DAPHNE>(s.daphne, stats, opts, 0);
+      break;
+    case Op::strided: {
+      opts.check_timestamps = true;
+      uint64_t stride = Sinks::DAPHNEStream::expected_tick_difference * Sinks::DAPHNEStream().get_num_frames(); // NOLINT
+      impl.process_chunk_func = parsers::timestampedChunkInto<Sinks::DAPHNEStream>(s.daphne_stream, stats, opts, stride);
+      break;
+    }
+    default:
+      impl.process_chunk_func = parsers::fixsizedChunkViaHeap<Sinks::DAPHNE>(s.daphne_heap, stats);
+      break;
+  }
+  if (capture_errors) {
+    impl.process_chunk_with_error_func =
+      parsers::errorChunkIntoSink(s.errors, s.error_pool, impl.get_block_header(), stats, opts);
+  }
+}
+
+void
+parse_input(const uint8_t* data, std::size_t size) // NOLINT(build/unsigned)
+{
+  if (size < 1) {
+    return;
+  }
+  const uint8_t cfg = data[0]; // NOLINT(build/unsigned)
+  const bool trailer_32b = cfg & cfg_trailer_32b;
+  const std::size_t block_size = (trailer_32b && (cfg & cfg_large_block)) ? 4096 : 1024;
+  const Op op = static_cast<Op>(((cfg >> cfg_op_shift) & 0x7) % static_cast<int>(Op::count));
+  ++data;
+  --size;
+
+  const std::size_t n_blocks = std::min(max_blocks, (size + block_size - 1) / block_size);
+  std::vector<char> blocks(n_blocks * block_size, 0);
+  std::memcpy(blocks.data(), data, std::min(size, blocks.size()));
+
+  DefaultParserImpl impl;
+  parsers::ParserOptions opts;
+  wire(impl, op, cfg & cfg_capture_errors, opts);
+  impl.set_expected_sob(blockformat::start_of_block(trailer_32b));
+  felix::packetformat::BlockParser<DefaultParserImpl> parser(impl);
+  parser.configure(block_size, trailer_32b);
+
+  // As ElinkModel::process_elink
+  for (std::size_t b = 0; b < n_blocks; ++b) {
+    char* block = blocks.data() + b * block_size;
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, block, sizeof(header));
+    if (cfg & cfg_force_sob) {
+      header = blockformat::make_header(
+        blockformat::header_elink(header), blockformat::header_seqnr(header), blockformat::start_of_block(trailer_32b));
+      std::memcpy(block, &header, sizeof(header));
+    }
+    if (impl.accept_block_header(header)) {
+      parser.process(felix::packetformat::block_from_bytes(block));
+    } else {
+      parser.configure(block_size, trailer_32b); // as ElinkModel::reset_parser
+    }
+    impl.flush_local_stats();
+  }
+  // As ElinkModel::flush_parser, at stop
+  impl.flush_func(true);
+  impl.flush_local_stats();
+}
+
+// Valid inputs, to seed the fuzzer and the mutations of the standalone driver
+std::vector<std::vector<uint8_t>> // NOLINT(build/unsigned)
+make_seeds()
+{
+  std::vector<std::vector<uint8_t>> seeds; // NOLINT(build/unsigned)
+  const std::vector<std::size_t> chunk_sizes = { 0, 7, 64, 100, 472, 1000, 2800, 5568, 9000 };
+  for (uint8_t format : { uint8_t{ 0 }, cfg_trailer_32b, uint8_t{ cfg_trailer_32b | cfg_large_block } }) { // NOLINT
+    const bool trailer_32b = format & cfg_trailer_32b;
+    const std::size_t block_size = (format & cfg_large_block) ? 4096 : 1024;
+    for (int op = 0; op < static_cast<int>(Op::count); ++op) {
+      for (std::size_t chunk_size : chunk_sizes) {
+        std::vector<uint8_t> seed = { static_cast<uint8_t>(format | (op << cfg_op_shift) | cfg_capture_errors) }; // NOLINT
+        BlockEncoder encoder(block_size, trailer_32b, [&](const char* block) {
+          if (seed.size() < 1 + max_blocks * block_size) {
+            seed.insert(seed.end(), block, block + block_size);
+          }
+        });
+        std::vector<char> chunk(chunk_size);
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+          chunk[i] = static_cast<char>(i * 7);
+        }
+        BlockEncoder::ChunkFlags flags;
+        flags.crc_error = chunk_size == 100;
+        for (int i = 0; i < 3; ++i) {
+          encoder.add_chunk(0, chunk.data(), chunk.size(), flags);
+        }
+        encoder.flush_all();
+        seeds.push_back(std::move(seed));
+      }
+    }
+  }
+  return seeds;
+}
+
+// A few random bit flips, byte writes, word writes near the block ends (trailers) or block copies
+void
+mutate(std::vector<uint8_t>& input, std::mt19937_64& rng) // NOLINT(build/unsigned)
+{
+  if (input.size() < 2) {
+    return;
+  }
+  const int n = 1 + rng() % 8;
+  for (int i = 0; i < n; ++i) {
+    const std::size_t pos = 1 + rng() % (input.size() - 1);
+    switch (rng() % 5) {
+      case 0:
+        input[pos] ^= static_cast<uint8_t>(1U << (rng() % 8)); // NOLINT(build/unsigned)
+        break;
+      case 1:
+        input[pos] = static_cast<uint8_t>(rng()); // NOLINT(build/unsigned)
+        break;
+      case 2: {
+        const std::size_t block_size = input.size() - 1 >= 4096 ? 4096 : 1024;
+        const std::size_t block_end = 1 + ((pos - 1) / block_size + 1) * block_size;
+        const std::size_t word = block_end - 4 * (1 + rng() % 16);
+        if (word + 4 <= input.size() && word >= 1) {
+          uint32_t value = static_cast<uint32_t>(rng()); // NOLINT(build/unsigned)
+          std::memcpy(&input[word], &value, sizeof(value));
+        }
+        break;
+      }
+      case 3:
+        input[0] ^= static_cast<uint8_t>(1U << (rng() % 7)); // NOLINT(build/unsigned)
+        break;
+      default:
+        input.resize(1 + rng() % input.size());
+        break;
+    }
+  }
+}
+
+std::vector<uint8_t> // NOLINT(build/unsigned)
+read_file(const std::filesystem::path& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()); // NOLINT
+}
+
+} // namespace
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) // NOLINT(build/unsigned)
+{
+  parse_input(data, size);
+  return 0;
+}
+
+#ifndef FLXLIBS_WITH_LIBFUZZER
+int
+main(int argc, char* argv[])
+{
+  std::size_t runs = 0;
+  uint64_t seed = 1; // NOLINT(build/unsigned)
+  std::string seeds_dir;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--runs" && i + 1 < argc) {
+      runs = std::stoul(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = std::stoull(argv[++i]);
+    } else if (arg == "--write-seeds" && i + 1 < argc) {
+      seeds_dir = argv[++i];
+    } else if (arg.rfind("--", 0) != 0) {
+      paths.push_back(arg);
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--runs N [--seed S]] [--write-seeds DIR] [FILE|DIR ...]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto seeds = make_seeds();
+  if (!seeds_dir.empty()) {
+    std::filesystem::create_directories(seeds_dir);
+    for (std::size_t i = 0; i < seeds.size(); ++i) {
+      std::ofstream out(std::filesystem::path(seeds_dir) / ("seed-" + std::to_string(i)), std::ios::binary);
+      out.write(reinterpret_cast<const char*>(seeds[i].data()), seeds[i].size()); // NOLINT
+    }
+    TLOG() << seeds.size() << " seed inputs written to " << seeds_dir;
+  }
+
+  std::size_t inputs = 0;
+  for (const auto& path : paths) {
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(path)) {
+      for (const auto& entry : std::filesystem::directory_iterator(path)) {
+        files.push_back(entry.path());
+      }
+    } else {
+      files.emplace_back(path);
+    }
+    for (const auto& file : files) {
+      auto input = read_file(file);
+      parse_input(input.data(), input.size());
+      ++inputs;
+    }
+  }
+
+  if (runs == 0 && paths.empty() && seeds_dir.empty()) {
+    runs = 100000;
+  }
+  std::mt19937_64 rng(seed);
+  for (auto& input : seeds) {
+    parse_input(input.data(), input.size());
+  }
+  for (std::size_t r = 0; r < runs; ++r) {
+    auto input = seeds[rng() % seeds.size()];
+    mutate(input, rng);
+    parse_input(input.data(), input.size());
+  }
+  TLOG() << "Parsed " << inputs << " input files, " << seeds.size() << " seeds and " << runs
+         << " mutated inputs without a crash";
+  return EXIT_SUCCESS;
+}
+#endif // FLXLIBS_WITH_LIBFUZZER
@@ -0,0 +1,336 @@
+/**
+ * @file test_block_router_bench_app.cxx Cost per block of the block routers
+ * (BlockRouter.hpp), called through a std::function as CardWrapper calls
+ * them, over a ring of blocks.
+ *
+ * Sweeps the router, the number of elinks, the elink interleaving in the
+ * ring (round robin, bursts, random, a few hot elinks) and the depth of the
+ * elink block queues, which a separate thread drains as the parsers would.
+ * Reports ns/block and, where perf_event_open is allowed, cache misses,
+ * cycles and instructions per block of the routing thread. Every case is
+ * also written as one JSON object per line (--json FILE).
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "BlockRouter.hpp"
+
+#include "flxlibs/BlockFormat.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <folly/ProducerConsumerQueue.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+constexpr std::size_t block_size = 4096;
+constexpr uint32_t elink_stride = 64; // NOLINT(build/unsigned) elink of link l is l * 64, as FelixReaderModule tags them
+constexpr std::size_t burst_length = 32;
+constexpr double min_seconds = 0.2;
+
+/**
+ * @brief Stand-in for ElinkConcept: a virtual queue_in_block_address into a
+ * folly SPSC queue, like ElinkModel.
+ */
+class BenchElink
+{
+public:
+  virtual ~BenchElink() = default;
+  virtual bool queue_in_block_address(uint64_t block_addr) = 0; // NOLINT(build/unsigned)
+};
+
+class QueueElink : public BenchElink
+{
+public:
+  explicit QueueElink(std::size_t depth)
+    : m_queue(depth)
+  {}
+
+  bool queue_in_block_address(uint64_t block_addr) override { return m_queue.write(block_addr); } // NOLINT
+
+  std::size_t drain()
+  {
+    std::size_t n = 0;
+    uint64_t block_addr; // NOLINT(build/unsigned)
+    while (m_queue.read(block_addr)) {
+      ++n;
+    }
+    return n;
+  }
+
+private:
+  folly::ProducerConsumerQueue<uint64_t> m_queue; // NOLINT(build/unsigned)
+};
+
+/**
+ * @brief Hardware counters of the calling thread, user space only; reads
+ * -1 when perf_event_open is not permitted (containers, perf_event_paranoid).
+ */
+class PerfCounters
+{
+public:
+  PerfCounters()
+  {
+    for (auto config : { PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS }) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      m_fds.push_back(static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)));
+    }
+  }
+  ~PerfCounters()
+  {
+    for (int fd : m_fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+  PerfCounters(const PerfCounters&) = delete;            ///< PerfCounters is not copy-constructible
+  PerfCounters& operator=(const PerfCounters&) = delete; ///< PerfCounters is not copy-assignable
+  PerfCounters(PerfCounters&&) = delete;                 ///< PerfCounters is not move-constructible
+  PerfCounters& operator=(PerfCounters&&) = delete;      ///< PerfCounters is not move-assignable
+
+  void start()
+  {
+    for (int fd : m_fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+  void stop()
+  {
+    for (int fd : m_fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+  }
+  // Cache misses, cycles, instructions
+  std::vector<double> read() const
+  {
+    std::vector<double> values;
+    for (int fd : m_fds) {
+      uint64_t value = 0; // NOLINT(build/unsigned)
+      values.push_back(fd >= 0 && ::read(fd, &value, sizeof(value)) == sizeof(value) ? static_cast<double>(value) : -1);
+    }
+    return values;
+  }
+
+private:
+  std::vector<int> m_fds;
+};
+
+// Elink index of every block in the ring
+std::vector<std::size_t>
+make_pattern(const std::string& pattern, std::size_t n_elinks, std::size_t n_blocks)
+{
+  std::vector<std::size_t> order(n_blocks);
+  std::mt19937_64 rng(n_elinks);
+  const std::size_t hot = std::max<std::size_t>(1, n_elinks / 4);
+  for (std::size_t b = 0; b < n_blocks; ++b) {
+    if (pattern == "roundrobin") {
+      order[b] = b % n_elinks;
+    } else if (pattern == "burst") {
+      order[b] = (b / burst_length) % n_elinks;
+    } else if (pattern == "random") {
+      order[b] = rng() % n_elinks;
+    } else { // skewed: a quarter of the elinks carry 80% of the blocks
+      order[b] = (rng() % 5 != 0 || hot == n_elinks) ? rng() % hot : hot + rng() % (n_elinks - hot);
+    }
+  }
+  return order;
+}
+
+struct BenchCase
+{
+  std::string router;
+  std::size_t elinks;
+  std::string pattern;
+  std::size_t depth;
+};
+
+template<class Router>
+nlohmann::json
+bench_router(const BenchCase& bc, const std::vector<char>& ring, std::size_t n_blocks)
+{
+  std::map<int, std::shared_ptr<BenchElink>> elinks;
+  std::vector<QueueElink*> queues;
+  for (std::size_t l = 0; l < bc.elinks; ++l) {
+    auto elink = std::make_shared<QueueElink>(bc.depth);
+    queues.push_back(elink.get());
+    elinks[static_cast<int>(l * elink_stride)] = elink;
+  }
+  Router router(elinks);
+  std::function<void(uint64_t)> handle_block_addr = std::ref(router); // NOLINT(build/unsigned)
+
+  // The parsers: one thread takes the blocks off all queues
+  std::atomic<bool> draining{ true };
+  std::thread drainer([&]() {
+    while (draining.load(std::memory_order_relaxed)) {
+      std::size_t n = 0;
+      for (auto* queue : queues) {
+        n += queue->drain();
+      }
+      if (n == 0) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  auto route_all = [&]() {
+    for (std::size_t b = 0; b < n_blocks; ++b) {
+      handle_block_addr(reinterpret_cast<uint64_t>(ring.data() + b * block_size)); // NOLINT
+    }
+  };
+  route_all(); // warm-up
+  const uint64_t full_before = router.get_queue_full(); // NOLINT(build/unsigned)
+
+  PerfCounters perf;
+  std::size_t passes = 0;
+  double seconds = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  perf.start();
+  do {
+    route_all();
+    ++passes;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (seconds < min_seconds);
+  perf.stop();
+  draining = false;
+  drainer.join();
+
+  const double blocks = static_cast<double>(passes * n_blocks);
+  const auto counters = perf.read();
+  auto per_block = [&](double value) { return value < 0 ? -1 : value / blocks; };
+  nlohmann::json result;
+  result["router"] = bc.router;
+  result["elinks"] = bc.elinks;
+  result["pattern"] = bc.pattern;
+  result["queue_depth"] = bc.depth;
+  result["blocks"] = passes * n_blocks;
+  result["ns_per_block"] = seconds / blocks * 1e9;
+  result["cache_misses_per_block"] = per_block(counters[0]); // -1 where perf counters are unavailable
+  result["cycles_per_block"] = per_block(counters[1]);
+  result["instructions_per_block"] = per_block(counters[2]);
+  result["queue_full_fraction"] = (router.get_queue_full() - full_before) / blocks;
+  result["unknown_elink"] = router.get_unknown_elink();
+  return result;
+}
+
+std::vector<std::size_t>
+split_sizes(const std::string& arg)
+{
+  std::vector<std::size_t> values;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(std::stoul(item));
+  }
+  return values;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  std::string json_filename;
+  std::size_t ring_bytes = 64UL << 20;
+  std::vector<std::size_t> elink_counts = { 1, 6, 12, 24, 48 };
+  std::vector<std::size_t> depths = { 1000, 1000000 }; // 1000000: FelixReaderModule's block queue capacity
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_filename = argv[++i];
+    } else if (arg == "--ring-mb" && i + 1 < argc) {
+      ring_bytes = std::stoul(argv[++i]) << 20;
+    } else if (arg == "--elinks" && i + 1 < argc) {
+      elink_counts = split_sizes(argv[++i]);
+    } else if (arg == "--depths" && i + 1 < argc) {
+      depths = split_sizes(argv[++i]);
+    } else if (arg == "--quick") {
+      quick = true;
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--json FILE] [--ring-mb MB] [--elinks N1,N2,...] [--depths D1,D2,...]"
+             << " [--quick]";
+      return EXIT_FAILURE;
+    }
+  }
+  if (quick) {
+    elink_counts = { 12 };
+    depths = { 1000 };
+  }
+  const std::vector<std::string> patterns = { "roundrobin", "burst", "random", "skewed" };
+
+  // Only the headers of the blocks are read by the routers
+  const std::size_t n_blocks = ring_bytes / block_size;
+  std::vector<char> ring(n_blocks * block_size);
+
+  std::vector<nlohmann::json> results;
+  for (auto n_elinks : elink_counts) {
+    for (const auto& pattern : patterns) {
+      const auto order = make_pattern(pattern, n_elinks, n_blocks);
+      for (std::size_t b = 0; b < n_blocks; ++b) {
+        const uint32_t header = blockformat::make_header( // NOLINT(build/unsigned)
+          order[b] * elink_stride,
+          b,
+          blockformat::sob_32b_trailers);
+        std::memcpy(ring.data() + b * block_size, &header, sizeof(header));
+      }
+      for (auto depth : depths) {
+        for (std::string router : { "map", "array" }) {
+          BenchCase bc{ router, n_elinks, pattern, depth };
+          auto result = router == "map" ? bench_router<MapBlockRouter<BenchElink>>(bc, ring, n_blocks)
+                                        : bench_router<ArrayBlockRouter<BenchElink>>(bc, ring, n_blocks);
+          TLOG() << router << " router, " << n_elinks << " elinks, " << pattern << ", depth " << depth << ": "
+                 << result["ns_per_block"].get<double>() << " ns/block, "
+                 << result["cache_misses_per_block"].get<double>() << " cache misses/block, "
+                 << result["queue_full_fraction"].get<double>() * 100 << "% on full queues";
+          results.push_back(std::move(result));
+        }
+      }
+    }
+  }
+
+  if (!json_filename.empty()) {
+    std::ofstream out(json_filename);
+    for (const auto& result : results) {
+      out << result.dump() << '\n';
+    }
+    TLOG() << results.size() << " results written to " << json_filename;
+  }
+  return EXIT_SUCCESS;
+}
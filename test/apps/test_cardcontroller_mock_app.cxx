@@ -0,0 +1,148 @@
+/**
+ * @file test_cardcontroller_mock_app.cxx Runs the CardControllerWrapper
+ * init, configure, register access and alignment sequences against the
+ * in-memory mock card, checking the register file and timing each step.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "CardControllerWrapper.hpp"
+#include "FelixIssues.hpp"
+#include "MockCardInterface.hpp"
+#include "TestSupport.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+constexpr int n_iterations = 10000;
+
+template<typename F>
+double
+ns_per_call(F&& f, int n = n_iterations)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i) {
+    f();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+felixcardcontroller::LogicalUnit
+make_logical_unit(bool emu_fanout)
+{
+  felixcardcontroller::LogicalUnit lu;
+  lu.log_unit_id = 0;
+  lu.emu_fanout = emu_fanout;
+  lu.ignore_alignment_mask = { 5 };
+  for (uint32_t link = 0; link < 6; ++link) { // NOLINT(build/unsigned)
+    felixcardcontroller::Link li;
+    li.link_id = link;
+    li.enabled = link != 4;
+    li.dma_desc = 0;
+    li.superchunk_factor = 12;
+    lu.links.push_back(li);
+  }
+  return lu;
+}
+
+} // namespace
+
+int
+main(int /*argc*/, char** /*argv[]*/)
+{
+  auto card = std::make_unique<MockCardInterface>();
+  MockCardInterface* mock = card.get(); // owned by the wrapper from here on
+  CardControllerWrapper controller(0, std::move(card));
+  expect(mock->is_open(), "card opened by the constructor");
+
+  // Init
+  controller.init();
+  expect(mock->soft_resets() == 1, "init soft-resets the card once");
+  expect(controller.get_bitfield("MMCM_MAIN_LCLK_SEL") == 1, "init selects the local clock");
+  expect(controller.get_bitfield("GBT_SOFT_RESET") == 0, "init releases the GBT soft reset");
+
+  // Configure
+  auto lu = make_logical_unit(false);
+  double configure_ns = ns_per_call([&]() { controller.configure(lu); });
+  std::vector<std::string> link_bfs;
+  for (const auto& li : lu.links) {
+    link_bfs.push_back(link_bitfield("DECODING_LINK%02u_EGROUP0_CTRL_EPATH_ENA", li.link_id));
+    link_bfs.push_back(link_bitfield("SUPER_CHUNK_FACTOR_LINK_%02u", li.link_id));
+  }
+  auto link_values = controller.get_bitfields(link_bfs);
+  for (std::size_t i = 0; i < lu.links.size(); ++i) {
+    const auto& li = lu.links[i];
+    expect(link_values[2 * i] == (li.enabled ? 1 : 0), link_bfs[2 * i]);
+    if (li.enabled) {
+      expect(link_values[2 * i + 1] == li.superchunk_factor, link_bfs[2 * i + 1]);
+    }
+  }
+  expect(controller.get_bitfield("FE_EMU_ENA_EMU_TOHOST") == 0, "emulator off without fanout");
+
+  controller.configure(make_logical_unit(true));
+  expect(controller.get_bitfield("FE_EMU_ENA_EMU_TOHOST") == 1, "emulator on with fanout");
+  expect(controller.get_bitfield("GBT_TOHOST_FANOUT_SEL") == 0xffffff, "to-host fanout with emulator");
+
+  // Register access: one at a time against a batch of the same names
+  std::vector<std::string> bf_names(link_bfs.begin(), link_bfs.end());
+  double single_ns = ns_per_call([&]() {
+    for (const auto& name : bf_names) {
+      controller.get_bitfield(name);
+    }
+  });
+  double batch_ns = ns_per_call([&]() { controller.get_bitfields(bf_names); });
+
+  CardControllerWrapper::reg_val_pairs_t pairs;
+  for (const auto& name : bf_names) {
+    pairs.emplace_back(name, 1);
+  }
+  controller.set_bitfields(pairs);
+  for (auto value : controller.get_bitfields(bf_names)) {
+    expect(value == 1, "batch set/get round trip");
+  }
+
+  // A batch with an unknown or read-only name is rejected whole
+  auto rejected = [](auto&& write) {
+    try {
+      write();
+    } catch (const UnknownRegister&) {
+      return true;
+    } catch (const ReadOnlyRegister&) {
+      return true;
+    }
+    return false;
+  };
+  expect(rejected([&]() { controller.set_bitfields({ { bf_names.front(), 0 }, { "NO_SUCH_BITFIELD", 0 } }); }),
+         "unknown bitfield rejects the batch");
+  expect(controller.get_bitfield(bf_names.front()) == 1, "nothing of a rejected batch written");
+  expect(rejected([&]() { controller.set_registers({ { "GBT_ALIGNMENT_DONE", 0 } }); }),
+         "read-only register rejects the batch");
+
+  // Alignment: link 3 down, link 5 ignored
+  uint64_t aligned = 0x3f & ~(1ULL << 3) & ~(1ULL << 5); // NOLINT(build/unsigned)
+  mock->poke("GBT_ALIGNMENT_DONE", aligned);
+  expect(controller.get_alignment() == aligned, "alignment read through the cached handle");
+  double alignment_ns = ns_per_call([&]() { controller.get_alignment(); });
+  TLOG() << "Expecting one ChannelAlignment error, for link 3:";
+  controller.check_alignment(lu, controller.get_alignment());
+
+  // GTH reset
+  controller.gth_reset();
+  expect(mock->gth_resets() == 6, "GTH reset of every quad");
+
+  TLOG() << "configure: " << configure_ns << " ns, " << bf_names.size() << " bitfields one at a time: " << single_ns
+         << " ns, as a batch: " << batch_ns << " ns, alignment poll: " << alignment_ns << " ns";
+  return check_summary();
+}
@@ -0,0 +1,127 @@
+/**
+ * @file test_cardcontroller_module_app.cxx Runs the FelixCardController
+ * module through its conf and start commands and the link alignment
+ * monitor, with a mock card per device from its card factory, checking the
+ * register file of every device and timing the configuration.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "FelixCardController.hpp"
+#include "MockCardInterface.hpp"
+#include "TestSupport.hpp"
+
+#include "flxlibs/felixcardcontroller/Nljs.hpp"
+#include "flxlibs/felixcardcontroller/Structs.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+constexpr uint32_t n_logical_units = 2; // NOLINT(build/unsigned)
+constexpr uint64_t all_aligned = 0x3f;  // NOLINT(build/unsigned)
+
+felixcardcontroller::Conf
+make_conf()
+{
+  felixcardcontroller::Conf conf;
+  conf.card_id = 0;
+  conf.alignment_poll_ms = 10;
+  for (uint32_t lu_id = 0; lu_id < n_logical_units; ++lu_id) { // NOLINT(build/unsigned)
+    felixcardcontroller::LogicalUnit lu;
+    lu.log_unit_id = lu_id;
+    lu.emu_fanout = false;
+    lu.ignore_alignment_mask = { 5 };
+    for (uint32_t link = 0; link < 6; ++link) { // NOLINT(build/unsigned)
+      felixcardcontroller::Link li;
+      li.link_id = link;
+      li.enabled = link != 4;
+      li.dma_desc = 0;
+      li.superchunk_factor = 12;
+      lu.links.push_back(li);
+    }
+    conf.logical_units.push_back(lu);
+  }
+  return conf;
+}
+
+} // namespace
+
+int
+main(int /*argc*/, char** /*argv[]*/)
+{
+  // One mock card per device, aligned from the start; owned by the module's wrappers
+  std::mutex mocks_mutex;
+  std::map<uint32_t, MockCardInterface*> mocks; // NOLINT(build/unsigned)
+  FelixCardController controller("flxcardctrl_test");
+  controller.set_card_factory([&](uint32_t device_id) { // NOLINT(build/unsigned)
+    auto card = std::make_unique<MockCardInterface>();
+    card->poke("GBT_ALIGNMENT_DONE", all_aligned);
+    const std::lock_guard<std::mutex> lock(mocks_mutex);
+    mocks[device_id] = card.get();
+    return card;
+  });
+
+  // Conf: every device opened and configured, the whole card initialized once
+  auto conf = make_conf();
+  nlohmann::json args;
+  to_json(args, conf);
+  auto t0 = std::chrono::steady_clock::now();
+  controller.execute_command("conf", args);
+  double conf_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+  expect(mocks.size() == n_logical_units, "one card per logical unit");
+  unsigned soft_resets = 0;
+  for (const auto& lu : conf.logical_units) {
+    auto it = mocks.find(conf.card_id + lu.log_unit_id);
+    if (it == mocks.end()) {
+      continue;
+    }
+    MockCardInterface* mock = it->second;
+    const std::string device = "device " + std::to_string(it->first) + ": ";
+    expect(mock->is_open(), device + "card opened");
+    soft_resets += mock->soft_resets();
+    for (const auto& li : lu.links) {
+      auto epath_ena = link_bitfield("DECODING_LINK%02u_EGROUP0_CTRL_EPATH_ENA", li.link_id);
+      expect(mock->peek_bitfield(epath_ena) == (li.enabled ? 1 : 0), device + epath_ena);
+      if (li.enabled) {
+        auto factor = link_bitfield("SUPER_CHUNK_FACTOR_LINK_%02u", li.link_id);
+        expect(mock->peek_bitfield(factor) == li.superchunk_factor, device + factor);
+      }
+    }
+    expect(mock->peek_bitfield("FE_EMU_ENA_EMU_TOHOST") == 0, device + "emulator off");
+  }
+  expect(soft_resets == 1, "whole-card init done once, through one device");
+
+  // Start: GTH reset of the whole card
+  controller.execute_command("start", {});
+  unsigned gth_resets = 0;
+  for (const auto& [id, mock] : mocks) {
+    gth_resets += mock->gth_resets();
+  }
+  expect(gth_resets == 6, "GTH reset of every quad, once");
+
+  // Alignment monitor: link 3 of the last device goes down and comes back, link 5 is ignored
+  MockCardInterface* last = mocks.rbegin()->second;
+  TLOG() << "Expecting one ChannelAlignment warning for link 3, then its regained alignment:";
+  last->poke("GBT_ALIGNMENT_DONE", all_aligned & ~(1ULL << 3) & ~(1ULL << 5));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5 * conf.alignment_poll_ms));
+  last->poke("GBT_ALIGNMENT_DONE", all_aligned);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5 * conf.alignment_poll_ms));
+
+  TLOG() << "conf of " << n_logical_units << " logical units: " << conf_ms << " ms";
+  return check_summary();
+}
@@ -1,27 +1,29 @@
 /**
  * @file test_cardwrapper_app.cxx Test application for
- * CardWrapper. Inits, starts, stops the DMA transfer.
+ * CardWrapper. Configures, starts, stops the DMA transfer.
  * Also demonstrates the most basic block interpretation/handler callback.
  *
+ * Runs on a software DMA source (SoftwareDmaCard), so no FELIX card is needed.
+ *
  * This is part of the DUNE DAQ Application Framework, copyright 2020.
  * Licensing/copyright details are in the COPYING file that you should have
  * received with this code.
  */
 #include "CardWrapper.hpp"
+#include "SoftwareDmaCard.hpp"
 
 #include "logging/Logging.hpp"
 
-#include "regmap/regmap.h"
 #include "packetformat/block_format.hpp"
 
-#include <nlohmann/json.hpp>
-
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
-#include <ios>
+#include <thread>
 
 using namespace dunedaq::flxlibs;
 
@@ -38,14 +40,20 @@ main(int /*argc*/, char** /*argv[]*/)
     marker.store(false);
   });
 
-  nlohmann::json cmd_params = "{}"_json;
-
-  // REGMAP version. Who sets this!? Ask Mark why it's not redefined in the appropriate regmap header?
-  // TLOG() << "Regmap version is: 0x0" << std::hex << REGMAP_VERSION << std::dec;
-
-  // CardWrapper
+  // CardWrapper, on a software card with 5 links
   TLOG() << "Creating CardWrapper...";
-  CardWrapper flx;
+  auto card = std::make_unique<SoftwareDmaCard>();
+  SoftwareDmaCard* sw_card = card.get();
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = 64 << 20;
+  settings.poll_time = 100;
+  SoftwareDmaCard::SourceSettings source;
+  source.rate_bytes_per_s = 100e6;
+  for (unsigned link = 0; link < 5; ++link) {
+    settings.links_enabled.push_back(link);
+    source.elinks.push_back(link * 64);
+  }
+  CardWrapper flx(settings, std::move(card));
 
   // Set how block addresses should be handled
   std::map<unsigned, size_t> elink_block_counters;
@@ -64,14 +72,12 @@ main(int /*argc*/, char** /*argv[]*/)
 
   flx.set_block_addr_handler(count_block_addr);
 
-  TLOG() << "Init CardWrapper...";
-  flx.init(cmd_params);
-
   TLOG() << "Configure CardWrapper...";
-  flx.configure(cmd_params);
+  flx.configure();
 
   TLOG() << "Start CardWrapper...";
-  flx.start(cmd_params);
+  flx.start();
+  sw_card->start_source(settings.dma_id, source);
 
   TLOG() << "Flipping killswitch in order to stop...";
   if (killswitch.joinable()) {
@@ -79,13 +85,19 @@ main(int /*argc*/, char** /*argv[]*/)
   }
 
   TLOG() << "Stop CardWrapper...";
-  flx.stop(cmd_params);
+  sw_card->stop_source();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  flx.stop();
 
-  TLOG() << "Number of blocks DMA-d: " << block_counter << "-> Per elink: ";
+  auto source_stats = sw_card->get_source_stats();
+  TLOG() << "Number of blocks DMA-d: " << block_counter << " of " << source_stats.blocks_written
+         << " written -> Per elink: ";
   for (const auto& [elinkid, count] : elink_block_counters) {
     TLOG() << "  elink(" << std::to_string(elinkid) << "): " << std::to_string(count);
   }
 
   TLOG() << "Exiting.";
-  return 0;
+  return block_counter == source_stats.blocks_written && elink_block_counters.size() == source.elinks.size()
+           ? EXIT_SUCCESS
+           : EXIT_FAILURE;
 }
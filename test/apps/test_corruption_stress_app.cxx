@@ -0,0 +1,324 @@
+/**
+ * @file test_corruption_stress_app.cxx Parse rate of BlockParser<DefaultParserImpl>
+ * as a growing fraction of the blocks is corrupted, with the parser operations
+ * and error chunk capture of the readout wired in.
+ *
+ * Block streams from the software BlockEncoder are corrupted the ways the
+ * FelixReaderModule router lists: payload bit flips, random trailer words,
+ * error flags on trailers, foreign start of block markers (firmware format
+ * mismatch), zeroed blocks (unconnected links) and random garbage. Every
+ * corruption mode and fraction is timed against the clean stream; the test
+ * fails if a case is more than --max-slowdown times slower per block than
+ * the clean one, or if one pass stalls for --stall-seconds (watchdog).
+ * Results are also written as one JSON object per line (--json FILE).
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "DefaultParserImpl.hpp"
+#include "TestSupport.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+#include "flxlibs/BlockFormat.hpp"
+#include "flxlibs/ErrorChunkPool.hpp"
+
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/VariableSizePayloadTypeAdapter.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+#include "packetformat/block_parser.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+constexpr uint32_t stress_elink = 0; // NOLINT(build/unsigned)
+constexpr double min_seconds = 0.2;
+
+const std::vector<std::string> corruption_modes = { "payload", "trailer", "flags", "header", "zero", "garbage" };
+
+struct StressCase
+{
+  std::string op; // varsized_chunk or timestamped_chunk
+  std::size_t block_size;
+  bool trailer_32b;
+  std::size_t chunk_size;
+};
+
+// Positions of the trailers of a well formed block, walked back from its end
+std::vector<std::size_t>
+trailer_positions(const char* block, std::size_t block_size, bool trailer_32b)
+{
+  std::vector<std::size_t> positions;
+  const std::size_t tsize = blockformat::trailer_size(trailer_32b);
+  std::size_t pos = block_size;
+  while (pos >= blockformat::header_size + tsize) {
+    pos -= tsize;
+    uint32_t value = 0; // NOLINT(build/unsigned)
+    std::memcpy(&value, block + pos, tsize);
+    positions.push_back(pos);
+    const std::size_t length = blockformat::padded_length(blockformat::decode_trailer(value, trailer_32b).length, trailer_32b);
+    if (length > pos - blockformat::header_size) {
+      break;
+    }
+    pos -= length;
+  }
+  return positions;
+}
+
+void
+corrupt_block(char* block, const StressCase& sc, const std::string& mode, std::mt19937_64& rng)
+{
+  const std::size_t tsize = blockformat::trailer_size(sc.trailer_32b);
+  if (mode == "payload") {
+    for (int i = 0; i < 8; ++i) {
+      block[blockformat::header_size + rng() % (sc.block_size - blockformat::header_size)] ^= 1 << (rng() % 8);
+    }
+  } else if (mode == "trailer" || mode == "flags") {
+    auto positions = trailer_positions(block, sc.block_size, sc.trailer_32b);
+    if (positions.empty()) {
+      return;
+    }
+    const std::size_t pos = positions[rng() % positions.size()];
+    uint32_t value = static_cast<uint32_t>(rng()); // NOLINT(build/unsigned)
+    if (mode == "flags") {
+      std::memcpy(&value, block + pos, tsize);
+      auto trailer = blockformat::decode_trailer(value, sc.trailer_32b);
+      trailer.crc_error = rng() % 2;
+      trailer.error = rng() % 2;
+      trailer.truncated = !trailer.crc_error && !trailer.error ? true : rng() % 2;
+      value = blockformat::encode_trailer(trailer, sc.trailer_32b);
+    }
+    std::memcpy(block + pos, &value, tsize);
+  } else if (mode == "header") {
+    const uint32_t header = blockformat::make_header(stress_elink, 0, blockformat::start_of_block(!sc.trailer_32b)); // NOLINT
+    std::memcpy(block, &header, sizeof(header));
+  } else if (mode == "zero") {
+    std::memset(block, 0, sc.block_size);
+  } else {
+    for (std::size_t i = 0; i < sc.block_size; i += sizeof(uint64_t)) {
+      uint64_t value = rng(); // NOLINT(build/unsigned)
+      std::memcpy(block + i, &value, sizeof(value));
+    }
+  }
+}
+
+/**
+ * @brief Parses the stream the way ElinkModel does, with error chunk capture
+ * into a null sink, and times it. A watchdog aborts when a pass stalls.
+ */
+class StressParser
+{
+public:
+  using VarSize = fdreadoutlibs::types::VariableSizePayloadTypeAdapter;
+  using DAPHNE = fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter;
+
+  explicit StressParser(const StressCase& sc)
+    : m_case(sc)
+    , m_parser(std::make_unique<felix::packetformat::BlockParser<DefaultParserImpl>>(m_impl))
+  {
+    auto& stats = m_impl.get_local_stats();
+    if (sc.op == "timestamped_chunk") {
+      m_opts.check_timestamps = true;
+      m_impl.process_chunk_func = parsers::timestampedChunkInto<DAPHNE>(m_daphne_sink, stats, m_opts, 0);
+    } else {
+      m_impl.process_chunk_func = parsers::varsizedChunkIntoWrapper(m_varsize_sink, stats, m_opts);
+      m_impl.process_shortchunk_func = parsers::varsizedShortchunkIntoWrapper(m_varsize_sink, stats, m_opts);
+    }
+    m_impl.process_chunk_with_error_func =
+      parsers::errorChunkIntoSink(m_error_sink, m_error_pool, m_impl.get_block_header(), stats, m_opts);
+    m_impl.set_expected_sob(blockformat::start_of_block(sc.trailer_32b));
+    m_parser->configure(sc.block_size, sc.trailer_32b);
+  }
+
+  // Seconds per pass over the stream
+  double time(const std::vector<char>& blocks, std::atomic<uint64_t>& progress) // NOLINT(build/unsigned)
+  {
+    const std::size_t n_blocks = blocks.size() / m_case.block_size;
+    auto parse_all = [&]() {
+      for (std::size_t b = 0; b < n_blocks; ++b) {
+        const char* block = blocks.data() + b * m_case.block_size;
+        uint32_t header; // NOLINT(build/unsigned)
+        std::memcpy(&header, block, sizeof(header));
+        if (m_impl.accept_block_header(header)) {
+          m_parser->process(felix::packetformat::block_from_bytes(block));
+        } else { // as ElinkModel::reset_parser
+          m_parser->configure(m_case.block_size, m_case.trailer_32b);
+        }
+        m_impl.flush_local_stats();
+        progress.fetch_add(1, std::memory_order_relaxed);
+      }
+    };
+    parse_all(); // warm-up
+    std::size_t passes = 0;
+    double seconds = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do {
+      parse_all();
+      ++passes;
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (seconds < min_seconds);
+    return seconds / passes;
+  }
+
+  stats::ParserStatsSnapshot snapshot() { return m_impl.get_stats().snapshot(); }
+
+private:
+  StressCase m_case;
+  parsers::ParserOptions m_opts;
+  std::shared_ptr<iomanager::SenderConcept<VarSize>> m_varsize_sink = std::make_shared<NullSink<VarSize>>();
+  std::shared_ptr<iomanager::SenderConcept<DAPHNE>> m_daphne_sink = std::make_shared<NullSink<DAPHNE>>();
+  std::shared_ptr<iomanager::SenderConcept<ErrorChunkHandle>> m_error_sink =
+    std::make_shared<NullSink<ErrorChunkHandle>>();
+  std::shared_ptr<ErrorChunkPool> m_error_pool = std::make_shared<ErrorChunkPool>(16, 100);
+  DefaultParserImpl m_impl;
+  std::unique_ptr<felix::packetformat::BlockParser<DefaultParserImpl>> m_parser;
+};
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  std::string json_filename;
+  std::size_t stream_bytes = 16 * 1024 * 1024;
+  double max_slowdown = 3.0;
+  double stall_seconds = 10;
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_filename = argv[++i];
+    } else if (arg == "--stream-mb" && i + 1 < argc) {
+      stream_bytes = std::stoul(argv[++i]) * 1024 * 1024;
+    } else if (arg == "--max-slowdown" && i + 1 < argc) {
+      max_slowdown = std::stod(argv[++i]);
+    } else if (arg == "--stall-seconds" && i + 1 < argc) {
+      stall_seconds = std::stod(argv[++i]);
+    } else if (arg == "--quick") {
+      quick = true;
+    } else {
+      TLOG() << "Usage: " << argv[0]
+             << " [--json FILE] [--stream-mb N] [--max-slowdown X] [--stall-seconds S] [--quick]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Watchdog: the parser must never stop making progress, whatever the blocks hold
+  std::atomic<uint64_t> progress{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<bool> done{ false };
+  std::thread watchdog([&]() {
+    uint64_t last = progress.load(); // NOLINT(build/unsigned)
+    auto last_change = std::chrono::steady_clock::now();
+    while (!done.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      uint64_t now = progress.load(); // NOLINT(build/unsigned)
+      if (now != last) {
+        last = now;
+        last_change = std::chrono::steady_clock::now();
+      } else if (std::chrono::steady_clock::now() - last_change > std::chrono::duration<double>(stall_seconds)) {
+        TLOG() << "Parser stalled: no block parsed for " << stall_seconds << " s";
+        std::abort();
+      }
+    }
+  });
+
+  const std::vector<StressCase> cases = {
+    { "varsized_chunk", 1024, false, 64 },
+    { "varsized_chunk", 4096, true, 5568 },
+    { "timestamped_chunk", 4096, true, sizeof(fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter) },
+  };
+  const std::vector<double> fractions =
+    quick ? std::vector<double>{ 0.01, 1.0 } : std::vector<double>{ 0.001, 0.01, 0.1, 0.5, 1.0 };
+
+  std::vector<nlohmann::json> results;
+  bool bounded = true;
+  for (const auto& sc : cases) {
+    StreamSpec spec;
+    spec.elink = stress_elink;
+    spec.block_size = sc.block_size;
+    spec.trailer_32b = sc.trailer_32b;
+    spec.chunk_size = sc.chunk_size;
+    spec.timestamp_step = 32;
+    const auto clean = encode_stream(spec, stream_bytes).blocks;
+    const std::size_t n_blocks = clean.size() / sc.block_size;
+    const double clean_seconds = StressParser(sc).time(clean, progress);
+    TLOG() << sc.op << " block " << sc.block_size << "/" << (sc.trailer_32b ? 32 : 16) << "b chunk " << sc.chunk_size
+           << ": clean " << clean_seconds / n_blocks * 1e9 << " ns/block";
+
+    for (const auto& mode : corruption_modes) {
+      for (double fraction : fractions) {
+        auto blocks = clean;
+        std::mt19937_64 rng(n_blocks);
+        std::bernoulli_distribution pick(fraction);
+        std::size_t corrupted = 0;
+        for (std::size_t b = 0; b < n_blocks; ++b) {
+          if (pick(rng)) {
+            corrupt_block(blocks.data() + b * sc.block_size, sc, mode, rng);
+            ++corrupted;
+          }
+        }
+
+        StressParser parser(sc);
+        const double seconds = parser.time(blocks, progress);
+        const double slowdown = seconds / clean_seconds;
+        const auto snap = parser.snapshot();
+        bounded &= slowdown <= max_slowdown;
+
+        nlohmann::json result;
+        result["op"] = sc.op;
+        result["block_size"] = sc.block_size;
+        result["trailer_bits"] = sc.trailer_32b ? 32 : 16;
+        result["chunk_size"] = sc.chunk_size;
+        result["mode"] = mode;
+        result["fraction"] = fraction;
+        result["corrupted_blocks"] = corrupted;
+        result["ns_per_block"] = seconds / n_blocks * 1e9;
+        result["slowdown"] = slowdown;
+        result["error_blocks"] = snap.error_block_ctr;
+        result["error_chunks"] = snap.error_chunk_ctr + snap.error_short_ctr;
+        result["bad_headers"] = snap.bad_header_ctr;
+        result["errors_captured"] = snap.error_capture_ctr;
+        TLOG() << "  " << mode << " " << fraction * 100 << "%: " << result["ns_per_block"].get<double>()
+               << " ns/block, slowdown " << slowdown << (slowdown > max_slowdown ? " (OVER BOUND)" : "")
+               << ", error blocks " << snap.error_block_ctr << ", error chunks "
+               << snap.error_chunk_ctr + snap.error_short_ctr << ", bad headers " << snap.bad_header_ctr;
+        results.push_back(std::move(result));
+      }
+    }
+  }
+  done = true;
+  watchdog.join();
+
+  if (!json_filename.empty()) {
+    std::ofstream out(json_filename);
+    for (const auto& result : results) {
+      out << result.dump() << '\n';
+    }
+    TLOG() << results.size() << " results written to " << json_filename;
+  }
+  if (!bounded) {
+    TLOG() << "Parse rate under corruption fell below 1/" << max_slowdown << " of the clean rate";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,459 @@
+/**
+ * @file test_dma_pipeline_bench_app.cxx End-to-end timing of the FELIX
+ * readout pipeline on a software DMA source: CardWrapper process_DMA, the
+ * block router of FelixReaderModule, the per-elink block address queues,
+ * the ElinkModel parser threads and the payload queues behind them.
+ *
+ * Sweeps the number of links and the per-link rate. For every case it
+ * reports the aggregate throughput, per-elink latency percentiles (chunk
+ * generation on the card to payload pop from the queue) and where data is
+ * lost: ring overflow on the card, full block address queues, or payloads
+ * dropped by the parsers. The highest per-link rate without loss is the
+ * sustainable rate of one SLR on this server. The sweep is repeated for the
+ * DAPHNE, WIB and WIB2 superchunk payloads, each with the wiring of the elink
+ * registry. Every case is also written as one JSON object per line
+ * (--json FILE).
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "CardWrapper.hpp"
+#include "CreateElink.hpp"
+#include "ElinkModel.hpp"
+#include "SoftwareDmaCard.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "iomanager/queue/FollyQueue.hpp"
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+/**
+ * @brief Stand-in for a WIB-style superchunk adapter of fdreadoutlibs:
+ * NumFrames frames of FrameSize bytes, at a fixed tick stride. The parser
+ * only sees its size and stride, which are the same as the real one's.
+ */
+template<std::size_t FrameSize, std::size_t NumFrames, uint64_t TickDifference> // NOLINT(build/unsigned)
+struct LocalSuperChunk
+{
+  char data[FrameSize * NumFrames];
+
+  uint64_t get_timestamp() const // NOLINT(build/unsigned)
+  {
+    uint64_t ts; // NOLINT(build/unsigned)
+    std::memcpy(&ts, data, sizeof(ts));
+    return ts;
+  }
+  std::size_t get_num_frames() const { return NumFrames; }
+  static const constexpr uint64_t expected_tick_difference = TickDifference; // NOLINT(build/unsigned)
+};
+
+// WIB and WIB2 superchunks are timed with the fdreadoutlibs adapters where the release still ships them
+#ifdef FLXLIBS_WITH_PROTOWIB_SUPERCHUNK
+using wib_payload_t = fdreadoutlibs::types::ProtoWIBSuperChunkTypeAdapter;
+#else
+using wib_payload_t = LocalSuperChunk<464, 12, 25>;
+#endif
+#ifdef FLXLIBS_WITH_DUNEWIB_SUPERCHUNK
+using wib2_payload_t = fdreadoutlibs::types::DUNEWIBSuperChunkTypeAdapter;
+#else
+using wib2_payload_t = LocalSuperChunk<472, 12, 32>;
+#endif
+
+} // namespace
+
+// Stand-ins take the typestrings of the adapters they replace
+namespace dunedaq {
+#ifndef FLXLIBS_WITH_PROTOWIB_SUPERCHUNK
+DUNE_DAQ_TYPESTRING(wib_payload_t, "WIBFrame")
+#endif
+#ifndef FLXLIBS_WITH_DUNEWIB_SUPERCHUNK
+DUNE_DAQ_TYPESTRING(wib2_payload_t, "WIB2Frame")
+#endif
+} // namespace dunedaq
+
+namespace {
+
+constexpr std::size_t block_size = 4096;
+constexpr std::size_t max_latency_samples = 200000; // per elink and case
+
+/**
+ * @brief Sender into a local iomanager SPSC queue, standing in for the
+ * queue between a FelixReaderModule and its DataLinkHandler.
+ */
+template<typename Datatype>
+class LocalQueueSender : public iomanager::SenderConcept<Datatype>
+{
+public:
+  using queue_t = iomanager::FollySPSCQueue<Datatype>;
+
+  LocalQueueSender(const std::string& name, const std::string& data_type, std::size_t capacity)
+    : iomanager::SenderConcept<Datatype>(iomanager::ConnectionId{ name, data_type })
+    , m_queue(std::make_shared<queue_t>(name, capacity))
+  {}
+
+  void send(Datatype&& data, iomanager::Sender::timeout_t timeout) override { m_queue->push(std::move(data), timeout); }
+  bool try_send(Datatype&& data, iomanager::Sender::timeout_t timeout) override
+  {
+    return m_queue->try_push(std::move(data), timeout);
+  }
+  void send_with_topic(Datatype&& data, iomanager::Sender::timeout_t timeout, std::string /*topic*/) override
+  {
+    send(std::move(data), timeout);
+  }
+  void stop() override {}
+  bool is_ready_for_sending(iomanager::Sender::timeout_t /*timeout*/) override { return true; }
+
+  std::shared_ptr<queue_t>& get_queue() { return m_queue; }
+
+private:
+  std::shared_ptr<queue_t> m_queue;
+};
+
+struct Options
+{
+  std::vector<std::string> payloads{ "daphne", "wib", "wib2" };
+  std::vector<std::size_t> links{ 1, 2, 4, 6 };
+  std::vector<double> rates_mbps{ 100, 200, 400, 800, 1600 }; // per link, MB/s
+  double seconds{ 2.0 };
+  std::size_t ring_mb{ 64 };
+  std::size_t block_threshold{ 256 };
+  std::size_t poll_us{ 100 };
+  bool interrupt_mode{ false };
+  std::size_t block_queue_capacity{ 1000000 };
+  std::size_t payload_queue_capacity{ 100000 };
+  std::string json_file;
+};
+
+struct Percentiles
+{
+  double p50{ 0 };
+  double p99{ 0 };
+  double p999{ 0 };
+  double max{ 0 };
+};
+
+Percentiles
+percentiles(std::vector<int64_t>& samples)
+{
+  Percentiles p;
+  if (samples.empty()) {
+    return p;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double q) { return samples[static_cast<std::size_t>(q * (samples.size() - 1))] / 1000.; };
+  p.p50 = at(0.5);
+  p.p99 = at(0.99);
+  p.p999 = at(0.999);
+  p.max = samples.back() / 1000.;
+  return p;
+}
+
+nlohmann::json
+to_json(const Percentiles& p)
+{
+  return { { "p50_us", p.p50 }, { "p99_us", p.p99 }, { "p999_us", p.p999 }, { "max_us", p.max } };
+}
+
+// One elink: parser, payload queue, and the consumer that timestamps what comes out of it
+template<class Payload>
+struct ElinkPipeline
+{
+  std::unique_ptr<ElinkModel<Payload>> model;
+  std::shared_ptr<LocalQueueSender<Payload>> sink;
+  std::thread consumer;
+  uint64_t consumed{ 0 }; // NOLINT(build/unsigned)
+  std::vector<int64_t> latency_ns;
+};
+
+template<class Payload>
+void
+consume(ElinkPipeline<Payload>& p, std::atomic<bool>& running, std::size_t sample_stride)
+{
+  Payload payload;
+  auto& queue = p.sink->get_queue();
+  // After the stop, keep going until the queue is empty
+  while (true) {
+    if (!queue->try_pop(payload, std::chrono::milliseconds(1))) {
+      if (!running.load()) {
+        break;
+      }
+      continue;
+    }
+    if (p.consumed++ % sample_stride == 0 && p.latency_ns.size() < max_latency_samples) {
+      int64_t stamp;
+      std::memcpy(&stamp, &payload.data, sizeof(stamp));
+      int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+      p.latency_ns.push_back(now - stamp);
+    }
+  }
+}
+
+template<class Payload, class Wiring>
+nlohmann::json
+run_case(const Options& opts, const std::string& payload_name, std::size_t n_links, double rate_mbps)
+{
+  auto card = std::make_unique<SoftwareDmaCard>();
+  SoftwareDmaCard* sw_card = card.get();
+
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = opts.ring_mb * 1024 * 1024;
+  settings.block_threshold = opts.block_threshold;
+  settings.interrupt_mode = opts.interrupt_mode;
+  settings.poll_time = opts.poll_us;
+  for (std::size_t l = 0; l < n_links; ++l) {
+    settings.links_enabled.push_back(l);
+  }
+  CardWrapper card_wrapper(settings, std::move(card));
+
+  // Elinks as FelixReaderModule sets them up: link l is elink l*64
+  const double chunks_per_s = rate_mbps * 1e6 / sizeof(Payload);
+  const std::size_t sample_stride = std::max<std::size_t>(1, chunks_per_s * opts.seconds / max_latency_samples);
+  parsers::ParserOptions parser_opts;
+  std::map<uint32_t, ElinkPipeline<Payload>> elinks; // NOLINT(build/unsigned)
+  SoftwareDmaCard::SourceSettings source;
+  source.block_size = block_size;
+  source.chunk_size = sizeof(Payload);
+  source.rate_bytes_per_s = rate_mbps * 1e6 * n_links;
+  for (std::size_t l = 0; l < n_links; ++l) {
+    auto elink = static_cast<uint32_t>(l * 64); // NOLINT(build/unsigned)
+    auto& p = elinks[elink];
+    p.model = std::make_unique<ElinkModel<Payload>>();
+    p.model->set_ids(0, 0, static_cast<int>(l), 0);
+    p.model->init(opts.block_queue_capacity);
+    p.sink = std::make_shared<LocalQueueSender<Payload>>(
+      "elink-" + std::to_string(elink), payload_name, opts.payload_queue_capacity);
+    p.model->set_sink(p.sink);
+    Wiring::wire(*p.model, parser_opts);
+    p.model->conf(block_size, true);
+    source.elinks.push_back(elink);
+  }
+
+  // Block router of FelixReaderModule, counting what it can't hand on
+  std::atomic<uint64_t> unknown_elink{ 0 };    // NOLINT(build/unsigned)
+  std::atomic<uint64_t> block_queue_full{ 0 }; // NOLINT(build/unsigned)
+  std::function<void(uint64_t)> block_router = [&](uint64_t block_addr) { // NOLINT(build/unsigned)
+    const auto* block = felix::packetformat::block_from_bytes(reinterpret_cast<const char*>(block_addr)); // NOLINT
+    auto it = elinks.find(block->elink);
+    if (it == elinks.end()) {
+      unknown_elink++;
+    } else if (!it->second.model->queue_in_block_address(block_addr)) {
+      block_queue_full++;
+    }
+  };
+  card_wrapper.set_block_addr_handler(block_router);
+  card_wrapper.configure();
+
+  std::atomic<bool> consuming{ true };
+  for (auto& [elink, p] : elinks) {
+    p.latency_ns.reserve(max_latency_samples);
+    p.consumer = std::thread(consume<Payload>, std::ref(p), std::ref(consuming), sample_stride);
+    p.model->start();
+  }
+  card_wrapper.start();
+
+  auto t0 = std::chrono::steady_clock::now();
+  sw_card->start_source(settings.dma_id, source);
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.seconds));
+  sw_card->stop_source();
+  double source_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // Let the pipeline drain what is in the ring and the queues
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  card_wrapper.stop();
+  for (auto& [elink, p] : elinks) {
+    p.model->stop();
+  }
+  consuming = false;
+  for (auto& [elink, p] : elinks) {
+    p.consumer.join();
+  }
+
+  // Results
+  auto source_stats = sw_card->get_source_stats();
+  uint64_t consumed = 0;        // NOLINT(build/unsigned)
+  uint64_t dropped_payloads = 0; // NOLINT(build/unsigned)
+  std::vector<int64_t> all_latency;
+  nlohmann::json per_elink = nlohmann::json::array();
+  for (auto& [elink, p] : elinks) {
+    auto snap = p.model->get_parser().get_stats().snapshot();
+    consumed += p.consumed;
+    dropped_payloads += snap.dropped_payload_ctr;
+    all_latency.insert(all_latency.end(), p.latency_ns.begin(), p.latency_ns.end());
+    per_elink.push_back({ { "elink", elink },
+                          { "payloads", p.consumed },
+                          { "dropped_payloads", snap.dropped_payload_ctr },
+                          { "latency", to_json(percentiles(p.latency_ns)) } });
+  }
+  Percentiles latency = percentiles(all_latency);
+
+  const double offered = rate_mbps * n_links;
+  const double achieved = source_stats.bytes / source_seconds / 1e6;
+  const double throughput = consumed * sizeof(Payload) / source_seconds / 1e6;
+  // Less than the block threshold can stay in the ring at the end, so missing payloads alone are no loss
+  const bool lossless =
+    source_stats.blocks_dropped == 0 && block_queue_full == 0 && unknown_elink == 0 && dropped_payloads == 0;
+
+  nlohmann::json result = { { "payload", payload_name },
+                            { "payload_bytes", sizeof(Payload) },
+                            { "links", n_links },
+                            { "rate_per_link_mbps", rate_mbps },
+                            { "offered_mbps", offered },
+                            { "source_mbps", achieved },
+                            { "source_limited", achieved < 0.95 * offered },
+                            { "throughput_mbps", throughput },
+                            { "chunks", source_stats.chunks },
+                            { "payloads", consumed },
+                            { "undelivered_chunks", source_stats.chunks - consumed },
+                            { "ring_dropped_blocks", source_stats.blocks_dropped },
+                            { "block_queue_full", block_queue_full.load() },
+                            { "unknown_elink_blocks", unknown_elink.load() },
+                            { "dropped_payloads", dropped_payloads },
+                            { "lossless", lossless },
+                            { "latency", to_json(latency) },
+                            { "elinks", per_elink } };
+
+  TLOG() << payload_name << ", " << n_links << " links x " << rate_mbps << " MB/s: source " << achieved << " MB/s, out " << throughput
+         << " MB/s, latency p50/p99/p99.9 " << latency.p50 << "/" << latency.p99 << "/" << latency.p999 << " us"
+         << (lossless ? "" : ", LOSS")
+         << (lossless ? "" : " (ring " + std::to_string(source_stats.blocks_dropped) + " blocks, queues " +
+                               std::to_string(block_queue_full.load()) + " blocks, parser " +
+                               std::to_string(dropped_payloads) + " payloads)")
+         << (achieved < 0.95 * offered ? ", source limited" : "");
+  return result;
+}
+
+using run_case_t = nlohmann::json (*)(const Options&, const std::string&, std::size_t, double);
+
+// Payloads of the sweep, with the wiring the elink registry gives them
+const std::map<std::string, run_case_t> payload_cases = {
+  { "daphne", &run_case<fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter, wiring::MonotonicSuperchunk> },
+  { "wib", &run_case<wib_payload_t, wiring::StridedSuperchunk> },
+  { "wib2", &run_case<wib2_payload_t, wiring::StridedSuperchunk> },
+};
+
+template<typename T>
+std::vector<T>
+parse_list(const std::string& arg)
+{
+  std::vector<T> values;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(static_cast<T>(std::stod(item)));
+  }
+  return values;
+}
+
+std::vector<std::string>
+split(const std::string& arg)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--payloads" && has_value) {
+      opts.payloads = split(argv[++i]);
+    } else if (arg == "--links" && has_value) {
+      opts.links = parse_list<std::size_t>(argv[++i]);
+    } else if (arg == "--rates" && has_value) {
+      opts.rates_mbps = parse_list<double>(argv[++i]);
+    } else if (arg == "--seconds" && has_value) {
+      opts.seconds = std::stod(argv[++i]);
+    } else if (arg == "--ring-mb" && has_value) {
+      opts.ring_mb = std::stoul(argv[++i]);
+    } else if (arg == "--block-threshold" && has_value) {
+      opts.block_threshold = std::stoul(argv[++i]);
+    } else if (arg == "--poll-us" && has_value) {
+      opts.poll_us = std::stoul(argv[++i]);
+    } else if (arg == "--interrupt") {
+      opts.interrupt_mode = true;
+    } else if (arg == "--json" && has_value) {
+      opts.json_file = argv[++i];
+    } else if (arg == "--quick") {
+      opts.links = { 1, 4 };
+      opts.rates_mbps = { 100, 400 };
+      opts.seconds = 0.5;
+    } else {
+      TLOG() << "Usage: " << argv[0]
+             << " [--payloads daphne,wib,wib2] [--links 1,2,4,6] [--rates 100,200,400 (MB/s per link)] [--seconds S] [--ring-mb N]"
+             << " [--block-threshold BLOCKS] [--poll-us US] [--interrupt] [--json FILE] [--quick]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::ofstream json_out;
+  if (!opts.json_file.empty()) {
+    json_out.open(opts.json_file);
+  }
+
+  for (const auto& payload : opts.payloads) {
+    if (payload_cases.count(payload) == 0) {
+      TLOG() << "Unknown payload type " << payload;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::sort(opts.rates_mbps.begin(), opts.rates_mbps.end());
+  for (const auto& payload : opts.payloads) {
+    auto run = payload_cases.at(payload);
+    for (auto n_links : opts.links) {
+      double sustainable = 0;
+      for (auto rate : opts.rates_mbps) {
+        auto result = run(opts, payload, n_links, rate);
+        if (json_out.is_open()) {
+          json_out << result.dump() << std::endl;
+        }
+        if (!result["lossless"].get<bool>()) {
+          break; // past the threshold; higher rates only lose more
+        }
+        sustainable = rate;
+      }
+      TLOG() << payload << ", " << n_links << " links: highest lossless rate " << sustainable << " MB/s per link, "
+             << sustainable * n_links << " MB/s per SLR";
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -2,29 +2,78 @@
  * @file test_elinkhandler_app.cxx Test application for
  * ElinkConcept and ElinkModel. Inits, starts, stops block parsers.
  *
+ * Runs on a software DMA source (SoftwareDmaCard), so no FELIX card is needed.
+ *
  * This is part of the DUNE DAQ Application Framework, copyright 2020.
  * Licensing/copyright details are in the COPYING file that you should have
  * received with this code.
  */
 #include "CardWrapper.hpp"
 #include "CreateElink.hpp"
-#include "ElinkConcept.hpp"
+#include "ElinkModel.hpp"
+#include "SoftwareDmaCard.hpp"
 #include "flxlibs/AvailableParserOperations.hpp"
 
-#include "logging/Logging.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
 
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
 
 #include "packetformat/block_format.hpp"
-#include <nlohmann/json.hpp>
 
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <utility>
 
+using namespace dunedaq;
 using namespace dunedaq::flxlibs;
-using namespace dunedaq::fdreadoutlibs;
+
+namespace {
+
+using payload_t = fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter;
+
+/**
+ * @brief Counts the payloads it is given and discards them.
+ */
+class CountingSink : public iomanager::SenderConcept<payload_t>
+{
+public:
+  CountingSink()
+    : iomanager::SenderConcept<payload_t>(iomanager::ConnectionId{ "elinkhandler_sink", "ElinkHandler" })
+  {}
+
+  void send(payload_t&& data, iomanager::Sender::timeout_t /*timeout*/) override { consume(std::move(data)); }
+  bool try_send(payload_t&& data, iomanager::Sender::timeout_t /*timeout*/) override
+  {
+    consume(std::move(data));
+    return true;
+  }
+  void send_with_topic(payload_t&& data, iomanager::Sender::timeout_t /*timeout*/, std::string /*topic*/) override
+  {
+    consume(std::move(data));
+  }
+  void stop() override {}
+  bool is_ready_for_sending(iomanager::Sender::timeout_t /*timeout*/) override { return true; }
+
+  uint64_t get_payloads() const { return m_payloads.load(); } // NOLINT(build/unsigned)
+
+private:
+  void consume(payload_t&& data)
+  {
+    payload_t dropped(std::move(data));
+    m_payloads.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> m_payloads{ 0 }; // NOLINT(build/unsigned)
+};
+
+} // namespace
 
 int
 main(int /*argc*/, char** /*argv[]*/)
@@ -39,25 +88,38 @@ main(int /*argc*/, char** /*argv[]*/)
     marker.store(false);
   });
 
-  // Dummy command
-  nlohmann::json cmd_params = "{}"_json;
-
   // Counter
   std::atomic<int> block_counter{ 0 };
 
-  // CardWrapper
+  // CardWrapper, on a software card
   TLOG() << "Creating CardWrapper...";
-  CardWrapper flx;
-  std::map<int, std::unique_ptr<ElinkConcept>> elinks;
+  auto card = std::make_unique<SoftwareDmaCard>();
+  SoftwareDmaCard* sw_card = card.get();
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = 64 << 20;
+  settings.poll_time = 100;
+  SoftwareDmaCard::SourceSettings source;
+  source.chunk_size = sizeof(payload_t);
+  source.rate_bytes_per_s = 100e6;
+  std::map<int, std::unique_ptr<ElinkModel<payload_t>>> elinks;
+  std::map<int, std::shared_ptr<CountingSink>> sinks;
 
   // 5 elink handlers
+  parsers::ParserOptions parser_opts;
   for (int i = 0; i < 5; ++i) {
-    elinks[i * 64] = createElinkModel("wib");
+    settings.links_enabled.push_back(i);
+    source.elinks.push_back(i * 64);
+    elinks[i * 64] = std::make_unique<ElinkModel<payload_t>>();
     auto& handler = elinks[i * 64];
-    handler->init(cmd_params, 100000);
-    handler->conf(cmd_params, 4096, true);
-    handler->start(cmd_params);
+    handler->set_ids(0, 0, i, i * 64);
+    handler->init(100000);
+    sinks[i * 64] = std::make_shared<CountingSink>();
+    handler->set_sink(sinks[i * 64]);
+    wiring::MonotonicSuperchunk::wire(*handler, parser_opts);
+    handler->conf(4096, true);
+    handler->start();
   }
+  CardWrapper flx(settings, std::move(card));
 
   // Modify a specific elink handler
   bool first = true;
@@ -91,14 +153,12 @@ main(int /*argc*/, char** /*argv[]*/)
   // Set this function as the handler of blocks.
   flx.set_block_addr_handler(count_block_addr);
 
-  TLOG() << "Init CardWrapper...";
-  flx.init(cmd_params);
-
   TLOG() << "Configure CardWrapper...";
-  flx.configure(cmd_params);
+  flx.configure();
 
   TLOG() << "Start CardWrapper...";
-  flx.start(cmd_params);
+  flx.start();
+  sw_card->start_source(settings.dma_id, source);
 
   TLOG() << "Flipping killswitch in order to stop...";
   if (killswitch.joinable()) {
@@ -106,15 +166,24 @@ main(int /*argc*/, char** /*argv[]*/)
   }
 
   TLOG() << "Stop CardWrapper...";
-  flx.stop(cmd_params);
+  sw_card->stop_source();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  flx.stop();
 
   TLOG() << "Stop ElinkHandlers...";
   for (auto const& [tag, handler] : elinks) {
-    handler->stop(cmd_params);
+    handler->stop();
   }
 
-  TLOG() << "Number of blocks DMA-d: " << block_counter;
+  uint64_t payloads = 0; // NOLINT(build/unsigned)
+  for (auto const& [tag, sink] : sinks) {
+    payloads += sink->get_payloads();
+  }
+  auto source_stats = sw_card->get_source_stats();
+  TLOG() << "Number of blocks DMA-d: " << block_counter << ", payloads: " << payloads << " of "
+         << source_stats.chunks << " chunks";
 
   TLOG() << "Exiting.";
-  return 0;
+  // Chunks still in flight at stop may be cut short, but nothing is made up
+  return payloads > 0 && payloads <= source_stats.chunks ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,136 @@
+/**
+ * @file test_emu_pattern_app.cxx Checks the table-driven CRC-20 against the
+ * bit-serial reference of the original emu_confgen, for both polynomials,
+ * and the chunks that come back out of generated EMU RAM images.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "TestSupport.hpp"
+
+#include "flxlibs/Crc20.hpp"
+#include "flxlibs/EmuPatternGenerator.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+// The bit-serial CRC-20 of emu_confgen before it moved to Crc20.hpp, unchanged
+uint64_t                                                    // NOLINT(build/unsigned)
+reference_crc20(const uint64_t* data, uint64_t length, bool crc_new) // NOLINT(build/unsigned)
+{
+  constexpr uint64_t crc_width = 20;                    // NOLINT(build/unsigned)
+  constexpr uint64_t crc_mask = ((1 << crc_width) - 1); // NOLINT(build/unsigned)
+  uint64_t crc = 0xFFFFF;                               // NOLINT(build/unsigned)
+  uint64_t polynomial = crc_new ? 0x8359F : 0xC1ACF;    // NOLINT(build/unsigned)
+
+  unsigned int i, k; // NOLINT
+  for (k = 0; k < crc_width; ++k) {
+    if ((crc & 1)) {
+      crc = (crc >> 1) ^ ((1 << (crc_width - 1)) | (polynomial >> 1));
+    } else {
+      crc = (crc >> 1);
+    }
+  }
+  for (i = 0; i < length; i++) {
+    for (k = 1; k <= 32; k++) {
+      if (crc & (1 << (crc_width - 1))) {
+        crc = ((crc << 1) | ((data[i] >> (32 - k)) & 1)) ^ polynomial;
+      } else {
+        crc = ((crc << 1) | ((data[i] >> (32 - k)) & 1));
+      }
+    }
+    crc &= crc_mask;
+  }
+  for (k = 0; k < crc_width; k++) {
+    if (crc & (1 << (crc_width - 1))) {
+      crc = (crc << 1) ^ polynomial;
+    } else {
+      crc = (crc << 1);
+    }
+  }
+  crc &= crc_mask;
+  return crc;
+}
+
+} // namespace
+
+int
+main(int /*argc*/, char** /*argv[]*/)
+{
+  // Random words of every length up to 256, with K-character bits above the data as in EMU RAM
+  std::mt19937_64 rng(1);
+  for (bool crc_new : { false, true }) {
+    const std::string poly = crc_new ? "new polynomial" : "old polynomial";
+    int mismatches = 0;
+    for (std::size_t n = 0; n <= 256; ++n) {
+      std::vector<uint64_t> words(n);  // NOLINT(build/unsigned)
+      std::vector<uint32_t> low(n);    // NOLINT(build/unsigned)
+      for (std::size_t i = 0; i < n; ++i) {
+        words[i] = rng() & 0x1FFFFFFFF;
+        low[i] = static_cast<uint32_t>(words[i]); // NOLINT(build/unsigned)
+      }
+      const uint64_t expected = reference_crc20(words.data(), n, crc_new); // NOLINT(build/unsigned)
+      mismatches += crc::crc20(words.data(), n, crc_new) != expected;
+      mismatches += crc::crc20(low.data(), n, crc_new) != expected;
+    }
+    expect(mismatches == 0, "CRC-20 matches the bit-serial reference, " + poly);
+  }
+
+  // Timing on a full EMU RAM image
+  std::vector<uint64_t> image(emu::emu_ram_size); // NOLINT(build/unsigned)
+  for (auto& word : image) {
+    word = rng() & 0xFFFFFFFF;
+  }
+  constexpr int n_iterations = 100;
+  uint64_t sink = 0; // NOLINT(build/unsigned)
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_iterations; ++i) {
+    image[0] = i; // no two calls alike, so none is hoisted out of the loop
+    sink += reference_crc20(image.data(), image.size(), true);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_iterations; ++i) {
+    image[0] = i;
+    sink += crc::crc20(image.data(), image.size(), true);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  const double reference_us = std::chrono::duration<double, std::micro>(t1 - t0).count() / n_iterations;
+  const double table_us = std::chrono::duration<double, std::micro>(t2 - t1).count() / n_iterations;
+
+  // Images: every generated chunk comes back out, except the ones with injected errors
+  for (uint32_t chunk_size : { 16, 464, 4096 }) { // NOLINT(build/unsigned)
+    for (bool crc_new : { false, true }) {
+      emu::EmuPatternConfig config;
+      config.chunk_size = chunk_size;
+      config.crc_new = crc_new;
+      auto generated = emu::generate_emu_image(config);
+      auto chunks = emu::emu_image_chunks(generated);
+      const std::string what = "chunks of a " + std::to_string(chunk_size) + " byte image";
+      expect(chunks.size() == generated.chunks, what);
+      bool sizes = true;
+      for (const auto& chunk : chunks) {
+        sizes = sizes && chunk.size() == chunk_size;
+      }
+      expect(sizes, what + ", sizes");
+    }
+  }
+  emu::EmuPatternConfig config;
+  config.add_crc_err = true;
+  auto generated = emu::generate_emu_image(config);
+  expect(emu::emu_image_chunks(generated).size() == generated.chunks - 1, "chunk with a CRC error left out");
+
+  TLOG() << "CRC-20 of " << image.size() << " words: bit-serial " << reference_us << " us, table " << table_us
+         << " us (" << (sink & 1) << ")";
+  return check_summary();
+}
@@ -0,0 +1,160 @@
+/**
+ * @file test_gather_bench_app.cxx Benchmark of the subchunk gather kernels
+ * against the legacy dump_to_buffer loop, for typical FELIX subchunk layouts.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "flxlibs/AvailableParserOperations.hpp"
+#include "flxlibs/GatherKernels.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+constexpr std::size_t block_header_size = 4;
+constexpr std::size_t ring_size = 256 * 1024 * 1024;
+
+struct Layout
+{
+  std::string name;
+  std::size_t payload_size;
+  std::size_t block_size;
+  std::size_t trailer_size;
+};
+
+struct ChunkDescriptor
+{
+  std::vector<const char*> data;
+  std::vector<unsigned> sizes;
+};
+
+// Places consecutive chunks into consecutive blocks of the ring, the way the
+// firmware fills to-host blocks: every block carries a header, and every
+// subchunk is followed by a trailer.
+std::vector<ChunkDescriptor>
+lay_out_chunks(const char* ring, const Layout& layout, std::size_t n_chunks)
+{
+  std::vector<ChunkDescriptor> chunks(n_chunks);
+  std::size_t block = 0;
+  std::size_t offset = block_header_size;
+  const std::size_t n_blocks = ring_size / layout.block_size;
+  for (auto& chunk : chunks) {
+    std::size_t left = layout.payload_size;
+    while (left > 0) {
+      if (layout.block_size - offset <= layout.trailer_size) {
+        block = (block + 1) % n_blocks;
+        offset = block_header_size;
+      }
+      std::size_t room = layout.block_size - offset - layout.trailer_size;
+      std::size_t piece = std::min(left, room);
+      chunk.data.push_back(ring + block * layout.block_size + offset);
+      chunk.sizes.push_back(static_cast<unsigned>(piece));
+      offset += (piece + layout.trailer_size - 1) / layout.trailer_size * layout.trailer_size + layout.trailer_size;
+      left -= piece;
+    }
+  }
+  return chunks;
+}
+
+template<class Kernel>
+double
+run(const std::vector<ChunkDescriptor>& chunks, char* dst, std::size_t dst_size, unsigned rounds, Kernel&& kernel)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for (unsigned r = 0; r < rounds; ++r) {
+    for (const auto& chunk : chunks) {
+      kernel(chunk, dst, dst_size);
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// 12 frames of 464 (WIB) and 472 (WIB2) bytes per superchunk
+constexpr std::size_t wib_superchunk_size = 12 * 464;
+constexpr std::size_t wib2_superchunk_size = 12 * 472;
+
+template<std::size_t Size>
+void
+bench_fixed_size(const std::string& name, const char* ring, unsigned rounds)
+{
+  Layout layout{ name, Size, 4096, 4 };
+  std::size_t n_chunks = (ring_size / 2) / Size;
+  auto chunks = lay_out_chunks(ring, layout, n_chunks);
+  std::unique_ptr<char[]> dst(new char[Size]);
+  double bytes = static_cast<double>(Size) * n_chunks * rounds;
+
+  double generic_s = run(chunks, dst.get(), Size, rounds, [](const ChunkDescriptor& c, char* d, std::size_t s) {
+    parsers::gather_subchunks(c.data.data(), c.sizes.data(), c.data.size(), d, s);
+  });
+  double fixed_s = run(chunks, dst.get(), Size, rounds, [](const ChunkDescriptor& c, char* d, std::size_t /*s*/) {
+    parsers::gather_fixed_size<Size>(c.data.data(), c.sizes.data(), c.data.size(), d);
+  });
+
+  TLOG() << name << " payload=" << Size << "B | gather_subchunks: " << bytes / generic_s / 1e9
+         << " GB/s | gather_fixed_size: " << bytes / fixed_s / 1e9 << " GB/s, "
+         << fixed_s * 1e9 / (n_chunks * rounds) << " ns/chunk";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  unsigned rounds = (argc > 1) ? std::atoi(argv[1]) : 10; // NOLINT
+
+  std::vector<Layout> layouts = {
+    { "DAPHNE", sizeof(dunedaq::fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter), 4096, 4 },
+    { "DAPHNEStream", sizeof(dunedaq::fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter), 4096, 4 },
+    { "varsize-256B-1k", 256, 1024, 2 },
+    { "varsize-16kB-4k", 16 * 1024, 4096, 4 },
+    { "varsize-4MB-4k", 4 * 1024 * 1024, 4096, 4 },
+  };
+
+  std::unique_ptr<char[]> ring(new char[ring_size]);
+  for (std::size_t i = 0; i < ring_size; ++i) {
+    ring[i] = static_cast<char>(i);
+  }
+
+  for (const auto& layout : layouts) {
+    std::size_t n_chunks = std::max<std::size_t>(1, (ring_size / 2) / layout.payload_size);
+    auto chunks = lay_out_chunks(ring.get(), layout, n_chunks);
+    std::unique_ptr<char[]> dst(new char[layout.payload_size]);
+    double bytes = static_cast<double>(layout.payload_size) * n_chunks * rounds;
+
+    double legacy_s = run(chunks, dst.get(), layout.payload_size, rounds, [](const ChunkDescriptor& c, char* d, std::size_t s) {
+      uint32_t bytes_copied_chunk = 0; // NOLINT(build/unsigned)
+      for (unsigned i = 0; i < c.data.size(); ++i) {
+        parsers::dump_to_buffer(c.data[i], c.sizes[i], d, bytes_copied_chunk, s);
+        bytes_copied_chunk += c.sizes[i];
+      }
+    });
+    double gather_s = run(chunks, dst.get(), layout.payload_size, rounds, [](const ChunkDescriptor& c, char* d, std::size_t s) {
+      parsers::gather_subchunks(c.data.data(), c.sizes.data(), c.data.size(), d, s);
+    });
+
+    TLOG() << layout.name << " payload=" << layout.payload_size << "B subchunks/chunk=" << chunks.front().data.size()
+           << " | dump_to_buffer: " << bytes / legacy_s / 1e9 << " GB/s, " << legacy_s * 1e9 / (n_chunks * rounds)
+           << " ns/chunk | gather_subchunks: " << bytes / gather_s / 1e9 << " GB/s, "
+           << gather_s * 1e9 / (n_chunks * rounds) << " ns/chunk";
+  }
+
+  // Size-specialized kernel of the WIB-style fixed size superchunk paths
+  bench_fixed_size<wib_superchunk_size>("WIB", ring.get(), rounds);
+  bench_fixed_size<wib2_superchunk_size>("WIB2", ring.get(), rounds);
+  return 0;
+}
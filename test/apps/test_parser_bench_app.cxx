@@ -0,0 +1,241 @@
+/**
+ * @file test_parser_bench_app.cxx Throughput of BlockParser<DefaultParserImpl>
+ * with the AvailableParserOperations factories, on block streams produced by
+ * the software BlockEncoder, into a sink that discards payloads.
+ *
+ * Sweeps block size and trailer width, chunk size, superchunk factor and
+ * subchunk fragmentation. Every case is also written as one JSON object per
+ * line (--json FILE), for tracking regressions across releases.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "DefaultParserImpl.hpp"
+#include "TestSupport.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+
+#include "fdreadoutlibs/DAPHNEStreamSuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+#include "fdreadoutlibs/VariableSizePayloadTypeAdapter.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+#include "packetformat/block_parser.hpp"
+
+#include <nlohmann/json.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+using namespace dunedaq::flxlibs::testsupport;
+
+namespace {
+
+constexpr std::size_t frame_size = 464; // superchunk factor unit for the variable size cases
+constexpr double min_seconds = 0.2;
+
+struct BenchCase
+{
+  std::string op;
+  std::size_t block_size;
+  bool trailer_32b;
+  std::size_t chunk_size;
+  std::size_t superchunk_factor; // 0 for fixed size payload types
+  std::size_t max_subchunk;      // 0: as large as the block allows
+};
+
+inline uint64_t // NOLINT(build/unsigned)
+read_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+nlohmann::json
+time_parser(const BenchCase& bc, const EncodedStream& stream, DefaultParserImpl& impl)
+{
+  felix::packetformat::BlockParser<DefaultParserImpl> parser(impl);
+  parser.configure(bc.block_size, bc.trailer_32b);
+  auto parse_all = [&]() {
+    for (std::size_t b = 0; b < stream.n_blocks; ++b) {
+      parser.process(felix::packetformat::block_from_bytes(stream.blocks.data() + b * bc.block_size));
+    }
+  };
+
+  parse_all(); // warm-up: caches, allocator pools
+  std::size_t passes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = read_tsc(); // NOLINT(build/unsigned)
+  double seconds = 0;
+  do {
+    parse_all();
+    ++passes;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (seconds < min_seconds);
+  uint64_t cycles = read_tsc() - c0; // NOLINT(build/unsigned)
+
+  const double chunks = static_cast<double>(passes * stream.n_chunks);
+  const double bytes = chunks * bc.chunk_size;
+  impl.flush_local_stats();
+  auto snap = impl.get_stats().snapshot();
+  nlohmann::json result;
+  result["op"] = bc.op;
+  result["block_size"] = bc.block_size;
+  result["trailer_bits"] = bc.trailer_32b ? 32 : 16;
+  result["chunk_size"] = bc.chunk_size;
+  result["superchunk_factor"] = bc.superchunk_factor;
+  result["max_subchunk"] = bc.max_subchunk;
+  result["subchunks_per_chunk"] = static_cast<double>(stream.n_subchunks) / stream.n_chunks;
+  result["chunks"] = passes * stream.n_chunks;
+  result["seconds"] = seconds;
+  result["gbytes_per_s"] = bytes / seconds / 1e9;
+  result["chunks_per_s"] = chunks / seconds;
+  result["cycles_per_chunk"] = cycles / chunks; // TSC (reference) cycles, 0 where unavailable
+  result["dropped"] = snap.dropped_payload_ctr;
+  return result;
+}
+
+template<class Payload>
+nlohmann::json
+bench_fixsized(const BenchCase& bc, const EncodedStream& stream)
+{
+  std::shared_ptr<iomanager::SenderConcept<Payload>> sink = std::make_shared<NullSink<Payload>>();
+  DefaultParserImpl impl;
+  parsers::ParserOptions opts;
+  if (bc.op == "timestamped_chunk") {
+    opts.check_timestamps = true;
+    impl.process_chunk_func = parsers::timestampedChunkInto<Payload>(sink, impl.get_local_stats(), opts, 0);
+  } else {
+    impl.process_chunk_func = parsers::fixsizedChunkInto<Payload>(sink, impl.get_local_stats(), opts);
+  }
+  return time_parser(bc, stream, impl);
+}
+
+template<class Payload>
+nlohmann::json
+bench_heap(const BenchCase& bc, const EncodedStream& stream)
+{
+  std::shared_ptr<iomanager::SenderConcept<Payload*>> sink = std::make_shared<NullSink<Payload*>>();
+  DefaultParserImpl impl;
+  impl.process_chunk_func = parsers::fixsizedChunkViaHeap<Payload>(sink, impl.get_local_stats());
+  return time_parser(bc, stream, impl);
+}
+
+nlohmann::json
+bench_varsized(const BenchCase& bc, const EncodedStream& stream)
+{
+  using Payload = fdreadoutlibs::types::VariableSizePayloadTypeAdapter;
+  std::shared_ptr<iomanager::SenderConcept<Payload>> sink = std::make_shared<NullSink<Payload>>();
+  DefaultParserImpl impl;
+  parsers::ParserOptions opts;
+  if (bc.op == "coalesced_shortchunk") {
+    opts.coalesce_shortchunks = true;
+    auto coalescer = std::make_shared<parsers::ShortchunkCoalescer>(sink, impl.get_local_stats(), opts);
+    impl.process_chunk_func = parsers::coalescedChunkIntoWrapper(coalescer, sink, impl.get_local_stats(), opts);
+    impl.process_shortchunk_func = parsers::coalescedShortchunkInto(coalescer);
+    impl.process_block_func = parsers::coalescedBlockBoundary(coalescer);
+    impl.flush_func = parsers::coalescedFlush(coalescer);
+    return time_parser(bc, stream, impl);
+  }
+  impl.process_chunk_func = parsers::varsizedChunkIntoWrapper(sink, impl.get_local_stats(), opts);
+  impl.process_shortchunk_func = parsers::varsizedShortchunkIntoWrapper(sink, impl.get_local_stats(), opts);
+  return time_parser(bc, stream, impl);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  std::string json_filename;
+  std::size_t stream_bytes = 32 * 1024 * 1024;
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_filename = argv[++i];
+    } else if (arg == "--stream-mb" && i + 1 < argc) {
+      stream_bytes = std::stoul(argv[++i]) * 1024 * 1024;
+    } else if (arg == "--quick") {
+      quick = true;
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--json FILE] [--stream-mb N] [--quick]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  const std::vector<std::pair<std::size_t, bool>> block_formats = { { 1024, false }, { 4096, true } };
+  const std::vector<std::size_t> fragmentations =
+    quick ? std::vector<std::size_t>{ 0 } : std::vector<std::size_t>{ 0, 256, 64 };
+  const std::vector<std::size_t> superchunk_factors =
+    quick ? std::vector<std::size_t>{ 12 } : std::vector<std::size_t>{ 1, 6, 12, 24 };
+  const std::vector<std::size_t> small_sizes = quick ? std::vector<std::size_t>{ 64 } : std::vector<std::size_t>{ 16, 64, 256 };
+
+  using DAPHNE = fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter;
+  using DAPHNEStream = fdreadoutlibs::types::DAPHNEStreamSuperChunkTypeAdapter;
+
+  std::vector<nlohmann::json> results;
+  auto run = [&](const BenchCase& bc, auto&& bench) {
+    // Back to back replayable: whole sequence number periods
+    StreamSpec spec;
+    spec.block_size = bc.block_size;
+    spec.trailer_32b = bc.trailer_32b;
+    spec.chunk_size = bc.chunk_size;
+    spec.max_subchunk = bc.max_subchunk;
+    spec.whole_seqnr_periods = true;
+    auto stream = encode_stream(spec, stream_bytes);
+    auto result = bench(bc, stream);
+    TLOG() << result["op"].get<std::string>() << " block " << bc.block_size << "/" << (bc.trailer_32b ? 32 : 16)
+           << "b chunk " << bc.chunk_size << " max subchunk " << bc.max_subchunk << ": "
+           << result["gbytes_per_s"].get<double>() << " GB/s, " << result["chunks_per_s"].get<double>() / 1e6
+           << " Mchunks/s, " << result["cycles_per_chunk"].get<double>() << " cycles/chunk";
+    results.push_back(std::move(result));
+  };
+
+  for (auto [block_size, trailer_32b] : block_formats) {
+    for (auto max_subchunk : fragmentations) {
+      // Fixed size superchunks
+      for (std::string op : { "fixsized_chunk", "timestamped_chunk" }) {
+        run({ op, block_size, trailer_32b, sizeof(DAPHNE), 0, max_subchunk }, bench_fixsized<DAPHNE>);
+        run({ op, block_size, trailer_32b, sizeof(DAPHNEStream), 0, max_subchunk }, bench_fixsized<DAPHNEStream>);
+      }
+      run({ "heap_chunk", block_size, trailer_32b, sizeof(DAPHNE), 0, max_subchunk }, bench_heap<DAPHNE>);
+
+      // Variable size chunks: superchunks of frame_size frames, and small messages
+      for (auto factor : superchunk_factors) {
+        run({ "varsized_chunk", block_size, trailer_32b, factor * frame_size, factor, max_subchunk }, bench_varsized);
+      }
+      for (auto size : small_sizes) {
+        run({ "varsized_chunk", block_size, trailer_32b, size, 0, max_subchunk }, bench_varsized);
+      }
+    }
+    for (auto size : small_sizes) {
+      run({ "coalesced_shortchunk", block_size, trailer_32b, size, 0, 0 }, bench_varsized);
+    }
+  }
+
+  if (!json_filename.empty()) {
+    std::ofstream out(json_filename);
+    for (const auto& result : results) {
+      out << result.dump() << '\n';
+    }
+    TLOG() << results.size() << " results written to " << json_filename;
+  }
+  return EXIT_SUCCESS;
+}
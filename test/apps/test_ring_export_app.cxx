@@ -0,0 +1,245 @@
+/**
+ * @file test_ring_export_app.cxx Out-of-process consumers of the DMA ring
+ * through its shared memory export: a software DMA source read out by a
+ * CardWrapper, followed by a fast and a slow secondary process.
+ *
+ * The secondaries are forked before the readout starts and attach to the
+ * export once it is there. Both check every block they read intact against
+ * its descriptor and the per-elink sequence numbers; the slow one sleeps on
+ * every block, so it keeps falling behind the card. The readout must not
+ * drop a block because of either of them, and no secondary may ever take an
+ * overwritten block for an intact one.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "CardWrapper.hpp"
+#include "FelixIssues.hpp"
+#include "RingExport.hpp"
+#include "SoftwareDmaCard.hpp"
+
+#include "flxlibs/BlockFormat.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+struct Options
+{
+  std::size_t ring_mb{ 64 };
+  std::size_t links{ 6 };
+  double rate_mbps{ 1000 }; // aggregate
+  double seconds{ 3 };
+  double slow_delay_us{ 50 };
+  std::string json_file;
+};
+
+// Follows the export until the primary stops; the result goes to fd as one line of JSON
+int
+follow(const std::string& name, double delay_us, int fd)
+{
+  std::unique_ptr<RingExportReader> reader;
+  auto t0 = std::chrono::steady_clock::now();
+  while (reader == nullptr) {
+    try {
+      reader = std::make_unique<RingExportReader>(name);
+    } catch (const RingExportError&) {
+      if (std::chrono::steady_clock::now() - t0 > std::chrono::seconds(10)) {
+        return EXIT_FAILURE;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  uint64_t bad_blocks = 0; // NOLINT(build/unsigned)
+  uint64_t seqnr_gaps = 0; // NOLINT(build/unsigned)
+  uint64_t intact = 0;     // NOLINT(build/unsigned)
+  std::map<uint32_t, std::pair<uint32_t, uint64_t>> last; // NOLINT(build/unsigned) elink: seqnr, skipped blocks
+  std::vector<char> copy(reader->get_block_size());
+  RingExportReader::Block block;
+  const auto t_end = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  while (std::chrono::steady_clock::now() < t_end) {
+    if (!reader->next(block)) {
+      if (!reader->primary_running() && reader->get_backlog() == 0) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    std::memcpy(copy.data(), block.data, copy.size());
+    if (delay_us > 0) {
+      std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(delay_us));
+    }
+    if (!reader->still_valid(block)) {
+      continue;
+    }
+    intact++;
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, copy.data(), sizeof(header));
+    if (header != block.header || blockformat::header_sob(header) != blockformat::sob_32b_trailers) {
+      bad_blocks++;
+      continue;
+    }
+    auto stats = reader->get_stats();
+    const uint64_t skipped = stats.lost_blocks + stats.torn_blocks; // NOLINT(build/unsigned)
+    const uint32_t seqnr = blockformat::header_seqnr(header);      // NOLINT(build/unsigned)
+    auto it = last.find(blockformat::header_elink(header));
+    if (it != last.end() && it->second.second == skipped &&
+        seqnr != ((it->second.first + 1) & blockformat::max_seqnr)) {
+      seqnr_gaps++;
+    }
+    last[blockformat::header_elink(header)] = { seqnr, skipped };
+  }
+
+  auto stats = reader->get_stats();
+  nlohmann::json result = { { "delay_us", delay_us },          { "blocks", stats.blocks },
+                            { "intact_blocks", intact },       { "lost_blocks", stats.lost_blocks },
+                            { "torn_blocks", stats.torn_blocks }, { "bad_blocks", bad_blocks },
+                            { "seqnr_gaps", seqnr_gaps } };
+  std::string line = result.dump() + "\n";
+  return write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--ring-mb" && has_value) {
+      opts.ring_mb = std::stoul(argv[++i]);
+    } else if (arg == "--links" && has_value) {
+      opts.links = std::stoul(argv[++i]);
+    } else if (arg == "--rate" && has_value) {
+      opts.rate_mbps = std::stod(argv[++i]);
+    } else if (arg == "--seconds" && has_value) {
+      opts.seconds = std::stod(argv[++i]);
+    } else if (arg == "--slow-delay-us" && has_value) {
+      opts.slow_delay_us = std::stod(argv[++i]);
+    } else if (arg == "--json" && has_value) {
+      opts.json_file = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--ring-mb MB] [--links N] [--rate MB/s] [--seconds S]"
+             << " [--slow-delay-us US] [--json FILE]";
+      return EXIT_FAILURE;
+    }
+  }
+  const std::string name = "/flxlibs-test-ring-export-" + std::to_string(getpid());
+
+  // The secondaries, forked while this process has no threads yet
+  struct Secondary
+  {
+    std::string role;
+    pid_t pid;
+    int fd;
+  };
+  std::vector<Secondary> secondaries;
+  for (auto [role, delay_us] : { std::pair<std::string, double>{ "fast", 0 }, { "slow", opts.slow_delay_us } }) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      TLOG() << "pipe failed";
+      return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      _exit(follow(name, delay_us, fds[1]));
+    }
+    close(fds[1]);
+    secondaries.push_back({ role, pid, fds[0] });
+  }
+
+  // The primary
+  auto card = std::make_unique<SoftwareDmaCard>();
+  SoftwareDmaCard* sw_card = card.get();
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = opts.ring_mb << 20;
+  settings.poll_time = 100;
+  for (std::size_t l = 0; l < opts.links; ++l) {
+    settings.links_enabled.push_back(l);
+  }
+  CardWrapper card_wrapper(settings, std::move(card));
+  card_wrapper.set_ring_export(std::make_shared<RingExport>(name));
+
+  uint64_t primary_blocks = 0; // NOLINT(build/unsigned)
+  uint64_t primary_bad = 0;    // NOLINT(build/unsigned)
+  std::function<void(uint64_t)> count_block = [&](uint64_t block_addr) { // NOLINT(build/unsigned)
+    uint32_t header; // NOLINT(build/unsigned)
+    std::memcpy(&header, reinterpret_cast<const void*>(block_addr), sizeof(header)); // NOLINT
+    primary_bad += blockformat::header_sob(header) != blockformat::sob_32b_trailers;
+    primary_blocks++;
+  };
+  card_wrapper.set_block_addr_handler(count_block);
+  card_wrapper.configure();
+  card_wrapper.start();
+
+  SoftwareDmaCard::SourceSettings source;
+  source.rate_bytes_per_s = opts.rate_mbps * 1e6;
+  for (std::size_t l = 0; l < opts.links; ++l) {
+    source.elinks.push_back(l * 64);
+  }
+  sw_card->start_source(settings.dma_id, source);
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.seconds));
+  sw_card->stop_source();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  card_wrapper.stop();
+  auto source_stats = sw_card->get_source_stats();
+
+  nlohmann::json result = { { "ring_mb", opts.ring_mb },
+                            { "rate_mbps", opts.rate_mbps },
+                            { "source_blocks", source_stats.blocks_written },
+                            { "ring_dropped_blocks", source_stats.blocks_dropped },
+                            { "primary_blocks", primary_blocks },
+                            { "primary_bad_blocks", primary_bad } };
+  bool pass = source_stats.blocks_dropped == 0 && primary_bad == 0 && primary_blocks > 0;
+  for (auto& secondary : secondaries) {
+    std::string line;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(secondary.fd, buffer, sizeof(buffer))) > 0) {
+      line.append(buffer, n);
+    }
+    close(secondary.fd);
+    int status = 0;
+    waitpid(secondary.pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || line.empty()) {
+      result[secondary.role] = "failed";
+      pass = false;
+      continue;
+    }
+    auto follower = nlohmann::json::parse(line);
+    pass = pass && follower["bad_blocks"] == 0 && follower["seqnr_gaps"] == 0 && follower["intact_blocks"] > 0;
+    result[secondary.role] = follower;
+  }
+  result["pass"] = pass;
+  TLOG() << result.dump(2);
+  if (!opts.json_file.empty()) {
+    std::ofstream out(opts.json_file);
+    out << result.dump() << '\n';
+  }
+  return pass ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file test_ring_lookback_app.cxx Window requests served from the DMA ring
+ * by RingLookback, on a software DMA source running through CardWrapper and
+ * the ElinkModel parser threads.
+ *
+ * A requester thread keeps asking for time windows of random age within the
+ * lookback, on every elink in turn, and checks what comes back: whole
+ * chunks, timestamps increasing and not after the window. The chunks carry
+ * the time they were generated at (SoftwareDmaCard), which is the timestamp
+ * the ring is indexed by. Reports request latency, copy rate, stale chunks
+ * (overwritten before they were asked for) and ring drops at the source,
+ * with payloads forwarded as usual or (--no-forward) only indexed.
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "CardWrapper.hpp"
+#include "CreateElink.hpp"
+#include "ElinkModel.hpp"
+#include "RingLookback.hpp"
+#include "SoftwareDmaCard.hpp"
+
+#include "flxlibs/AvailableParserOperations.hpp"
+
+#include "fdreadoutlibs/DAPHNESuperChunkTypeAdapter.hpp"
+
+#include "iomanager/Sender.hpp"
+#include "logging/Logging.hpp"
+#include "packetformat/block_format.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq;
+using namespace dunedaq::flxlibs;
+
+namespace {
+
+using payload_t = fdreadoutlibs::types::DAPHNESuperChunkTypeAdapter;
+constexpr std::size_t block_size = 4096;
+
+/**
+ * @brief Counts the payloads it is given and discards them.
+ */
+template<typename Datatype>
+class CountingSink : public iomanager::SenderConcept<Datatype>
+{
+public:
+  CountingSink()
+    : iomanager::SenderConcept<Datatype>(iomanager::ConnectionId{ "lookback_sink", "Lookback" })
+  {}
+
+  void send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override { consume(std::move(data)); }
+  bool try_send(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/) override
+  {
+    consume(std::move(data));
+    return true;
+  }
+  void send_with_topic(Datatype&& data, iomanager::Sender::timeout_t /*timeout*/, std::string /*topic*/) override
+  {
+    consume(std::move(data));
+  }
+  void stop() override {}
+  bool is_ready_for_sending(iomanager::Sender::timeout_t /*timeout*/) override { return true; }
+
+  uint64_t get_payloads() const { return m_payloads.load(); } // NOLINT(build/unsigned)
+
+private:
+  void consume(Datatype&& data)
+  {
+    Datatype dropped(std::move(data));
+    m_payloads.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> m_payloads{ 0 }; // NOLINT(build/unsigned)
+};
+
+struct Options
+{
+  std::size_t ring_mb{ 512 };
+  std::size_t lookback_mb{ 256 };
+  std::size_t links{ 4 };
+  double rate_mbps{ 200 }; // per link
+  double seconds{ 5 };
+  double window_us{ 100 };
+  bool forward_payloads{ true };
+  std::string json_file;
+};
+
+uint64_t // NOLINT(build/unsigned)
+now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+double
+percentile(std::vector<double> values, double p)
+{
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, static_cast<std::size_t>(p * values.size()))];
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (arg == "--ring-mb" && has_value) {
+      opts.ring_mb = std::stoul(argv[++i]);
+    } else if (arg == "--lookback-mb" && has_value) {
+      opts.lookback_mb = std::stoul(argv[++i]);
+    } else if (arg == "--links" && has_value) {
+      opts.links = std::stoul(argv[++i]);
+    } else if (arg == "--rate" && has_value) {
+      opts.rate_mbps = std::stod(argv[++i]);
+    } else if (arg == "--seconds" && has_value) {
+      opts.seconds = std::stod(argv[++i]);
+    } else if (arg == "--window-us" && has_value) {
+      opts.window_us = std::stod(argv[++i]);
+    } else if (arg == "--no-forward") {
+      opts.forward_payloads = false;
+    } else if (arg == "--json" && has_value) {
+      opts.json_file = argv[++i];
+    } else {
+      TLOG() << "Usage: " << argv[0] << " [--ring-mb MB] [--lookback-mb MB] [--links N] [--rate MB/s per link]"
+             << " [--seconds S] [--window-us US] [--no-forward] [--json FILE]";
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto card = std::make_unique<SoftwareDmaCard>();
+  SoftwareDmaCard* sw_card = card.get();
+  CardWrapper::Settings settings;
+  settings.dma_memory_size = opts.ring_mb << 20;
+  settings.poll_time = 100;
+  for (std::size_t l = 0; l < opts.links; ++l) {
+    settings.links_enabled.push_back(l);
+  }
+  CardWrapper card_wrapper(settings, std::move(card));
+
+  RingLookback::Settings lookback_settings;
+  lookback_settings.lookback_bytes = opts.lookback_mb << 20;
+  lookback_settings.timestamp_offset = 0; // generation time stamped by SoftwareDmaCard
+  auto lookback = std::make_shared<RingLookback>(lookback_settings);
+  card_wrapper.set_lookback(lookback);
+
+  // Elinks as FelixReaderModule sets them up: link l is elink l*64
+  struct Elink
+  {
+    std::unique_ptr<ElinkModel<payload_t>> model;
+    std::shared_ptr<CountingSink<payload_t>> sink;
+  };
+  std::map<uint32_t, Elink> elinks; // NOLINT(build/unsigned)
+  std::vector<uint32_t> elink_ids;  // NOLINT(build/unsigned)
+  parsers::ParserOptions parser_opts;
+  SoftwareDmaCard::SourceSettings source;
+  source.block_size = block_size;
+  source.chunk_size = sizeof(payload_t);
+  source.rate_bytes_per_s = opts.rate_mbps * 1e6 * opts.links;
+  for (std::size_t l = 0; l < opts.links; ++l) {
+    auto id = static_cast<uint32_t>(l * 64); // NOLINT(build/unsigned)
+    auto& e = elinks[id];
+    e.model = std::make_unique<ElinkModel<payload_t>>();
+    e.model->set_ids(0, 0, static_cast<int>(l), static_cast<int>(id));
+    e.model->init(100000);
+    e.sink = std::make_shared<CountingSink<payload_t>>();
+    e.model->set_sink(e.sink);
+    wiring::MonotonicSuperchunk::wire(*e.model, parser_opts);
+    e.model->set_lookback(lookback, opts.forward_payloads);
+    e.model->conf(block_size, true);
+    source.elinks.push_back(id);
+    elink_ids.push_back(id);
+  }
+
+  std::function<void(uint64_t)> block_router = [&](uint64_t block_addr) { // NOLINT(build/unsigned)
+    const auto* block = felix::packetformat::block_from_bytes(reinterpret_cast<const char*>(block_addr)); // NOLINT
+    auto it = elinks.find(block->elink);
+    if (it != elinks.end()) {
+      it->second.model->queue_in_block_address(block_addr);
+    }
+  };
+  card_wrapper.set_block_addr_handler(block_router);
+  card_wrapper.configure();
+  for (auto& [id, e] : elinks) {
+    e.model->start();
+  }
+  card_wrapper.start();
+  sw_card->start_source(settings.dma_id, source);
+
+  // Requests: windows of random age within the time the lookback holds at this rate
+  const double lookback_ns = lookback_settings.lookback_bytes / (opts.rate_mbps * 1e6 * opts.links) * 1e9;
+  const auto window_ns = static_cast<uint64_t>(opts.window_us * 1000); // NOLINT(build/unsigned)
+  std::vector<double> latency_us;
+  uint64_t bad_windows = 0;   // NOLINT(build/unsigned)
+  uint64_t empty_windows = 0; // NOLINT(build/unsigned)
+  double copy_seconds = 0;
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<double> age(0.1, 0.9);
+  std::vector<char> out;
+  const auto t_fill = std::chrono::steady_clock::now() + std::chrono::duration<double>(lookback_ns / 1e9);
+  const auto t_end = std::chrono::steady_clock::now() + std::chrono::duration<double>(opts.seconds);
+  std::size_t request = 0;
+  while (std::chrono::steady_clock::now() < t_end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (std::chrono::steady_clock::now() < t_fill) {
+      continue; // the lookback is not full yet
+    }
+    const uint32_t elink = elink_ids[request++ % elink_ids.size()]; // NOLINT(build/unsigned)
+    const uint64_t begin = now_ns() - static_cast<uint64_t>(age(rng) * lookback_ns); // NOLINT(build/unsigned)
+    const uint64_t end = begin + window_ns;                                           // NOLINT(build/unsigned)
+    out.clear();
+    auto t0 = std::chrono::steady_clock::now();
+    auto result = lookback->read_window(elink, begin, end, out);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    latency_us.push_back(seconds * 1e6);
+    copy_seconds += seconds;
+
+    // Whole chunks, increasing timestamps, none after the window
+    bool good = out.size() == result.chunks * sizeof(payload_t);
+    uint64_t previous = 0; // NOLINT(build/unsigned)
+    for (std::size_t c = 0; good && c < result.chunks; ++c) {
+      uint64_t ts; // NOLINT(build/unsigned)
+      std::memcpy(&ts, out.data() + c * sizeof(payload_t), sizeof(ts));
+      good = ts >= previous && ts < end;
+      previous = ts;
+    }
+    bad_windows += !good;
+    empty_windows += result.chunks == 0;
+  }
+
+  sw_card->stop_source();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  card_wrapper.stop();
+  for (auto& [id, e] : elinks) {
+    e.model->stop();
+  }
+
+  auto source_stats = sw_card->get_source_stats();
+  auto stats = lookback->get_stats();
+  uint64_t payloads = 0; // NOLINT(build/unsigned)
+  for (auto& [id, e] : elinks) {
+    payloads += e.sink->get_payloads();
+  }
+  nlohmann::json result = { { "links", opts.links },
+                            { "rate_per_link_mbps", opts.rate_mbps },
+                            { "ring_mb", opts.ring_mb },
+                            { "lookback_mb", opts.lookback_mb },
+                            { "lookback_ms", lookback_ns / 1e6 },
+                            { "forward_payloads", opts.forward_payloads },
+                            { "chunks", source_stats.chunks },
+                            { "ring_dropped_blocks", source_stats.blocks_dropped },
+                            { "payloads", payloads },
+                            { "indexed_chunks", stats.indexed_chunks },
+                            { "unindexed_chunks", stats.unindexed_chunks },
+                            { "requests", stats.requests },
+                            { "served_chunks", stats.served_chunks },
+                            { "served_mb", stats.served_bytes / 1e6 },
+                            { "stale_chunks", stats.stale_chunks },
+                            { "empty_windows", empty_windows },
+                            { "bad_windows", bad_windows },
+                            { "latency_us_p50", percentile(latency_us, 0.5) },
+                            { "latency_us_p99", percentile(latency_us, 0.99) },
+                            { "copy_gbytes_per_s", copy_seconds > 0 ? stats.served_bytes / copy_seconds / 1e9 : 0 } };
+  TLOG() << result.dump(2);
+  if (!opts.json_file.empty()) {
+    std::ofstream out_file(opts.json_file);
+    out_file << result.dump() << '\n';
+  }
+  return bad_windows == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}